@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <QDateTime>
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+
+#include "audiocache.hpp"
+#include "tracer.hpp"
+
+/* A single file takes a quarter of the budget at most, an hour long mix shouldn't push everything else out */
+static constexpr qint64 MAX_FILE_SHARE {4};
+
+AudioCache::AudioCache()
+    : m_entries(std::make_shared<const Entries>())
+    , m_clock(0)
+    , m_budget(0)
+    , m_usedBytes(0)
+    , m_quit(false)
+    , m_clear(false)
+{
+    m_thread = std::thread(&AudioCache::run, this);
+}
+
+AudioCache::~AudioCache()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_condition.notify_one();
+    m_thread.join();
+}
+
+void AudioCache::setBudget(qint64 bytes)
+{
+    m_budget.store(std::max<qint64>(bytes, 0));
+    if (bytes <= 0) {
+        clear();
+    }
+}
+
+qint64 AudioCache::budget() const
+{
+    return m_budget.load();
+}
+
+void AudioCache::retain(const QString &path)
+{
+    if (path.isEmpty() or m_budget.load() <= 0) {
+        return;
+    }
+
+    /* Already there, whether it's still current is checked when it's used */
+    if (auto cached = entry(path)) {
+        cached->lastUsed.store(m_clock.fetch_add(1) + 1);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_queue.contains(path)) {
+            return;
+        }
+        m_queue.append(path);
+    }
+    m_condition.notify_one();
+}
+
+std::shared_ptr<AudioCache::Entry> AudioCache::entry(const QString &path) const
+{
+    auto entries = std::atomic_load(&m_entries);
+    for (const auto &entry : *entries) {
+        if (entry->path == path) {
+            return entry;
+        }
+    }
+
+    return {};
+}
+
+AudioCache::Bytes AudioCache::find(const QString &path) const
+{
+    auto cached = entry(path);
+    if (not cached) {
+        return {};
+    }
+
+    /* Edited since it was read */
+    QFileInfo info(path);
+    if (info.size() != cached->size or info.lastModified().toMSecsSinceEpoch() != cached->modified) {
+        return {};
+    }
+
+    cached->lastUsed.store(m_clock.fetch_add(1) + 1);
+    return cached->bytes;
+}
+
+qint64 AudioCache::usedBytes() const
+{
+    return m_usedBytes.load();
+}
+
+void AudioCache::clear()
+{
+    {
+        /* The cache thread is the only one replacing the entries */
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue.clear();
+        m_clear = true;
+    }
+    m_condition.notify_one();
+}
+
+void AudioCache::run()
+{
+    while (true) {
+        QString path;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this] { return m_quit or m_clear or not m_queue.isEmpty(); });
+            if (m_quit) {
+                return;
+            }
+
+            if (m_clear) {
+                m_clear = false;
+                std::atomic_store(&m_entries, std::make_shared<const Entries>());
+                m_usedBytes.store(0);
+                continue;
+            }
+
+            path = m_queue.takeFirst();
+        }
+
+        QFileInfo info(path);
+        auto size = info.size();
+        auto modified = info.lastModified().toMSecsSinceEpoch();
+        if (not info.isFile() or size <= 0 or size > m_budget.load() / MAX_FILE_SHARE) {
+            continue;
+        }
+
+        if (auto cached = entry(path); cached and cached->size == size and cached->modified == modified) {
+            cached->lastUsed.store(m_clock.fetch_add(1) + 1);
+            continue;
+        }
+
+        TRACE_SCOPE("AudioCache read");
+        QFile file(path);
+        if (not file.open(QIODevice::ReadOnly)) {
+            qWarning() << "Couldn't cache" << path << ":" << file.errorString();
+            continue;
+        }
+
+        auto bytes = std::make_shared<const QByteArray>(file.readAll());
+        if (bytes->size() != size) {
+            continue;
+        }
+
+        insert(path, size, modified, std::move(bytes));
+    }
+}
+
+void AudioCache::insert(const QString &path, qint64 size, qint64 modified, Bytes bytes)
+{
+    auto current = std::atomic_load(&m_entries);
+    Entries entries;
+    entries.reserve(current->size() + 1);
+    qint64 usedBytes {};
+    for (const auto &entry : *current) {
+        if (entry->path != path) {
+            entries.push_back(entry);
+            usedBytes += entry->size;
+        }
+    }
+
+    auto fresh = std::make_shared<Entry>();
+    fresh->path = path;
+    fresh->size = size;
+    fresh->modified = modified;
+    fresh->bytes = std::move(bytes);
+    fresh->lastUsed.store(m_clock.fetch_add(1) + 1);
+    entries.push_back(std::move(fresh));
+    usedBytes += size;
+
+    evict(entries, usedBytes);
+    m_usedBytes.store(usedBytes);
+    std::atomic_store(&m_entries, std::shared_ptr<const Entries>(std::make_shared<Entries>(std::move(entries))));
+}
+
+void AudioCache::evict(Entries &entries, qint64 &usedBytes) const
+{
+    auto budget = m_budget.load();
+
+    /* The newest entry is last and never goes, it was asked for just now */
+    while (usedBytes > budget and entries.size() > 1) {
+        auto oldest = std::min_element(entries.begin(), entries.end() - 1, [](const auto &left, const auto &right) {
+            return left->lastUsed.load() < right->lastUsed.load();
+        });
+        usedBytes -= (*oldest)->size;
+        entries.erase(oldest);
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef AUDIOCACHE_HPP
+#define AUDIOCACHE_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <thread>
+#include <vector>
+
+/* Whole files of the tracks played lately and of their neighbours, kept in memory so going back,
+ * replaying or skipping around opens the decoder without touching the disk.
+ *
+ * Files are read on the cache's own thread. Lookups don't take a lock, they search an immutable
+ * snapshot of the entries which the cache thread replaces after every change.
+ * The least recently used files go once the budget is exceeded. A stream still decoding
+ * evicted bytes keeps them alive until it's unloaded.
+ */
+class AudioCache
+{
+public:
+    using Bytes = std::shared_ptr<const QByteArray>;
+private:
+    struct Entry
+    {
+        QString path;
+        qint64 size;
+        qint64 modified;
+        Bytes bytes;
+        mutable std::atomic<quint64> lastUsed;
+    };
+    using Entries = std::vector<std::shared_ptr<Entry>>;
+
+    /* Only read and replaced through std::atomic_load and std::atomic_store */
+    std::shared_ptr<const Entries> m_entries;
+    mutable std::atomic<quint64> m_clock;
+    std::atomic<qint64> m_budget;
+    std::atomic<qint64> m_usedBytes;
+
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    bool m_quit;
+    bool m_clear;
+    QStringList m_queue;
+
+    void run();
+    void insert(const QString &path, qint64 size, qint64 modified, Bytes bytes);
+    void evict(Entries &entries, qint64 &usedBytes) const;
+    std::shared_ptr<Entry> entry(const QString &path) const;
+public:
+    AudioCache();
+    ~AudioCache();
+    AudioCache(const AudioCache &) = delete;
+    AudioCache &operator=(const AudioCache &) = delete;
+
+    void setBudget(qint64 bytes);
+    qint64 budget() const;
+    void retain(const QString &path);
+    Bytes find(const QString &path) const;
+    qint64 usedBytes() const;
+    void clear();
+};
+
+#endif // AUDIOCACHE_HPP
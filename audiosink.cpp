@@ -0,0 +1,274 @@
+#include <algorithm>
+#include <QDebug>
+
+#include "audiosink.hpp"
+#include "binaryio.hpp"
+
+static constexpr qint64 WAV_HEADER_SIZE {44};
+/* Fifth of a second, rides out a pump round that waits for the next track's decode */
+static constexpr int RING_DIVISOR {5};
+
+std::atomic<DeviceSink *> DeviceSink::s_playing {nullptr};
+
+std::unique_ptr<AudioSink> AudioSink::create(Kind kind, const QString &path)
+{
+    switch (kind) {
+    case Kind::Null:
+        return std::make_unique<NullSink>();
+    case Kind::WavFile:
+        return std::make_unique<WavFileSink>(path);
+    case Kind::GaplessDevice:
+        return std::make_unique<DeviceSink>();
+    case Kind::Device:
+        break;
+    }
+
+    return nullptr;
+}
+
+DeviceSink::DeviceSink()
+    : m_stream {}
+    , m_frames(0)
+    , m_capacity(0)
+    , m_writePosition(0)
+    , m_readPosition(0)
+    , m_discardPosition(0)
+{
+}
+
+DeviceSink::~DeviceSink()
+{
+    close();
+}
+
+bool DeviceSink::open(const Format &format)
+{
+    /* raylib's callbacks don't carry a pointer, so there's one at a time */
+    DeviceSink *none {nullptr};
+    if (not s_playing.compare_exchange_strong(none, this)) {
+        qWarning() << "Another device sink is already playing.";
+        return false;
+    }
+
+    m_format = format;
+    m_frames = 0;
+    m_capacity = format.sampleRate / RING_DIVISOR;
+    m_ring.assign(static_cast<size_t>(m_capacity * format.channels), 0);
+    m_writePosition = 0;
+    m_readPosition = 0;
+    m_discardPosition = 0;
+
+    InitAudioDevice();
+    if (not IsAudioDeviceReady()) {
+        qWarning() << "Couldn't open the audio device.";
+        s_playing = nullptr;
+        return false;
+    }
+
+    m_stream = LoadAudioStream(static_cast<unsigned int>(format.sampleRate),
+                               static_cast<unsigned int>(format.sampleSize),
+                               static_cast<unsigned int>(format.channels));
+    SetAudioStreamCallback(m_stream, &DeviceSink::fill);
+    PlayAudioStream(m_stream);
+    return true;
+}
+
+void DeviceSink::write(const void *frames, int frameCount)
+{
+    if (s_playing.load() != this) {
+        return;
+    }
+
+    /* Whatever doesn't fit would overwrite frames that weren't played yet */
+    auto count = std::min<qint64>(frameCount, framesWritable());
+    const auto *samples = static_cast<const qint16 *>(frames);
+    auto position = m_writePosition.load(std::memory_order_relaxed);
+    for (qint64 written {}; written < count;) {
+        auto offset = (position + written) % m_capacity;
+        auto chunk = std::min(count - written, m_capacity - offset);
+        std::copy_n(samples + written * m_format.channels, chunk * m_format.channels,
+                    m_ring.data() + offset * m_format.channels);
+        written += chunk;
+    }
+
+    m_writePosition.store(position + count, std::memory_order_release);
+    m_frames += count;
+}
+
+void DeviceSink::close()
+{
+    if (s_playing.load() != this) {
+        return;
+    }
+
+    /* The callback isn't called anymore once the stream is gone */
+    StopAudioStream(m_stream);
+    UnloadAudioStream(m_stream);
+    CloseAudioDevice();
+    s_playing = nullptr;
+}
+
+qint64 DeviceSink::framesWritten() const
+{
+    return m_frames;
+}
+
+qint64 DeviceSink::framesWritable() const
+{
+    /* Without a device it's thrown away like the null sink does */
+    if (s_playing.load() != this) {
+        return -1;
+    }
+
+    return m_capacity - (m_writePosition.load(std::memory_order_relaxed) - m_readPosition.load(std::memory_order_acquire));
+}
+
+qint64 DeviceSink::framesQueued() const
+{
+    auto read = std::max(m_readPosition.load(std::memory_order_acquire), m_discardPosition.load(std::memory_order_relaxed));
+    return std::max<qint64>(m_writePosition.load(std::memory_order_relaxed) - read, 0);
+}
+
+void DeviceSink::setPaused(bool paused)
+{
+    if (s_playing.load() != this) {
+        return;
+    }
+
+    /* The ring keeps its frames, resuming goes on from the very next one */
+    if (paused) {
+        PauseAudioStream(m_stream);
+    } else {
+        ResumeAudioStream(m_stream);
+    }
+}
+
+void DeviceSink::discard()
+{
+    /* Only the audio thread moves the read position, it skips ahead the next time it reads */
+    m_discardPosition.store(m_writePosition.load(std::memory_order_relaxed), std::memory_order_release);
+}
+
+void DeviceSink::fill(void *buffer, unsigned int frameCount)
+{
+    if (auto *sink = s_playing.load(std::memory_order_acquire)) {
+        sink->read(static_cast<qint16 *>(buffer), frameCount);
+    }
+}
+
+void DeviceSink::read(qint16 *samples, qint64 frameCount)
+{
+    auto position = std::max(m_readPosition.load(std::memory_order_relaxed), m_discardPosition.load(std::memory_order_acquire));
+    auto count = std::min(frameCount, m_writePosition.load(std::memory_order_acquire) - position);
+    for (qint64 copied {}; copied < count;) {
+        auto offset = (position + copied) % m_capacity;
+        auto chunk = std::min(count - copied, m_capacity - offset);
+        std::copy_n(m_ring.data() + offset * m_format.channels, chunk * m_format.channels,
+                    samples + copied * m_format.channels);
+        copied += chunk;
+    }
+
+    /* The engine fell behind, silence rather than old frames */
+    std::fill_n(samples + count * m_format.channels, (frameCount - count) * m_format.channels, qint16 {});
+    m_readPosition.store(position + count, std::memory_order_release);
+}
+
+NullSink::NullSink()
+    : m_frames(0)
+{
+}
+
+bool NullSink::open([[maybe_unused]] const Format &format)
+{
+    m_frames = 0;
+    return true;
+}
+
+void NullSink::write([[maybe_unused]] const void *frames, int frameCount)
+{
+    m_frames += frameCount;
+}
+
+void NullSink::close()
+{
+}
+
+qint64 NullSink::framesWritten() const
+{
+    return m_frames;
+}
+
+WavFileSink::WavFileSink(const QString &path)
+    : m_file(path)
+    , m_frames(0)
+{
+}
+
+WavFileSink::~WavFileSink()
+{
+    close();
+}
+
+bool WavFileSink::open(const Format &format)
+{
+    m_format = format;
+    m_frames = 0;
+
+    if (not m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Couldn't open" << m_file.fileName() << ":" << m_file.errorString();
+        return false;
+    }
+
+    writeHeader();
+    return true;
+}
+
+void WavFileSink::write(const void *frames, int frameCount)
+{
+    if (not m_file.isOpen()) {
+        return;
+    }
+
+    m_file.write(static_cast<const char *>(frames), static_cast<qint64>(frameCount) * m_format.frameBytes());
+    m_frames += frameCount;
+}
+
+void WavFileSink::close()
+{
+    if (not m_file.isOpen()) {
+        return;
+    }
+
+    /* Now the sizes are known */
+    m_file.seek(0);
+    writeHeader();
+    m_file.close();
+}
+
+qint64 WavFileSink::framesWritten() const
+{
+    return m_frames;
+}
+
+void WavFileSink::writeHeader()
+{
+    auto dataBytes = static_cast<quint32>(m_frames * m_format.frameBytes());
+
+    QByteArray header;
+    header.reserve(WAV_HEADER_SIZE);
+    header.append("RIFF");
+    appendValue<quint32>(header, static_cast<quint32>(WAV_HEADER_SIZE - 8) + dataBytes);
+    header.append("WAVE");
+    header.append("fmt ");
+    appendValue<quint32>(header, 16);
+    appendValue<quint16>(header, 1); /* PCM */
+    appendValue<quint16>(header, static_cast<quint16>(m_format.channels));
+    appendValue<quint32>(header, static_cast<quint32>(m_format.sampleRate));
+    appendValue<quint32>(header, static_cast<quint32>(m_format.sampleRate * m_format.frameBytes()));
+    appendValue<quint16>(header, static_cast<quint16>(m_format.frameBytes()));
+    appendValue<quint16>(header, static_cast<quint16>(m_format.sampleSize));
+    header.append("data");
+    appendValue<quint32>(header, dataBytes);
+
+    m_file.write(header);
+}
@@ -0,0 +1,111 @@
+#ifndef AUDIOSINK_HPP
+#define AUDIOSINK_HPP
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <QFile>
+#include <QString>
+#include <raylib.h>
+
+/* Where decoded audio goes when it doesn't go through raylib's music streams.
+ * The engine decodes every track whole and hands its frames to the sink in order, through the same DSP chain
+ * the device gets, so the next track's first frame follows the last one of the track before it.
+ * It's not the device's path though: there's no crossfade, seeking goes straight to the frame without a seek index,
+ * nothing comes from the audio cache, and tracker formats can't be decoded whole so they fail to load.
+ */
+class AudioSink
+{
+public:
+    enum class Kind { Device, GaplessDevice, Null, WavFile };
+
+    /* What the engine converts every track to before writing it */
+    struct Format
+    {
+        int sampleRate {48'000};
+        int sampleSize {16};
+        int channels {2};
+
+        int frameBytes() const { return sampleSize / 8 * channels; }
+    };
+
+    virtual ~AudioSink() = default;
+    virtual bool open(const Format &format) = 0;
+    virtual void write(const void *frames, int frameCount) = 0;
+    virtual void close() = 0;
+    virtual qint64 framesWritten() const = 0;
+
+    /* How many frames write takes right now, -1 when it takes anything and the engine sets the pace */
+    virtual qint64 framesWritable() const { return -1; }
+    /* Written but not heard yet */
+    virtual qint64 framesQueued() const { return 0; }
+    virtual void setPaused([[maybe_unused]] bool paused) {}
+    /* Drops what's queued, so a stop or a seek is heard right away */
+    virtual void discard() {}
+
+    /* Device has no sink, the engine plays through raylib's music streams */
+    static std::unique_ptr<AudioSink> create(Kind kind, const QString &path = {});
+};
+
+/* Plays through the sound card. raylib pulls the frames from a ring the engine keeps full,
+ * so it's the engine, not the pump rounds, that decides where one track ends and the next begins.
+ */
+class DeviceSink : public AudioSink
+{
+    static std::atomic<DeviceSink *> s_playing;
+
+    AudioStream m_stream;
+    Format m_format;
+    qint64 m_frames;
+    /* Written by the engine, read by raylib's audio thread, positions count frames since opening */
+    std::vector<qint16> m_ring;
+    qint64 m_capacity;
+    std::atomic<qint64> m_writePosition;
+    std::atomic<qint64> m_readPosition;
+    std::atomic<qint64> m_discardPosition;
+
+    static void fill(void *buffer, unsigned int frameCount);
+    void read(qint16 *samples, qint64 frameCount);
+public:
+    DeviceSink();
+    ~DeviceSink();
+    bool open(const Format &format) override;
+    void write(const void *frames, int frameCount) override;
+    void close() override;
+    qint64 framesWritten() const override;
+    qint64 framesWritable() const override;
+    qint64 framesQueued() const override;
+    void setPaused(bool paused) override;
+    void discard() override;
+};
+
+/* Throws everything away, for measuring the decoders and running without a sound card */
+class NullSink : public AudioSink
+{
+    qint64 m_frames;
+public:
+    NullSink();
+    bool open(const Format &format) override;
+    void write(const void *frames, int frameCount) override;
+    void close() override;
+    qint64 framesWritten() const override;
+};
+
+/* Writes a 16 bits PCM WAV file, the sizes in the header are filled in when it's closed */
+class WavFileSink : public AudioSink
+{
+    QFile m_file;
+    Format m_format;
+    qint64 m_frames;
+
+    void writeHeader();
+public:
+    explicit WavFileSink(const QString &path);
+    ~WavFileSink();
+    bool open(const Format &format) override;
+    void write(const void *frames, int frameCount) override;
+    void close() override;
+    qint64 framesWritten() const override;
+};
+
+#endif // AUDIOSINK_HPP
@@ -0,0 +1,263 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <vector>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSysInfo>
+#include <QTemporaryDir>
+
+#include <raylib.h>
+
+/* Measures the decoders behind every format the player opens:
+ *   - decode throughput of the whole file (LoadWave),
+ *   - time to first sample of a music stream (LoadMusicStream and the first UpdateMusicStream),
+ *   - seek latency at random offsets (stop, seek and refill a sub-buffer, like the engine does),
+ *   - peak memory while decoding (Linux only).
+ * Results are printed as JSON. WAV and QOA fixtures are generated when none are given,
+ * the other formats need a fixture in --fixtures since raylib can't encode them.
+ */
+
+using Clock = std::chrono::steady_clock;
+
+static const QStringList FORMATS {"wav", "qoa", "mp3", "ogg", "flac", "xm", "mod"};
+static constexpr int FIXTURE_SECONDS {60};
+static constexpr int FIXTURE_SAMPLE_RATE {44'100};
+static constexpr int SEEKS {32};
+static constexpr double PI {3.14159265358979323846};
+
+static double millisecondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+#ifdef Q_OS_LINUX
+static qint64 procStatusKiB(const QByteArray &field)
+{
+    QFile status("/proc/self/status");
+    if (not status.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+
+    for (const auto &line : status.readAll().split('\n')) {
+        if (line.startsWith(field)) {
+            return line.mid(field.size()).trimmed().split(' ').first().toLongLong();
+        }
+    }
+
+    return -1;
+}
+
+static void resetPeakMemory()
+{
+    /* Makes VmHWM start over from the current resident size */
+    QFile clearRefs("/proc/self/clear_refs");
+    if (clearRefs.open(QIODevice::WriteOnly)) {
+        clearRefs.write("5");
+    }
+}
+#endif
+
+static QString generateFixture(const QString &directory, const QString &format)
+{
+    /* A sweep with a bit of noise, stereo, so the encoder has something to chew on */
+    auto frames = static_cast<unsigned int>(FIXTURE_SECONDS * FIXTURE_SAMPLE_RATE);
+    std::vector<short> samples(frames * 2);
+    std::mt19937 random(1);
+    std::uniform_real_distribution<double> noise(-0.05, 0.05);
+    double phase {};
+
+    for (unsigned int frame {}; frame < frames; ++frame) {
+        auto time = static_cast<double>(frame) / FIXTURE_SAMPLE_RATE;
+        phase += 2.0 * PI * (110.0 + 1'000.0 * time / FIXTURE_SECONDS) / FIXTURE_SAMPLE_RATE;
+        auto value = 0.5 * std::sin(phase);
+        samples[2 * frame] = static_cast<short>((value + noise(random)) * 32'767);
+        samples[2 * frame + 1] = static_cast<short>((0.8 * value + noise(random)) * 32'767);
+    }
+
+    Wave wave {frames, FIXTURE_SAMPLE_RATE, 16, 2, samples.data()};
+    auto path = QDir(directory).filePath(QString("fixture.%1").arg(format));
+    if (not ExportWave(wave, path.toStdString().c_str())) {
+        return {};
+    }
+
+    return path;
+}
+
+static QString findFixture(const QString &directory, const QString &format)
+{
+    if (directory.isEmpty()) {
+        return {};
+    }
+
+    auto files = QDir(directory).entryInfoList({QString("*.%1").arg(format)}, QDir::Files, QDir::Name);
+    return files.isEmpty() ? QString() : files.first().absoluteFilePath();
+}
+
+static QJsonObject benchmarkDecode(const QString &path, int iterations)
+{
+    QJsonObject result;
+    auto best = std::numeric_limits<double>::max();
+    unsigned int frames {};
+    unsigned int sampleRate {};
+
+#ifdef Q_OS_LINUX
+    resetPeakMemory();
+    auto residentBefore = procStatusKiB("VmRSS:");
+#endif
+
+    for (int i {}; i < iterations; ++i) {
+        auto start = Clock::now();
+        auto wave = LoadWave(path.toStdString().c_str());
+        auto elapsed = millisecondsSince(start);
+        if (not IsWaveReady(wave)) {
+            /* Trackers are only rendered through music streams */
+            return result;
+        }
+
+        frames = wave.frameCount;
+        sampleRate = wave.sampleRate;
+        UnloadWave(wave);
+        best = std::min(best, elapsed);
+    }
+
+    result["frames"] = static_cast<qint64>(frames);
+    result["sampleRate"] = static_cast<qint64>(sampleRate);
+    result["decodeMs"] = best;
+    result["framesPerSecond"] = frames / (best / 1'000.0);
+    result["realtimeFactor"] = (static_cast<double>(frames) / sampleRate) / (best / 1'000.0);
+#ifdef Q_OS_LINUX
+    result["peakDecodeKiB"] = procStatusKiB("VmHWM:") - residentBefore;
+#endif
+    return result;
+}
+
+static QJsonObject benchmarkStream(const QString &path)
+{
+    QJsonObject result;
+
+    auto start = Clock::now();
+    auto music = LoadMusicStream(path.toStdString().c_str());
+    if (not IsMusicReady(music)) {
+        return result;
+    }
+    UpdateMusicStream(music);
+    result["firstSampleMs"] = millisecondsSince(start);
+
+    auto length = GetMusicTimeLength(music);
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> offset(0.0f, length * 0.95f);
+    std::vector<double> seeks;
+    seeks.reserve(SEEKS);
+
+    for (int i {}; i < SEEKS; ++i) {
+        auto position = offset(random);
+        auto seekStart = Clock::now();
+        StopMusicStream(music);
+        SeekMusicStream(music, position);
+        UpdateMusicStream(music);
+        seeks.push_back(millisecondsSince(seekStart));
+    }
+    UnloadMusicStream(music);
+
+    std::sort(seeks.begin(), seeks.end());
+    auto percentile = [&seeks](double fraction) {
+        return seeks[std::min(seeks.size() - 1, static_cast<size_t>(fraction * seeks.size()))];
+    };
+
+    result["seekMs"] = QJsonObject {
+        {"mean", std::accumulate(seeks.cbegin(), seeks.cend(), 0.0) / seeks.size()},
+        {"p50", percentile(0.5)},
+        {"p95", percentile(0.95)},
+        {"max", seeks.back()},
+    };
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("decodebenchmark");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Measures decoding costs of every supported format.");
+    parser.addHelpOption();
+    QCommandLineOption fixturesOption("fixtures", "Directory with one file per format to measure.", "directory");
+    QCommandLineOption iterationsOption("iterations", "Times each file is decoded, the best run counts.", "count", "3");
+    QCommandLineOption outputOption("output", "Write the JSON report here instead of the standard output.", "path");
+    parser.addOption(fixturesOption);
+    parser.addOption(iterationsOption);
+    parser.addOption(outputOption);
+    parser.process(app);
+
+    auto iterations = std::max(1, parser.value(iterationsOption).toInt());
+    auto fixtures = parser.value(fixturesOption);
+
+    SetTraceLogLevel(LOG_ERROR);
+    /* Headless machines end up on miniaudio's null backend, if not even that works streams are skipped */
+    InitAudioDevice();
+    bool hasDevice = IsAudioDeviceReady();
+
+    QTemporaryDir generated;
+    QJsonArray results;
+
+    for (const auto &format : FORMATS) {
+        QJsonObject result {{"format", format}};
+
+        auto path = findFixture(fixtures, format);
+        if (path.isEmpty() and (format == "wav" or format == "qoa") and generated.isValid()) {
+            path = generateFixture(generated.path(), format);
+        }
+
+        if (path.isEmpty()) {
+            result["skipped"] = "no fixture";
+            results.append(result);
+            continue;
+        }
+
+        result["file"] = QFileInfo(path).fileName();
+        result["bytes"] = QFileInfo(path).size();
+        result["decode"] = benchmarkDecode(path, iterations);
+        if (hasDevice) {
+            result["stream"] = benchmarkStream(path);
+        }
+        results.append(result);
+    }
+
+    if (hasDevice) {
+        CloseAudioDevice();
+    }
+
+    QJsonObject report {
+        {"cpu", QSysInfo::currentCpuArchitecture()},
+        {"os", QSysInfo::prettyProductName()},
+        {"raylib", RAYLIB_VERSION},
+        {"iterations", iterations},
+        {"results", results},
+    };
+    auto json = QJsonDocument(report).toJson();
+
+    if (parser.isSet(outputOption)) {
+        QFile output(parser.value(outputOption));
+        if (not output.open(QIODevice::WriteOnly)) {
+            qCritical("Couldn't write %s", qPrintable(output.fileName()));
+            return 1;
+        }
+        output.write(json);
+    } else {
+        QFile output;
+        output.open(stdout, QIODevice::WriteOnly);
+        output.write(json);
+    }
+
+    return 0;
+}
@@ -0,0 +1,227 @@
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QListView>
+#include <QSysInfo>
+#include <QTemporaryDir>
+
+#include "binaryio.hpp"
+#include "mainwindow.hpp"
+#include "metadataprober.hpp"
+#include "sessionstore.hpp"
+
+/* Measures how long the player takes from nothing to a window showing the last session's queue:
+ *   - constructing the main window, which restores the session,
+ *   - the first paint of the playlist, which is when it's usable,
+ *   - every song in it probed, which happens in the background after that.
+ * Every run starts from a session of the given size in a temporary config directory, with a short
+ * WAV file on disk for every song, and nothing is ever played. Results are printed as JSON,
+ * a run slower to be usable than the budget makes the exit status 1.
+ * The config directory is moved through XDG_CONFIG_HOME, so this only isolates itself on Linux.
+ */
+
+using Clock = std::chrono::steady_clock;
+
+static constexpr int ALBUM_TRACKS {12};
+static constexpr int ARTIST_ALBUMS {8};
+
+static double millisecondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+/* 10 ms of silence, 16-bit mono at 8 kHz */
+static QByteArray shortWave()
+{
+    static constexpr quint32 SAMPLE_RATE {8'000};
+    static constexpr quint32 DATA_SIZE {SAMPLE_RATE / 100 * 2};
+
+    QByteArray wave;
+    wave.append("RIFF", 4);
+    appendValue<quint32>(wave, 36 + DATA_SIZE);
+    wave.append("WAVEfmt ", 8);
+    appendValue<quint32>(wave, 16);
+    appendValue<quint16>(wave, 1);
+    appendValue<quint16>(wave, 1);
+    appendValue<quint32>(wave, SAMPLE_RATE);
+    appendValue<quint32>(wave, SAMPLE_RATE * 2);
+    appendValue<quint16>(wave, 2);
+    appendValue<quint16>(wave, 16);
+    wave.append("data", 4);
+    appendValue<quint32>(wave, DATA_SIZE);
+    wave.append(static_cast<int>(DATA_SIZE), '\0');
+    return wave;
+}
+
+static QStringList writeSongs(const QString &musicDirectory, int tracks)
+{
+    auto wave = shortWave();
+    QStringList paths;
+    paths.reserve(tracks);
+    for (int i {}; i < tracks; ++i) {
+        auto album = i / ALBUM_TRACKS;
+        auto directory = QString("%1/Artist %2/Album %3").arg(musicDirectory).arg(album / ARTIST_ALBUMS).arg(album % ARTIST_ALBUMS);
+        if (i % ALBUM_TRACKS == 0) {
+            QDir().mkpath(directory);
+        }
+
+        auto path = QString("%1/%2 Track.wav").arg(directory).arg(i % ALBUM_TRACKS + 1, 2, 10, QChar('0'));
+        QFile file(path);
+        if (file.open(QIODevice::WriteOnly)) {
+            file.write(wave);
+        }
+        paths << path;
+    }
+
+    return paths;
+}
+
+static void writeSession(const QString &configDirectory, const QStringList &songs)
+{
+    SessionStore::Session session;
+    session.tracks = songs;
+    session.current = songs.size() / 2;
+    session.position = 42.0f;
+    session.repeat = true;
+
+    SessionStore(QString("%1%2%3%2%4").arg(configDirectory, QDir::separator(), PROGRAM_NAME, "session.bin")).save(session);
+}
+
+/* Notices when a widget was painted */
+class PaintWatcher : public QObject
+{
+public:
+    bool painted {false};
+
+    bool eventFilter(QObject *watched, QEvent *event) override
+    {
+        if (event->type() == QEvent::Paint) {
+            painted = true;
+        }
+        return QObject::eventFilter(watched, event);
+    }
+};
+
+static QJsonObject benchmarkStartup(int tracks, int iterations)
+{
+    auto bestConstruct = std::numeric_limits<double>::max();
+    auto bestUsable = std::numeric_limits<double>::max();
+    auto bestProbed = std::numeric_limits<double>::max();
+    int rows {};
+
+    /* Written once, every run still probes them from scratch since the metadata cache is in the config */
+    QTemporaryDir music;
+    auto songs = writeSongs(music.path(), tracks);
+
+    for (int i {}; i < iterations; ++i) {
+        QTemporaryDir config;
+        qputenv("XDG_CONFIG_HOME", config.path().toLocal8Bit());
+        writeSession(config.path(), songs);
+
+        auto start = Clock::now();
+        auto window = std::make_unique<MainWindow>();
+        auto constructed = millisecondsSince(start);
+
+        int probed {};
+        QObject::connect(window->findChild<MetadataProber *>(), &MetadataProber::probed, [&probed](QVector<ProbeResult> results) {
+            probed += results.size();
+        });
+
+        auto *listView = window->findChild<QListView *>();
+        PaintWatcher watcher;
+        listView->viewport()->installEventFilter(&watcher);
+        window->show();
+        while (not watcher.painted and millisecondsSince(start) < 10'000.0) {
+            QApplication::processEvents(QEventLoop::AllEvents, 1);
+        }
+        auto usable = millisecondsSince(start);
+        rows = listView->model()->rowCount();
+
+        while (probed < tracks and millisecondsSince(start) < 60'000.0) {
+            QApplication::processEvents(QEventLoop::AllEvents, 1);
+        }
+        auto probedAll = millisecondsSince(start);
+
+        listView->viewport()->removeEventFilter(&watcher);
+        window.reset();
+        bestConstruct = std::min(bestConstruct, constructed);
+        bestUsable = std::min(bestUsable, usable);
+        bestProbed = std::min(bestProbed, probedAll);
+    }
+
+    return {
+        {"tracks", tracks},
+        {"rowsShown", rows},
+        {"constructMs", bestConstruct},
+        {"usableMs", bestUsable},
+        {"probedMs", bestProbed},
+    };
+}
+
+int main(int argc, char *argv[])
+{
+    /* No display needed, the offscreen platform still paints */
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+
+    QApplication app(argc, argv);
+    QApplication::setApplicationName("startupbenchmark");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Measures the time from launch to a usable window with the last queue in it.");
+    parser.addHelpOption();
+    QCommandLineOption tracksOption("tracks", "Comma separated queue sizes to restore.", "counts", "0,1000,10000,100000");
+    QCommandLineOption iterationsOption("iterations", "Times each size is started, the best run counts.", "count", "3");
+    QCommandLineOption budgetOption("budget", "Slowest acceptable time to a usable window.", "milliseconds", "100");
+    QCommandLineOption outputOption("output", "Write the JSON report here instead of the standard output.", "path");
+    parser.addOption(tracksOption);
+    parser.addOption(iterationsOption);
+    parser.addOption(budgetOption);
+    parser.addOption(outputOption);
+    parser.process(app);
+
+    auto iterations = std::max(1, parser.value(iterationsOption).toInt());
+    auto budget = parser.value(budgetOption).toDouble();
+
+    QJsonArray results;
+    bool withinBudget {true};
+    for (const auto &count : parser.value(tracksOption).split(',', Qt::SkipEmptyParts)) {
+        auto result = benchmarkStartup(std::max(0, count.trimmed().toInt()), iterations);
+        withinBudget = withinBudget and result["usableMs"].toDouble() <= budget;
+        results.append(result);
+    }
+
+    QJsonObject report {
+        {"cpu", QSysInfo::currentCpuArchitecture()},
+        {"os", QSysInfo::prettyProductName()},
+        {"iterations", iterations},
+        {"budgetMs", budget},
+        {"withinBudget", withinBudget},
+        {"results", results},
+    };
+    auto json = QJsonDocument(report).toJson();
+
+    if (parser.isSet(outputOption)) {
+        QFile output(parser.value(outputOption));
+        if (not output.open(QIODevice::WriteOnly)) {
+            qCritical("Couldn't write %s", qPrintable(output.fileName()));
+            return 1;
+        }
+        output.write(json);
+    } else {
+        QFile output;
+        output.open(stdout, QIODevice::WriteOnly);
+        output.write(json);
+    }
+
+    return withinBudget ? 0 : 1;
+}
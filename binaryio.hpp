@@ -0,0 +1,21 @@
+#ifndef BINARYIO_HPP
+#define BINARYIO_HPP
+
+#include <QByteArray>
+#include <QtEndian>
+
+/* Our binary files are little-endian no matter the host */
+template <typename T>
+inline T readValue(const uchar *data)
+{
+    return qFromLittleEndian<T>(data);
+}
+
+template <typename T>
+inline void appendValue(QByteArray &bytes, T value)
+{
+    auto littleEndian = qToLittleEndian(value);
+    bytes.append(reinterpret_cast<const char *>(&littleEndian), sizeof(T));
+}
+
+#endif // BINARYIO_HPP
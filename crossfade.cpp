@@ -0,0 +1,104 @@
+#include <algorithm>
+#include <cmath>
+
+#include "crossfade.hpp"
+#include "dspchain.hpp"
+
+static constexpr double PI {3.14159265358979323846};
+
+std::atomic<qint64> Crossfade::s_length {0};
+std::atomic<qint64> Crossfade::s_fadedOut {0};
+std::atomic<qint64> Crossfade::s_fadedIn {0};
+std::atomic<float> Crossfade::s_outgoingLevel {1.0f};
+
+Crossfade::Crossfade()
+    : m_outgoing {}
+    , m_incoming {}
+    , m_running(false)
+{
+}
+
+Crossfade::~Crossfade()
+{
+    finish();
+}
+
+void Crossfade::start(AudioStream outgoing, AudioStream incoming, qint64 frames, float outgoingLevel)
+{
+    finish();
+    if (frames <= 0) {
+        return;
+    }
+
+    s_length.store(frames, std::memory_order_relaxed);
+    s_fadedOut.store(0, std::memory_order_relaxed);
+    s_fadedIn.store(0, std::memory_order_relaxed);
+    s_outgoingLevel.store(outgoingLevel, std::memory_order_relaxed);
+
+    /* raylib takes the audio lock to attach them, which publishes the above too */
+    m_outgoing = outgoing;
+    m_incoming = incoming;
+    AttachAudioStreamProcessor(m_outgoing, fadeOutCallback);
+    AttachAudioStreamProcessor(m_incoming, fadeInCallback);
+    m_running = true;
+}
+
+bool Crossfade::isRunning() const
+{
+    return m_running;
+}
+
+bool Crossfade::isFinished() const
+{
+    return m_running and s_fadedIn.load(std::memory_order_relaxed) >= s_length.load(std::memory_order_relaxed);
+}
+
+void Crossfade::finish()
+{
+    if (not m_running) {
+        return;
+    }
+
+    /* Neither processor is running once these return, raylib holds the audio lock while it mixes */
+    DetachAudioStreamProcessor(m_outgoing, fadeOutCallback);
+    DetachAudioStreamProcessor(m_incoming, fadeInCallback);
+    m_outgoing = {};
+    m_incoming = {};
+    m_running = false;
+}
+
+void Crossfade::fade(float *samples, unsigned int frameCount, std::atomic<qint64> &faded, bool rising)
+{
+    auto length = s_length.load(std::memory_order_relaxed);
+    auto done = faded.load(std::memory_order_relaxed);
+    faded.store(done + frameCount, std::memory_order_relaxed);
+    if (rising and done >= length) {
+        return;
+    }
+
+    /* cos² + sin² = 1, uncorrelated tracks keep the same power all the way through */
+    auto level = rising ? 1.0f : s_outgoingLevel.load(std::memory_order_relaxed);
+    auto curve = [length, level, rising](qint64 frame) {
+        auto angle = std::min(static_cast<double>(frame) / static_cast<double>(length), 1.0) * PI / 2.0;
+        return level * static_cast<float>(rising ? std::sin(angle) : std::cos(angle));
+    };
+
+    /* A period is a few milliseconds, a straight line between its ends is as good as the curve */
+    auto from = curve(done);
+    auto to = curve(done + frameCount);
+    DspChain::applyGain(samples, frameCount, from, (to - from) / static_cast<float>(frameCount));
+}
+
+void Crossfade::fadeOutCallback(void *buffer, unsigned int frames)
+{
+    if (frames > 0) {
+        fade(static_cast<float *>(buffer), frames, s_fadedOut, false);
+    }
+}
+
+void Crossfade::fadeInCallback(void *buffer, unsigned int frames)
+{
+    if (frames > 0) {
+        fade(static_cast<float *>(buffer), frames, s_fadedIn, true);
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef CROSSFADE_HPP
+#define CROSSFADE_HPP
+
+#include <atomic>
+#include <QtGlobal>
+#include <raylib.h>
+
+/* Equal-power crossfade from the track that's ending into the next one. Both decoders run at once
+ * and raylib's mixer adds them up, the curves are applied by a processor on each stream.
+ * Those run in the audio thread on what's about to be mixed, so the fade follows the frames
+ * that were actually played instead of how often the playback thread gets to run.
+ * raylib's processors get no context, there's only ever one crossfade going on.
+ */
+class Crossfade
+{
+    /* Device frames */
+    static std::atomic<qint64> s_length;
+    static std::atomic<qint64> s_fadedOut;
+    static std::atomic<qint64> s_fadedIn;
+    /* The outgoing track's level next to the incoming one's, the DSP chain already plays the latter */
+    static std::atomic<float> s_outgoingLevel;
+
+    AudioStream m_outgoing;
+    AudioStream m_incoming;
+    bool m_running;
+
+    static void fade(float *samples, unsigned int frameCount, std::atomic<qint64> &faded, bool rising);
+public:
+    Crossfade();
+    ~Crossfade();
+    Crossfade(const Crossfade &) = delete;
+    Crossfade &operator=(const Crossfade &) = delete;
+
+    /* Before the incoming stream starts playing */
+    void start(AudioStream outgoing, AudioStream incoming, qint64 frames, float outgoingLevel);
+    bool isRunning() const;
+    /* The incoming track is at full level */
+    bool isFinished() const;
+    /* Before either stream is reopened or unloaded */
+    void finish();
+    static void fadeOutCallback(void *buffer, unsigned int frames);
+    static void fadeInCallback(void *buffer, unsigned int frames);
+};
+
+#endif // CROSSFADE_HPP
@@ -0,0 +1,88 @@
+#include <utility>
+
+#include "decodedtrack.hpp"
+#include "tracer.hpp"
+
+DecodedTrack::DecodedTrack()
+    : m_wave {}
+{
+}
+
+DecodedTrack::~DecodedTrack()
+{
+    reset();
+}
+
+DecodedTrack::DecodedTrack(DecodedTrack &&other) noexcept
+    : m_wave(std::exchange(other.m_wave, Wave {}))
+    , m_path(std::move(other.m_path))
+{
+}
+
+DecodedTrack &DecodedTrack::operator=(DecodedTrack &&other) noexcept
+{
+    if (this != &other) {
+        reset();
+        m_wave = std::exchange(other.m_wave, Wave {});
+        m_path = std::move(other.m_path);
+    }
+
+    return *this;
+}
+
+DecodedTrack DecodedTrack::load(const QString &path, const AudioSink::Format &format)
+{
+    TRACE_SCOPE("DecodedTrack::load");
+    DecodedTrack track;
+    /* Trackers can't be loaded as a wave, they'll fail here */
+    track.m_wave = LoadWave(path.toStdString().c_str());
+    if (not IsWaveReady(track.m_wave)) {
+        track.m_wave = {};
+        return track;
+    }
+
+    WaveFormat(&track.m_wave, format.sampleRate, format.sampleSize, format.channels);
+    track.m_path = path;
+    return track;
+}
+
+bool DecodedTrack::isReady() const
+{
+    return IsWaveReady(m_wave);
+}
+
+const QString &DecodedTrack::path() const
+{
+    return m_path;
+}
+
+void DecodedTrack::rename(QString path)
+{
+    m_path = std::move(path);
+}
+
+unsigned int DecodedTrack::frameCount() const
+{
+    return m_wave.frameCount;
+}
+
+unsigned int DecodedTrack::sampleRate() const
+{
+    return m_wave.sampleRate;
+}
+
+const void *DecodedTrack::frames(unsigned int from) const
+{
+    auto frameBytes = static_cast<size_t>(m_wave.sampleSize / 8 * m_wave.channels);
+    return static_cast<const char *>(m_wave.data) + from * frameBytes;
+}
+
+void DecodedTrack::reset()
+{
+    if (IsWaveReady(m_wave)) {
+        UnloadWave(m_wave);
+    }
+
+    m_wave = {};
+    m_path.clear();
+}
@@ -0,0 +1,36 @@
+#ifndef DECODEDTRACK_HPP
+#define DECODEDTRACK_HPP
+
+#include <QString>
+
+#include <raylib.h>
+
+#include "audiosink.hpp"
+
+/* A whole track decoded into memory and converted to the sink's format,
+ * for sinks that pull audio themselves instead of going through raylib's audio device.
+ */
+class DecodedTrack
+{
+    Wave m_wave;
+    QString m_path;
+public:
+    DecodedTrack();
+    ~DecodedTrack();
+    DecodedTrack(const DecodedTrack &) = delete;
+    DecodedTrack &operator=(const DecodedTrack &) = delete;
+    DecodedTrack(DecodedTrack &&other) noexcept;
+    DecodedTrack &operator=(DecodedTrack &&other) noexcept;
+
+    static DecodedTrack load(const QString &path, const AudioSink::Format &format);
+
+    bool isReady() const;
+    const QString &path() const;
+    void rename(QString path);
+    unsigned int frameCount() const;
+    unsigned int sampleRate() const;
+    const void *frames(unsigned int from) const;
+    void reset();
+};
+
+#endif // DECODEDTRACK_HPP
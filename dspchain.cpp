@@ -0,0 +1,378 @@
+#include <algorithm>
+#include <cmath>
+
+#include <raylib.h>
+
+#include "dspchain.hpp"
+#include "tracer.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DSPCHAIN_X86
+#include <immintrin.h>
+#endif
+
+static constexpr float PI {3.14159265f};
+/* Filter state this small turns into denormals on silence, which are slow on x86 */
+static constexpr float DENORMAL_LIMIT {1e-20f};
+
+static std::atomic<DspChain *> s_attached {nullptr};
+
+static void filterScalar(float *samples, unsigned int frameCount, const DspChain::Coefficients &coefficients,
+                         DspChain::FilterState &state)
+{
+    for (int channel {}; channel < 2; ++channel) {
+        auto z1 = state.z1[channel];
+        auto z2 = state.z2[channel];
+        for (unsigned int frame {}; frame < frameCount; ++frame) {
+            auto &sample = samples[frame * 2 + channel];
+            auto output = coefficients.b0 * sample + z1;
+            z1 = coefficients.b1 * sample - coefficients.a1 * output + z2;
+            z2 = coefficients.b2 * sample - coefficients.a2 * output;
+            sample = output;
+        }
+        state.z1[channel] = z1;
+        state.z2[channel] = z2;
+    }
+}
+
+static void applyGainScalar(float *samples, unsigned int frameCount, float gain, float step)
+{
+    for (unsigned int frame {}; frame < frameCount; ++frame) {
+        auto frameGain = gain + step * static_cast<float>(frame);
+        samples[frame * 2] = std::clamp(samples[frame * 2] * frameGain, -1.0f, 1.0f);
+        samples[frame * 2 + 1] = std::clamp(samples[frame * 2 + 1] * frameGain, -1.0f, 1.0f);
+    }
+}
+
+#ifdef DSPCHAIN_X86
+/* Every sample depends on the one before it, so the vector holds both channels of a frame instead */
+__attribute__((target("sse2")))
+static void filterSse2(float *samples, unsigned int frameCount, const DspChain::Coefficients &coefficients,
+                       DspChain::FilterState &state)
+{
+    auto b0 = _mm_set1_ps(coefficients.b0);
+    auto b1 = _mm_set1_ps(coefficients.b1);
+    auto b2 = _mm_set1_ps(coefficients.b2);
+    auto a1 = _mm_set1_ps(coefficients.a1);
+    auto a2 = _mm_set1_ps(coefficients.a2);
+    auto z1 = _mm_load_ps(state.z1);
+    auto z2 = _mm_load_ps(state.z2);
+
+    for (unsigned int frame {}; frame < frameCount; ++frame) {
+        auto *stereo = reinterpret_cast<__m64 *>(samples + frame * 2);
+        auto input = _mm_loadl_pi(_mm_setzero_ps(), stereo);
+        auto output = _mm_add_ps(_mm_mul_ps(b0, input), z1);
+        z1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b1, input), _mm_mul_ps(a1, output)), z2);
+        z2 = _mm_sub_ps(_mm_mul_ps(b2, input), _mm_mul_ps(a2, output));
+        _mm_storel_pi(stereo, output);
+    }
+
+    _mm_store_ps(state.z1, z1);
+    _mm_store_ps(state.z2, z2);
+}
+
+/* Two frames per register */
+__attribute__((target("sse2")))
+static void applyGainSse2(float *samples, unsigned int frameCount, float gain, float step)
+{
+    auto lower = _mm_set1_ps(-1.0f);
+    auto upper = _mm_set1_ps(1.0f);
+    auto gains = _mm_add_ps(_mm_set1_ps(gain), _mm_mul_ps(_mm_set1_ps(step), _mm_setr_ps(0.0f, 0.0f, 1.0f, 1.0f)));
+    auto advance = _mm_set1_ps(step * 2.0f);
+
+    unsigned int frame {};
+    for (; frame + 2 <= frameCount; frame += 2) {
+        auto values = _mm_mul_ps(_mm_loadu_ps(samples + frame * 2), gains);
+        _mm_storeu_ps(samples + frame * 2, _mm_min_ps(_mm_max_ps(values, lower), upper));
+        gains = _mm_add_ps(gains, advance);
+    }
+
+    applyGainScalar(samples + frame * 2, frameCount - frame, gain + step * static_cast<float>(frame), step);
+}
+
+/* Four frames per register */
+__attribute__((target("avx")))
+static void applyGainAvx(float *samples, unsigned int frameCount, float gain, float step)
+{
+    auto lower = _mm256_set1_ps(-1.0f);
+    auto upper = _mm256_set1_ps(1.0f);
+    auto offsets = _mm256_setr_ps(0.0f, 0.0f, 1.0f, 1.0f, 2.0f, 2.0f, 3.0f, 3.0f);
+    auto gains = _mm256_add_ps(_mm256_set1_ps(gain), _mm256_mul_ps(_mm256_set1_ps(step), offsets));
+    auto advance = _mm256_set1_ps(step * 4.0f);
+
+    unsigned int frame {};
+    for (; frame + 4 <= frameCount; frame += 4) {
+        auto values = _mm256_mul_ps(_mm256_loadu_ps(samples + frame * 2), gains);
+        _mm256_storeu_ps(samples + frame * 2, _mm256_min_ps(_mm256_max_ps(values, lower), upper));
+        gains = _mm256_add_ps(gains, advance);
+    }
+
+    applyGainScalar(samples + frame * 2, frameCount - frame, gain + step * static_cast<float>(frame), step);
+}
+#endif
+
+DspChain::DspChain()
+    : m_sampleRate(48'000)
+    , m_sequence(0)
+    , m_sharedGain(1.0f)
+    , m_sharedBandCount(0)
+    , m_seenSequence(0)
+    , m_appliedGain(1.0f)
+    , m_filters {}
+    , m_filterKernel(filterScalar)
+    , m_attached(false)
+{
+    for (auto &coefficient : m_sharedCoefficients) {
+        coefficient.store(0.0f, std::memory_order_relaxed);
+    }
+
+#ifdef DSPCHAIN_X86
+    if (__builtin_cpu_supports("sse2")) {
+        m_filterKernel = filterSse2;
+    }
+#endif
+}
+
+DspChain::~DspChain()
+{
+    detach();
+}
+
+const char *DspChain::instructionSet()
+{
+#ifdef DSPCHAIN_X86
+    if (__builtin_cpu_supports("avx")) {
+        return "AVX";
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return "SSE2";
+    }
+#endif
+    return "scalar";
+}
+
+void DspChain::applyGain(float *samples, unsigned int frameCount, float gain, float step)
+{
+    static const auto kernel = [] {
+#ifdef DSPCHAIN_X86
+        if (__builtin_cpu_supports("avx")) {
+            return applyGainAvx;
+        }
+        if (__builtin_cpu_supports("sse2")) {
+            return applyGainSse2;
+        }
+#endif
+        return applyGainScalar;
+    }();
+
+    kernel(samples, frameCount, gain, step);
+}
+
+void DspChain::configure(const Config &config)
+{
+    m_config = config;
+    publish();
+}
+
+void DspChain::setSampleRate(int sampleRate)
+{
+    if (sampleRate <= 0 or sampleRate == m_sampleRate) {
+        return;
+    }
+
+    m_sampleRate = sampleRate;
+    publish();
+}
+
+void DspChain::setReplayGain(const ReplayGain &replayGain)
+{
+    m_replayGain = replayGain;
+    publish();
+}
+
+bool DspChain::isActive() const
+{
+    return m_sharedGain.load(std::memory_order_relaxed) != 1.0f or m_sharedBandCount.load(std::memory_order_relaxed) > 0;
+}
+
+float DspChain::gain(const ReplayGain &replayGain) const
+{
+    /* Without a tag the preamp is all there is */
+    auto decibels = m_config.preamp;
+    float peak {};
+    bool useAlbum = m_config.replayGainMode == ReplayGainMode::Album and replayGain.hasAlbum;
+    bool useTrack = m_config.replayGainMode != ReplayGainMode::Off and not useAlbum and replayGain.hasTrack;
+    if (useAlbum) {
+        decibels += replayGain.albumGain;
+        peak = replayGain.albumPeak;
+    } else if (useTrack) {
+        decibels += replayGain.trackGain;
+        peak = replayGain.trackPeak;
+    }
+
+    auto gain = std::pow(10.0f, decibels / 20.0f);
+    /* Raising a track never pushes its loudest sample past full scale */
+    if (peak > 0.0f) {
+        gain = std::min(gain, 1.0f / peak);
+    }
+
+    return gain;
+}
+
+void DspChain::publish()
+{
+    /* Peaking filters from the Audio EQ Cookbook, flat or out of range bands are left out */
+    Parameters parameters;
+    parameters.gain = gain(m_replayGain);
+    auto nyquist = static_cast<float>(m_sampleRate) / 2.0f;
+    for (const auto &band : m_config.bands) {
+        if (parameters.bandCount == MAX_BANDS) {
+            break;
+        }
+        if (band.gain == 0.0f or band.frequency <= 0.0f or band.frequency >= nyquist or band.q <= 0.0f) {
+            continue;
+        }
+
+        auto amplitude = std::pow(10.0f, band.gain / 40.0f);
+        auto omega = 2.0f * PI * band.frequency / static_cast<float>(m_sampleRate);
+        auto alpha = std::sin(omega) / (2.0f * band.q);
+        auto cosine = std::cos(omega);
+        auto a0 = 1.0f + alpha / amplitude;
+
+        auto &coefficients = parameters.bands[parameters.bandCount++];
+        coefficients.b0 = (1.0f + alpha * amplitude) / a0;
+        coefficients.b1 = -2.0f * cosine / a0;
+        coefficients.b2 = (1.0f - alpha * amplitude) / a0;
+        coefficients.a1 = -2.0f * cosine / a0;
+        coefficients.a2 = (1.0f - alpha / amplitude) / a0;
+    }
+
+    auto sequence = m_sequence.load(std::memory_order_relaxed);
+    m_sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    m_sharedGain.store(parameters.gain, std::memory_order_relaxed);
+    m_sharedBandCount.store(parameters.bandCount, std::memory_order_relaxed);
+    for (int band {}; band < parameters.bandCount; ++band) {
+        const auto &coefficients = parameters.bands[band];
+        auto *shared = &m_sharedCoefficients[band * 5];
+        shared[0].store(coefficients.b0, std::memory_order_relaxed);
+        shared[1].store(coefficients.b1, std::memory_order_relaxed);
+        shared[2].store(coefficients.b2, std::memory_order_relaxed);
+        shared[3].store(coefficients.a1, std::memory_order_relaxed);
+        shared[4].store(coefficients.a2, std::memory_order_relaxed);
+    }
+
+    m_sequence.store(sequence + 2, std::memory_order_release);
+}
+
+bool DspChain::refresh()
+{
+    auto before = m_sequence.load(std::memory_order_acquire);
+    if (before != m_seenSequence and not (before & 1)) {
+        Parameters parameters;
+        parameters.gain = m_sharedGain.load(std::memory_order_relaxed);
+        parameters.bandCount = std::clamp(m_sharedBandCount.load(std::memory_order_relaxed), 0, MAX_BANDS);
+        for (int band {}; band < parameters.bandCount; ++band) {
+            const auto *shared = &m_sharedCoefficients[band * 5];
+            parameters.bands[band] = {shared[0].load(std::memory_order_relaxed), shared[1].load(std::memory_order_relaxed),
+                                      shared[2].load(std::memory_order_relaxed), shared[3].load(std::memory_order_relaxed),
+                                      shared[4].load(std::memory_order_relaxed)};
+        }
+
+        /* Raced a change, the audio thread doesn't wait: it's picked up next period */
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (m_sequence.load(std::memory_order_relaxed) == before) {
+            for (int band = m_parameters.bandCount; band < parameters.bandCount; ++band) {
+                m_filters[band] = {};
+            }
+            m_parameters = parameters;
+            m_seenSequence = before;
+        }
+    }
+
+    return m_parameters.bandCount > 0 or m_parameters.gain != 1.0f or m_appliedGain != 1.0f;
+}
+
+void DspChain::run(float *samples, unsigned int frameCount)
+{
+    for (int band {}; band < m_parameters.bandCount; ++band) {
+        auto &filter = m_filters[band];
+        m_filterKernel(samples, frameCount, m_parameters.bands[band], filter);
+        for (int channel {}; channel < 2; ++channel) {
+            if (std::fabs(filter.z1[channel]) < DENORMAL_LIMIT) {
+                filter.z1[channel] = 0.0f;
+            }
+            if (std::fabs(filter.z2[channel]) < DENORMAL_LIMIT) {
+                filter.z2[channel] = 0.0f;
+            }
+        }
+    }
+
+    /* The gain moves to the new value over this period */
+    auto target = m_parameters.gain;
+    auto step = (target - m_appliedGain) / static_cast<float>(frameCount);
+    applyGain(samples, frameCount, m_appliedGain, step);
+    m_appliedGain = target;
+}
+
+void DspChain::process(float *samples, unsigned int frameCount)
+{
+    if (frameCount == 0 or not refresh()) {
+        return;
+    }
+
+    run(samples, frameCount);
+}
+
+void DspChain::process(qint16 *samples, unsigned int frameCount)
+{
+    TRACE_SCOPE("DspChain::process");
+    if (frameCount == 0 or not refresh()) {
+        return;
+    }
+
+    auto count = static_cast<size_t>(frameCount) * 2;
+    m_conversion.resize(count);
+    for (size_t i {}; i < count; ++i) {
+        m_conversion[i] = static_cast<float>(samples[i]) / 32'768.0f;
+    }
+
+    run(m_conversion.data(), frameCount);
+
+    for (size_t i {}; i < count; ++i) {
+        samples[i] = static_cast<qint16>(std::lrint(m_conversion[i] * 32'767.0f));
+    }
+}
+
+void DspChain::attach()
+{
+    if (m_attached) {
+        return;
+    }
+
+    s_attached.store(this, std::memory_order_release);
+    AttachAudioMixedProcessor(audioCallback);
+    m_attached = true;
+}
+
+void DspChain::detach()
+{
+    if (not m_attached) {
+        return;
+    }
+
+    /* raylib holds the audio lock while it calls the processors, so none is running after this */
+    DetachAudioMixedProcessor(audioCallback);
+    s_attached.store(nullptr, std::memory_order_release);
+    m_attached = false;
+}
+
+void DspChain::audioCallback(void *buffer, unsigned int frames)
+{
+    if (auto *chain = s_attached.load(std::memory_order_acquire)) {
+        /* On the audio device's thread, only the span that doesn't lock or allocate */
+        TRACE_AUDIO_SCOPE("DspChain::process");
+        chain->process(static_cast<float *>(buffer), frames);
+    }
+}
@@ -0,0 +1,116 @@
+#ifndef DSPCHAIN_HPP
+#define DSPCHAIN_HPP
+
+#include <array>
+#include <atomic>
+#include <QVector>
+#include <QtGlobal>
+#include <vector>
+
+#include "trackinfo.hpp"
+
+/* Processing between the decoders and the device: ReplayGain and a preamp, then a parametric EQ
+ * made of peaking biquads, then a clamp so boosted peaks don't wrap around.
+ * It works on interleaved stereo floats, which is what raylib mixes into.
+ *
+ * The playback thread sets it up, the audio thread runs it. Settings travel through atomics behind
+ * a sequence counter; when the audio thread races a change it keeps the previous settings for one
+ * more period instead of waiting. Gain changes are ramped over a period so they don't click.
+ * The loops are picked at runtime: AVX or SSE2 when the CPU has them, plain C++ otherwise.
+ */
+class DspChain
+{
+public:
+    enum class ReplayGainMode { Off, Track, Album };
+
+    struct Band
+    {
+        float frequency;
+        /* dB */
+        float gain;
+        float q;
+    };
+
+    struct Config
+    {
+        /* dB, added to the ReplayGain */
+        float preamp {};
+        ReplayGainMode replayGainMode {ReplayGainMode::Track};
+        QVector<Band> bands {};
+    };
+
+    struct Coefficients
+    {
+        float b0;
+        float b1;
+        float b2;
+        float a1;
+        float a2;
+    };
+
+    /* Transposed direct form II, left and right in the first two lanes */
+    struct alignas(16) FilterState
+    {
+        float z1[4];
+        float z2[4];
+    };
+
+    static constexpr int MAX_BANDS {10};
+private:
+    struct Parameters
+    {
+        float gain {1.0f};
+        int bandCount {};
+        std::array<Coefficients, MAX_BANDS> bands {};
+    };
+
+    using FilterKernel = void (*)(float *samples, unsigned int frameCount, const Coefficients &coefficients, FilterState &state);
+
+    /* Playback thread */
+    Config m_config;
+    int m_sampleRate;
+    ReplayGain m_replayGain;
+
+    /* Shared, odd while the playback thread writes */
+    std::atomic<quint32> m_sequence;
+    std::atomic<float> m_sharedGain;
+    std::atomic<int> m_sharedBandCount;
+    std::array<std::atomic<float>, MAX_BANDS * 5> m_sharedCoefficients;
+
+    /* Audio thread, or the playback thread when there's a sink instead of the device */
+    quint32 m_seenSequence;
+    Parameters m_parameters;
+    float m_appliedGain;
+    std::array<FilterState, MAX_BANDS> m_filters;
+    FilterKernel m_filterKernel;
+    std::vector<float> m_conversion;
+    bool m_attached;
+
+    void publish();
+    bool refresh();
+    void run(float *samples, unsigned int frameCount);
+public:
+    DspChain();
+    ~DspChain();
+    DspChain(const DspChain &) = delete;
+    DspChain &operator=(const DspChain &) = delete;
+
+    /* Before playback starts */
+    void configure(const Config &config);
+    void setSampleRate(int sampleRate);
+    void setReplayGain(const ReplayGain &replayGain);
+    /* Linear gain a track with these tags is played at */
+    float gain(const ReplayGain &replayGain) const;
+    bool isActive() const;
+    void process(float *samples, unsigned int frameCount);
+    void process(qint16 *samples, unsigned int frameCount);
+    /* Runs the chain on whatever raylib's audio device mixes, only one chain can be attached */
+    void attach();
+    void detach();
+    static void audioCallback(void *buffer, unsigned int frames);
+    /* Interleaved stereo times a gain that moves by step every frame, clamped to full scale */
+    static void applyGain(float *samples, unsigned int frameCount, float gain, float step);
+    static const char *instructionSet();
+};
+
+#endif // DSPCHAIN_HPP
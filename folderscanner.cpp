@@ -0,0 +1,139 @@
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QThread>
+
+#include "folderscanner.hpp"
+#include "tracer.hpp"
+
+/* Often enough to see the list grow, rarely enough that merging doesn't keep the window busy */
+static constexpr int FLUSH_INTERVAL {250};
+
+FolderScanner::FolderScanner(QObject *parent)
+    : QObject(parent)
+    , m_generation(0)
+    , m_running(false)
+    , m_total(0)
+{
+    /* Listing directories is all waiting for the disk */
+    m_pool.setMaxThreadCount(QThread::idealThreadCount() * 2);
+
+    m_flushTimer.setInterval(FLUSH_INTERVAL);
+    connect(&m_flushTimer, &QTimer::timeout, this, &FolderScanner::flush);
+}
+
+FolderScanner::~FolderScanner()
+{
+    /* Whoever listens may be gone already, nothing is emitted from here */
+    ++m_generation;
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+bool FolderScanner::isSupported(const QString &path)
+{
+    auto suffix = QFileInfo(path).suffix().toLower();
+    return suffix == "mp3" or suffix == "ogg" or suffix == "wav" or suffix == "qoa" or suffix == "flac"
+           or suffix == "xm" or suffix == "mod";
+}
+
+void FolderScanner::scan(const QStringList &directories)
+{
+    cancel();
+    if (directories.isEmpty()) {
+        return;
+    }
+
+    auto generation = m_generation.load();
+    auto pending = std::make_shared<std::atomic<int>>(static_cast<int>(directories.size()));
+    m_running = true;
+    m_total = 0;
+    m_flushTimer.start();
+
+    for (const auto &directory : directories) {
+        m_pool.start([this, directory, generation, pending] {
+            scanDirectory(directory, generation, pending);
+        });
+    }
+}
+
+void FolderScanner::cancel()
+{
+    ++m_generation;
+    m_pool.clear();
+    {
+        std::lock_guard<std::mutex> lock(m_foundMutex);
+        m_found.clear();
+    }
+    m_flushTimer.stop();
+
+    if (m_running) {
+        m_running = false;
+        emit finished(m_total, true);
+    }
+}
+
+bool FolderScanner::isRunning() const
+{
+    return m_running;
+}
+
+void FolderScanner::scanDirectory(const QString &directory, quint64 generation, std::shared_ptr<std::atomic<int>> pending)
+{
+    TRACE_SCOPE("FolderScanner::scanDirectory");
+    QStringList songs;
+    QDirIterator it(directory, QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot);
+    while (it.hasNext() and m_generation.load() == generation) {
+        auto path = it.next();
+        auto fileInfo = it.fileInfo();
+        if (fileInfo.isDir()) {
+            if (fileInfo.isSymLink()) {
+                continue;
+            }
+
+            /* Counted before this directory is done, so the count can't reach zero early */
+            ++*pending;
+            m_pool.start([this, path, generation, pending] {
+                scanDirectory(path, generation, pending);
+            });
+        } else if (isSupported(path)) {
+            songs.append(path);
+        }
+    }
+
+    if (not songs.isEmpty()) {
+        std::lock_guard<std::mutex> lock(m_foundMutex);
+        /* Cancelling empties the list under the lock, a cancelled walk can't add to a new one */
+        if (m_generation.load() == generation) {
+            m_found.append(songs);
+        }
+    }
+
+    if (--*pending > 0) {
+        return;
+    }
+
+    QMetaObject::invokeMethod(this, [this, generation] {
+        if (m_generation.load() != generation) {
+            return;
+        }
+
+        m_flushTimer.stop();
+        flush();
+        m_running = false;
+        emit finished(m_total, false);
+    }, Qt::QueuedConnection);
+}
+
+void FolderScanner::flush()
+{
+    QStringList paths;
+    {
+        std::lock_guard<std::mutex> lock(m_foundMutex);
+        paths.swap(m_found);
+    }
+
+    if (not paths.isEmpty()) {
+        m_total += static_cast<int>(paths.size());
+        emit found(paths);
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef FOLDERSCANNER_HPP
+#define FOLDERSCANNER_HPP
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <QObject>
+#include <QStringList>
+#include <QThreadPool>
+#include <QTimer>
+
+/* Finds the songs under whole folder trees. Each directory is listed by a task on a thread pool
+ * that starts a task for each of its subdirectories, so wide trees are walked in parallel.
+ * What was found comes back in batches on the thread the scanner lives in, unsorted:
+ * the track table merges them into place. Symbolic links to directories aren't followed.
+ */
+class FolderScanner : public QObject
+{
+    Q_OBJECT
+    QThreadPool m_pool;
+    std::atomic<quint64> m_generation;
+    std::mutex m_foundMutex;
+    QStringList m_found;
+    QTimer m_flushTimer;
+    bool m_running;
+    int m_total;
+
+    void scanDirectory(const QString &directory, quint64 generation, std::shared_ptr<std::atomic<int>> pending);
+    void flush();
+public:
+    explicit FolderScanner(QObject *parent = nullptr);
+    ~FolderScanner();
+    void scan(const QStringList &directories);
+    void cancel();
+    bool isRunning() const;
+    static bool isSupported(const QString &path);
+signals:
+    void found(QStringList paths);
+    void finished(int total, bool cancelled);
+};
+
+#endif // FOLDERSCANNER_HPP
@@ -0,0 +1,242 @@
+#include <QDebug>
+#include <QSocketNotifier>
+
+#ifdef Q_OS_LINUX
+#include <cerrno>
+#include <cstring>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "folderscanner.hpp"
+#include "librarywatcher.hpp"
+#include "tracer.hpp"
+
+/* A copy or a tag editor writes a burst of events, wait until it's over */
+static constexpr int QUIET_DELAY {500};
+/* Long bursts are still handed over every now and then */
+static constexpr qint64 MAX_DELAY {3'000};
+
+LibraryWatcher::LibraryWatcher(QObject *parent)
+    : QObject(parent)
+    , m_fd(-1)
+    , m_notifier(nullptr)
+    , m_warnedLimit(false)
+{
+    m_quietTimer.setSingleShot(true);
+    m_quietTimer.setInterval(QUIET_DELAY);
+    connect(&m_quietTimer, &QTimer::timeout, this, &LibraryWatcher::flush);
+
+#ifdef Q_OS_LINUX
+    m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_fd < 0) {
+        qWarning() << "Couldn't watch the library:" << std::strerror(errno);
+        return;
+    }
+
+    /* Reading the events is cheap, the GUI thread does it */
+    m_notifier = new QSocketNotifier(m_fd, QSocketNotifier::Read, this);
+    connect(m_notifier, &QSocketNotifier::activated, this, &LibraryWatcher::readEvents);
+#endif
+}
+
+LibraryWatcher::~LibraryWatcher()
+{
+#ifdef Q_OS_LINUX
+    if (m_fd >= 0) {
+        delete m_notifier;
+        close(m_fd);
+    }
+#endif
+}
+
+void LibraryWatcher::setDirectories(const QStringList &directories)
+{
+#ifdef Q_OS_LINUX
+    if (m_fd < 0) {
+        return;
+    }
+
+    TRACE_SCOPE("LibraryWatcher::setDirectories");
+    QSet<QString> wanted;
+    for (const auto &directory : directories) {
+        if (not directory.isEmpty()) {
+            wanted.insert(directory);
+        }
+    }
+
+    for (auto it = m_watches.begin(); it != m_watches.end();) {
+        if (wanted.contains(it.key())) {
+            ++it;
+            continue;
+        }
+
+        inotify_rm_watch(m_fd, it.value());
+        m_directories.remove(it.value());
+        it = m_watches.erase(it);
+    }
+
+    constexpr quint32 mask = IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+    for (const auto &directory : wanted) {
+        if (m_watches.contains(directory)) {
+            continue;
+        }
+
+        auto watch = inotify_add_watch(m_fd, directory.toLocal8Bit().constData(), mask);
+        if (watch < 0) {
+            /* Running out of watches is worth telling once, a missing directory isn't */
+            if (errno == ENOSPC and not m_warnedLimit) {
+                qWarning() << "Out of inotify watches, raise fs.inotify.max_user_watches to watch the whole library.";
+                m_warnedLimit = true;
+            }
+            continue;
+        }
+
+        m_watches.insert(directory, watch);
+        m_directories.insert(watch, directory);
+    }
+#else
+    Q_UNUSED(directories)
+#endif
+}
+
+void LibraryWatcher::readEvents()
+{
+#ifdef Q_OS_LINUX
+    TRACE_SCOPE("LibraryWatcher::readEvents");
+    alignas(inotify_event) char buffer[64 * 1'024];
+    for (;;) {
+        auto length = read(m_fd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            break;
+        }
+
+        for (ssize_t offset {}; offset < length;) {
+            const auto *event = reinterpret_cast<const inotify_event *>(buffer + offset);
+            offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                qWarning() << "Too many changes in the library at once, some were missed.";
+                continue;
+            }
+
+            auto directory = m_directories.value(event->wd);
+            if (directory.isEmpty()) {
+                continue;
+            }
+
+            if (event->mask & IN_IGNORED) {
+                m_directories.remove(event->wd);
+                m_watches.remove(directory);
+                continue;
+            }
+
+            if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+                m_removedDirectories.insert(directory);
+                continue;
+            }
+
+            /* Subdirectories come and go with their own watch, or not at all */
+            if (event->len == 0 or (event->mask & IN_ISDIR)) {
+                continue;
+            }
+
+            auto path = QString("%1/%2").arg(directory, QString::fromLocal8Bit(event->name));
+            if (event->mask & IN_MOVED_FROM) {
+                m_movedFrom.insert(event->cookie, path);
+            } else if (event->mask & IN_MOVED_TO) {
+                auto from = m_movedFrom.take(event->cookie);
+                if (from.isEmpty()) {
+                    fileAdded(path);
+                } else {
+                    fileRenamed(from, path);
+                }
+            } else if (event->mask & IN_CLOSE_WRITE) {
+                fileAdded(path);
+            } else if (event->mask & IN_DELETE) {
+                fileRemoved(path);
+            }
+        }
+    }
+
+    if (not m_pendingSince.isValid()) {
+        m_pendingSince.start();
+    }
+
+    if (m_pendingSince.elapsed() >= MAX_DELAY) {
+        flush();
+    } else {
+        m_quietTimer.start();
+    }
+#endif
+}
+
+void LibraryWatcher::fileAdded(const QString &path)
+{
+    m_removed.remove(path);
+    m_added.insert(path);
+}
+
+void LibraryWatcher::fileRemoved(const QString &path)
+{
+    m_added.remove(path);
+    m_removed.insert(path);
+}
+
+void LibraryWatcher::fileRenamed(const QString &from, const QString &to)
+{
+    /* Written under a temporary name and renamed once complete, like rsync does: it's just new */
+    if (m_added.remove(from)) {
+        fileAdded(to);
+        return;
+    }
+
+    m_removed.remove(to);
+    m_renamed.append({from, to});
+}
+
+void LibraryWatcher::flush()
+{
+    m_quietTimer.stop();
+    m_pendingSince.invalidate();
+
+    /* Moved out of the watched directories */
+    for (const auto &path : m_movedFrom) {
+        fileRemoved(path);
+    }
+    m_movedFrom.clear();
+
+    Changes changes;
+    for (const auto &path : m_added) {
+        if (FolderScanner::isSupported(path)) {
+            changes.added.append(path);
+        }
+    }
+    for (const auto &path : m_removed) {
+        if (FolderScanner::isSupported(path)) {
+            changes.removed.append(path);
+        }
+    }
+    for (const auto &rename : m_renamed) {
+        auto fromSupported = FolderScanner::isSupported(rename.first);
+        auto toSupported = FolderScanner::isSupported(rename.second);
+        if (fromSupported and toSupported) {
+            changes.renamed.append(rename);
+        } else if (fromSupported) {
+            changes.removed.append(rename.first);
+        } else if (toSupported) {
+            changes.added.append(rename.second);
+        }
+    }
+    changes.removedDirectories = QStringList(m_removedDirectories.cbegin(), m_removedDirectories.cend());
+
+    m_added.clear();
+    m_removed.clear();
+    m_renamed.clear();
+    m_removedDirectories.clear();
+
+    if (not changes.added.isEmpty() or not changes.removed.isEmpty() or not changes.renamed.isEmpty()
+        or not changes.removedDirectories.isEmpty()) {
+        emit changed(changes);
+    }
+}
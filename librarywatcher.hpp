@@ -0,0 +1,63 @@
+#ifndef LIBRARYWATCHER_HPP
+#define LIBRARYWATCHER_HPP
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QPair>
+#include <QSet>
+#include <QStringList>
+#include <QTimer>
+#include <QVector>
+
+class QSocketNotifier;
+
+/* Notices songs appearing, disappearing and being renamed in the directories the queue and
+ * the saved playlists refer to, through inotify. Every directory is watched on its own and
+ * nothing is ever rescanned. Events are collected and handed over once the directories quiet
+ * down, or every few seconds while a long burst like an rsync run goes on.
+ * Only Linux has inotify, anywhere else nothing is watched.
+ */
+class LibraryWatcher : public QObject
+{
+    Q_OBJECT
+public:
+    struct Changes
+    {
+        /* Written or moved in, including songs that were already there and changed */
+        QStringList added;
+        QStringList removed;
+        QVector<QPair<QString, QString>> renamed;
+        /* Moved or deleted as a whole, with whatever was in them */
+        QStringList removedDirectories;
+    };
+private:
+    int m_fd;
+    QSocketNotifier *m_notifier;
+    QHash<int, QString> m_directories;
+    QHash<QString, int> m_watches;
+    /* The first half of a rename, until the other half shows up */
+    QHash<quint32, QString> m_movedFrom;
+    QSet<QString> m_added;
+    QSet<QString> m_removed;
+    QVector<QPair<QString, QString>> m_renamed;
+    QSet<QString> m_removedDirectories;
+    QTimer m_quietTimer;
+    QElapsedTimer m_pendingSince;
+    bool m_warnedLimit;
+
+    void readEvents();
+    void fileAdded(const QString &path);
+    void fileRemoved(const QString &path);
+    void fileRenamed(const QString &from, const QString &to);
+    void flush();
+public:
+    explicit LibraryWatcher(QObject *parent = nullptr);
+    ~LibraryWatcher();
+    /* The whole set, directories left out stop being watched */
+    void setDirectories(const QStringList &directories);
+signals:
+    void changed(const LibraryWatcher::Changes &changes);
+};
+
+#endif // LIBRARYWATCHER_HPP
@@ -0,0 +1,292 @@
+#include <algorithm>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QThread>
+
+#include <raylib.h>
+
+#include "loudnessanalyzer.hpp"
+#include "loudnessmeter.hpp"
+#include "tracer.hpp"
+
+/* Decoded tracks in memory at once, a single longer one is still analyzed, alone */
+static constexpr qint64 MEMORY_BUDGET {1'024ll * 1'024 * 1'024};
+/* Cancelling is noticed between chunks */
+static constexpr qint64 CHUNK_FRAMES {48'000};
+static constexpr qint64 PROGRESS_INTERVAL {200};
+/* Write new results to disk once nothing was analyzed for this long */
+static constexpr int STORE_SAVE_DELAY {2'000};
+
+/* Memory taken while a file is analyzed: the file itself, the samples raylib decodes it to
+ * and their float copy, as a multiple of the file size at common bitrates
+ */
+static qint64 decodingBytes(const QString &path, qint64 fileSize)
+{
+    auto suffix = QFileInfo(path).suffix().toLower();
+    qint64 ratio {4};
+    if (suffix == "mp3") {
+        ratio = 23;
+    } else if (suffix == "ogg") {
+        ratio = 27;
+    } else if (suffix == "flac") {
+        ratio = 6;
+    } else if (suffix == "qoa") {
+        ratio = 17;
+    }
+
+    return fileSize * ratio;
+}
+
+LoudnessAnalyzer::LoudnessAnalyzer(const QString &storePath, QObject *parent)
+    : QObject(parent)
+    , m_generation(0)
+    , m_store(storePath)
+    , m_storeLoaded(false)
+    , m_memoryInUse(0)
+    , m_running(false)
+    , m_total(0)
+    , m_done(0)
+    , m_analyzed(0)
+{
+    /* Decoding keeps a core busy, unlike probing there's no waiting for the disk */
+    m_pool.setMaxThreadCount(QThread::idealThreadCount());
+
+    m_saveTimer.setSingleShot(true);
+    m_saveTimer.setInterval(STORE_SAVE_DELAY);
+    connect(&m_saveTimer, &QTimer::timeout, this, &LoudnessAnalyzer::saveStore);
+}
+
+LoudnessAnalyzer::~LoudnessAnalyzer()
+{
+    /* Whoever listens may be gone already, nothing is emitted from here */
+    ++m_generation;
+    m_pool.clear();
+    {
+        std::lock_guard<std::mutex> lock(m_memoryMutex);
+    }
+    m_memoryCondition.notify_all();
+    m_pool.waitForDone();
+
+    if (m_saveTimer.isActive()) {
+        saveStore();
+    }
+}
+
+void LoudnessAnalyzer::analyze(const QStringList &paths)
+{
+    cancel();
+    if (paths.isEmpty()) {
+        return;
+    }
+
+    loadStore();
+    auto generation = m_generation.load();
+    m_running = true;
+    m_total = static_cast<int>(paths.size());
+    m_done = 0;
+    m_analyzed = 0;
+    m_albumPaths = QSet<QString>(paths.cbegin(), paths.cend());
+    m_album = {};
+    m_progressTimer.start();
+    emit progress(0, m_total);
+
+    for (const auto &path : paths) {
+        m_pool.start([this, generation, path] {
+            if (m_generation.load() != generation) {
+                return;
+            }
+
+            QFileInfo fileInfo(path);
+            LoudnessStore::Result result {fileInfo.size(), fileInfo.lastModified().toMSecsSinceEpoch(), 0.0f, 0.0f, {}};
+            bool known {};
+            {
+                std::lock_guard<std::mutex> lock(m_storeMutex);
+                known = m_store.find(path, result.size, result.modified) != nullptr;
+            }
+
+            bool analyzed = not known and fileInfo.isFile() and analyzeFile(path, generation, result);
+            QMetaObject::invokeMethod(this, [this, generation, path, analyzed, result] {
+                onFileDone(generation, path, analyzed, result);
+            }, Qt::QueuedConnection);
+        });
+    }
+}
+
+void LoudnessAnalyzer::cancel()
+{
+    ++m_generation;
+    m_pool.clear();
+    {
+        /* Workers waiting for memory give up */
+        std::lock_guard<std::mutex> lock(m_memoryMutex);
+    }
+    m_memoryCondition.notify_all();
+
+    if (m_running) {
+        m_running = false;
+        emit finished(m_analyzed, true);
+    }
+}
+
+bool LoudnessAnalyzer::isRunning() const
+{
+    return m_running;
+}
+
+ReplayGain LoudnessAnalyzer::replayGain(const QString &path)
+{
+    loadStore();
+    ReplayGain replayGain;
+    QFileInfo fileInfo(path);
+    const auto *result = m_store.find(path, fileInfo.size(), fileInfo.lastModified().toMSecsSinceEpoch());
+    /* Nothing but silence, leave it alone */
+    if (result != nullptr and result->integrated > LoudnessMeter::ABSOLUTE_GATE) {
+        replayGain.trackGain = static_cast<float>(REFERENCE_LOUDNESS - result->integrated);
+        replayGain.trackPeak = result->truePeak;
+        replayGain.hasTrack = true;
+    }
+
+    if (m_album.hasAlbum and m_albumPaths.contains(path)) {
+        replayGain.albumGain = m_album.albumGain;
+        replayGain.albumPeak = m_album.albumPeak;
+        replayGain.hasAlbum = true;
+    }
+
+    return replayGain;
+}
+
+bool LoudnessAnalyzer::acquireMemory(qint64 bytes, quint64 generation)
+{
+    std::unique_lock<std::mutex> lock(m_memoryMutex);
+    m_memoryCondition.wait(lock, [this, bytes, generation] {
+        return m_generation.load() != generation or m_memoryInUse == 0 or m_memoryInUse + bytes <= MEMORY_BUDGET;
+    });
+
+    if (m_generation.load() != generation) {
+        return false;
+    }
+
+    m_memoryInUse += bytes;
+    return true;
+}
+
+void LoudnessAnalyzer::releaseMemory(qint64 bytes)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_memoryMutex);
+        m_memoryInUse -= bytes;
+    }
+    m_memoryCondition.notify_all();
+}
+
+bool LoudnessAnalyzer::analyzeFile(const QString &path, quint64 generation, LoudnessStore::Result &result)
+{
+    TRACE_SCOPE("LoudnessAnalyzer::analyzeFile");
+    auto bytes = decodingBytes(path, result.size);
+    if (not acquireMemory(bytes, generation)) {
+        return false;
+    }
+
+    /* Trackers can't be loaded as a wave, they're left out */
+    bool analyzed {false};
+    auto wave = LoadWave(path.toStdString().c_str());
+    if (IsWaveReady(wave)) {
+        if (wave.sampleSize != 32) {
+            WaveFormat(&wave, static_cast<int>(wave.sampleRate), 32, static_cast<int>(wave.channels));
+        }
+
+        LoudnessMeter meter(static_cast<int>(wave.sampleRate), static_cast<int>(wave.channels));
+        const auto *samples = static_cast<const float *>(wave.data);
+        qint64 frameCount = wave.frameCount;
+        analyzed = true;
+        for (qint64 frame {}; frame < frameCount; frame += CHUNK_FRAMES) {
+            if (m_generation.load() != generation) {
+                analyzed = false;
+                break;
+            }
+            meter.addFrames(samples + frame * wave.channels, std::min(CHUNK_FRAMES, frameCount - frame));
+        }
+
+        if (analyzed) {
+            result.integrated = static_cast<float>(meter.integrated());
+            result.truePeak = meter.truePeak();
+            result.histogram = LoudnessMeter::toBytes(meter.histogram());
+        }
+        UnloadWave(wave);
+    }
+
+    releaseMemory(bytes);
+    return analyzed;
+}
+
+void LoudnessAnalyzer::onFileDone(quint64 generation, const QString &path, bool analyzed, const LoudnessStore::Result &result)
+{
+    /* Cancelled, or a newer analysis started */
+    if (generation != m_generation.load()) {
+        return;
+    }
+
+    if (analyzed) {
+        {
+            std::lock_guard<std::mutex> lock(m_storeMutex);
+            m_store.insert(path, result);
+        }
+        ++m_analyzed;
+        m_saveTimer.start();
+    }
+
+    ++m_done;
+    if (m_done == m_total) {
+        m_running = false;
+        measureAlbum();
+        emit progress(m_done, m_total);
+        emit finished(m_analyzed, false);
+        return;
+    }
+
+    if (m_progressTimer.elapsed() >= PROGRESS_INTERVAL) {
+        m_progressTimer.restart();
+        emit progress(m_done, m_total);
+    }
+}
+
+void LoudnessAnalyzer::measureAlbum()
+{
+    /* The gating blocks of every track together, as if the playlist were one long track */
+    LoudnessMeter::Histogram histogram(LoudnessMeter::BINS, 0);
+    float peak {};
+    bool measured {};
+    for (const auto &path : m_albumPaths) {
+        const auto *result = m_store.find(path);
+        if (result == nullptr) {
+            continue;
+        }
+
+        LoudnessMeter::accumulate(result->histogram, histogram);
+        peak = std::max(peak, result->truePeak);
+        measured = true;
+    }
+
+    m_album = {};
+    auto loudness = LoudnessMeter::integrated(histogram);
+    if (measured and loudness > LoudnessMeter::ABSOLUTE_GATE) {
+        m_album.albumGain = static_cast<float>(REFERENCE_LOUDNESS - loudness);
+        m_album.albumPeak = peak;
+        m_album.hasAlbum = true;
+    }
+}
+
+void LoudnessAnalyzer::loadStore()
+{
+    /* analyze() gets here before starting the workers, they never see it loading */
+    if (not m_storeLoaded) {
+        m_store.load();
+        m_storeLoaded = true;
+    }
+}
+
+void LoudnessAnalyzer::saveStore()
+{
+    /* Workers only read it, and inserting happens on this thread */
+    m_store.save();
+}
@@ -0,0 +1,70 @@
+#ifndef LOUDNESSANALYZER_HPP
+#define LOUDNESSANALYZER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <QElapsedTimer>
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+#include <QThreadPool>
+#include <QTimer>
+
+#include "loudnessstore.hpp"
+#include "trackinfo.hpp"
+
+/* Measures the loudness of whole playlists so tracks without ReplayGain tags can be normalized too.
+ * Tracks are decoded by raylib on a pool with a thread per core, files that didn't change since
+ * they were analyzed are skipped. The playlist as a whole is measured as well, for album mode.
+ * Progress and results come back on the thread the analyzer lives in.
+ */
+class LoudnessAnalyzer : public QObject
+{
+    Q_OBJECT
+    QThreadPool m_pool;
+    std::atomic<quint64> m_generation;
+    /* Workers look up, the analyzer's thread inserts */
+    mutable std::mutex m_storeMutex;
+    LoudnessStore m_store;
+    /* Read the first time a result is needed rather than at startup */
+    bool m_storeLoaded;
+    QTimer m_saveTimer;
+
+    /* Decoded tracks are whole in memory, the pool waits when there's too much of them */
+    std::mutex m_memoryMutex;
+    std::condition_variable m_memoryCondition;
+    qint64 m_memoryInUse;
+
+    bool m_running;
+    int m_total;
+    int m_done;
+    int m_analyzed;
+    QElapsedTimer m_progressTimer;
+
+    QSet<QString> m_albumPaths;
+    ReplayGain m_album;
+
+    bool acquireMemory(qint64 bytes, quint64 generation);
+    void releaseMemory(qint64 bytes);
+    bool analyzeFile(const QString &path, quint64 generation, LoudnessStore::Result &result);
+    void onFileDone(quint64 generation, const QString &path, bool analyzed, const LoudnessStore::Result &result);
+    void measureAlbum();
+    void loadStore();
+    void saveStore();
+public:
+    /* ReplayGain 2.0 brings everything to -18 LUFS */
+    static constexpr double REFERENCE_LOUDNESS {-18.0};
+
+    explicit LoudnessAnalyzer(const QString &storePath, QObject *parent = nullptr);
+    ~LoudnessAnalyzer();
+    void analyze(const QStringList &paths);
+    void cancel();
+    bool isRunning() const;
+    ReplayGain replayGain(const QString &path);
+signals:
+    void progress(int done, int total);
+    void finished(int analyzed, bool cancelled);
+};
+
+#endif // LOUDNESSANALYZER_HPP
@@ -0,0 +1,218 @@
+#include <algorithm>
+#include <cmath>
+
+#include "binaryio.hpp"
+#include "loudnessmeter.hpp"
+
+static constexpr double PI {3.14159265358979323846};
+/* BS.1770 offsets the mean square so a 997 Hz sine at full scale reads -3.01 LUFS */
+static constexpr double LOUDNESS_OFFSET {-0.691};
+static constexpr double RELATIVE_GATE {-10.0};
+/* 48 taps over 4 phases, like the interpolator suggested in BS.1770 annex 2 */
+static constexpr int TAPS_PER_PHASE {12};
+
+static double loudness(double energy)
+{
+    return LOUDNESS_OFFSET + 10.0 * std::log10(energy);
+}
+
+static double energyOfBin(int bin)
+{
+    auto center = LoudnessMeter::ABSOLUTE_GATE + (bin + 0.5) * LoudnessMeter::BIN_WIDTH;
+    return std::pow(10.0, (center - LOUDNESS_OFFSET) / 10.0);
+}
+
+LoudnessMeter::LoudnessMeter(int sampleRate, int channels)
+    : m_subBlockFrames(std::max(sampleRate / 10, 1))
+    , m_framesInSubBlock(0)
+    , m_subBlocks {}
+    , m_subBlockCount(0)
+    , m_histogram(BINS, 0)
+    , m_oversampling(sampleRate < 96'000 ? 4 : sampleRate < 192'000 ? 2 : 1)
+    , m_truePeak(0.0f)
+{
+    /* The filters of BS.1770 are given for 48 kHz, these are their analog prototypes
+     * brought to whatever the track was recorded at
+     */
+    auto k = std::tan(PI * 1'681.974450955533 / sampleRate);
+    auto q = 0.7071752369554196;
+    auto vh = std::pow(10.0, 3.999843853973347 / 20.0);
+    auto vb = std::pow(vh, 0.4996667741545416);
+    auto a0 = 1.0 + k / q + k * k;
+    m_shelf = {(vh + vb * k / q + k * k) / a0, 2.0 * (k * k - vh) / a0, (vh - vb * k / q + k * k) / a0,
+               2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0};
+
+    k = std::tan(PI * 38.13547087602444 / sampleRate);
+    q = 0.5003270373238773;
+    a0 = 1.0 + k / q + k * k;
+    m_highPass = {1.0, -2.0, 1.0, 2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0};
+
+    m_channels.resize(static_cast<size_t>(std::max(channels, 1)));
+    for (size_t channel {}; channel < m_channels.size(); ++channel) {
+        auto &state = m_channels[channel];
+        state = {};
+        state.weight = 1.0;
+        /* 5.1: the LFE doesn't count, the surround channels count more */
+        if (channels == 6) {
+            state.weight = channel == 3 ? 0.0 : channel >= 4 ? 1.41 : 1.0;
+        }
+        state.history.assign(TAPS_PER_PHASE, 0.0f);
+    }
+
+    /* A Hann windowed sinc, each phase sums up to one */
+    if (m_oversampling > 1) {
+        auto taps = TAPS_PER_PHASE * m_oversampling;
+        m_interpolation.resize(static_cast<size_t>(taps));
+        for (int tap {}; tap < taps; ++tap) {
+            auto x = (tap - (taps - 1) / 2.0) / m_oversampling;
+            auto sinc = x == 0.0 ? 1.0 : std::sin(PI * x) / (PI * x);
+            auto window = 0.5 - 0.5 * std::cos(2.0 * PI * (tap + 0.5) / taps);
+            m_interpolation[static_cast<size_t>(tap)] = static_cast<float>(sinc * window);
+        }
+
+        for (int phase {}; phase < m_oversampling; ++phase) {
+            float sum {};
+            for (int tap {}; tap < TAPS_PER_PHASE; ++tap) {
+                sum += m_interpolation[static_cast<size_t>(tap * m_oversampling + phase)];
+            }
+            for (int tap {}; tap < TAPS_PER_PHASE; ++tap) {
+                m_interpolation[static_cast<size_t>(tap * m_oversampling + phase)] /= sum;
+            }
+        }
+    }
+}
+
+void LoudnessMeter::addFrames(const float *samples, qint64 frameCount)
+{
+    auto channelCount = static_cast<qint64>(m_channels.size());
+
+    for (qint64 frame {}; frame < frameCount; ++frame) {
+        for (qint64 index {}; index < channelCount; ++index) {
+            auto &channel = m_channels[static_cast<size_t>(index)];
+            auto input = samples[frame * channelCount + index];
+
+            double value = input;
+            for (int stage {}; stage < 2; ++stage) {
+                const auto &filter = stage == 0 ? m_shelf : m_highPass;
+                auto output = filter.b0 * value + channel.z1[stage];
+                channel.z1[stage] = filter.b1 * value - filter.a1 * output + channel.z2[stage];
+                channel.z2[stage] = filter.b2 * value - filter.a2 * output;
+                value = output;
+            }
+            channel.energy += value * value;
+
+            auto peak = std::fabs(input);
+            if (m_oversampling > 1) {
+                auto &history = channel.history;
+                std::rotate(history.rbegin(), history.rbegin() + 1, history.rend());
+                history[0] = input;
+                for (int phase {}; phase < m_oversampling; ++phase) {
+                    float interpolated {};
+                    for (int tap {}; tap < TAPS_PER_PHASE; ++tap) {
+                        interpolated += m_interpolation[static_cast<size_t>(tap * m_oversampling + phase)] * history[static_cast<size_t>(tap)];
+                    }
+                    peak = std::max(peak, std::fabs(interpolated));
+                }
+            }
+            m_truePeak = std::max(m_truePeak, peak);
+        }
+
+        if (++m_framesInSubBlock < m_subBlockFrames) {
+            continue;
+        }
+
+        double energy {};
+        for (auto &channel : m_channels) {
+            energy += channel.weight * channel.energy / static_cast<double>(m_subBlockFrames);
+            channel.energy = 0.0;
+        }
+        m_framesInSubBlock = 0;
+
+        std::rotate(std::begin(m_subBlocks), std::begin(m_subBlocks) + 1, std::end(m_subBlocks));
+        m_subBlocks[3] = energy;
+        if (++m_subBlockCount < 4) {
+            continue;
+        }
+
+        auto blockLoudness = loudness((m_subBlocks[0] + m_subBlocks[1] + m_subBlocks[2] + m_subBlocks[3]) / 4.0);
+        if (blockLoudness < ABSOLUTE_GATE) {
+            continue;
+        }
+
+        auto bin = std::min(static_cast<int>((blockLoudness - ABSOLUTE_GATE) / BIN_WIDTH), BINS - 1);
+        ++m_histogram[static_cast<size_t>(bin)];
+    }
+}
+
+const LoudnessMeter::Histogram &LoudnessMeter::histogram() const
+{
+    return m_histogram;
+}
+
+double LoudnessMeter::integrated() const
+{
+    return integrated(m_histogram);
+}
+
+float LoudnessMeter::truePeak() const
+{
+    return m_truePeak;
+}
+
+double LoudnessMeter::integrated(const Histogram &histogram)
+{
+    double energy {};
+    quint64 blocks {};
+    for (int bin {}; bin < static_cast<int>(histogram.size()); ++bin) {
+        energy += histogram[static_cast<size_t>(bin)] * energyOfBin(bin);
+        blocks += histogram[static_cast<size_t>(bin)];
+    }
+
+    if (blocks == 0) {
+        return ABSOLUTE_GATE;
+    }
+
+    /* Quiet passages don't drag the result down */
+    auto gate = loudness(energy / static_cast<double>(blocks)) + RELATIVE_GATE;
+    auto firstBin = std::max(static_cast<int>(std::ceil((gate - ABSOLUTE_GATE) / BIN_WIDTH - 0.5)), 0);
+    energy = 0.0;
+    blocks = 0;
+    for (auto bin = firstBin; bin < static_cast<int>(histogram.size()); ++bin) {
+        energy += histogram[static_cast<size_t>(bin)] * energyOfBin(bin);
+        blocks += histogram[static_cast<size_t>(bin)];
+    }
+
+    return blocks == 0 ? ABSOLUTE_GATE : loudness(energy / static_cast<double>(blocks));
+}
+
+QByteArray LoudnessMeter::toBytes(const Histogram &histogram)
+{
+    /* Only the bins that were hit, a track covers a few dozen of them */
+    QByteArray bytes;
+    for (int bin {}; bin < static_cast<int>(histogram.size()); ++bin) {
+        if (histogram[static_cast<size_t>(bin)] > 0) {
+            appendValue<quint16>(bytes, static_cast<quint16>(bin));
+            appendValue<quint32>(bytes, histogram[static_cast<size_t>(bin)]);
+        }
+    }
+
+    return bytes;
+}
+
+LoudnessMeter::Histogram LoudnessMeter::fromBytes(const QByteArray &bytes)
+{
+    Histogram histogram(BINS, 0);
+    accumulate(bytes, histogram);
+    return histogram;
+}
+
+void LoudnessMeter::accumulate(const QByteArray &bytes, Histogram &histogram)
+{
+    const auto *data = reinterpret_cast<const uchar *>(bytes.constData());
+    for (qint64 position {}; position + 6 <= bytes.size(); position += 6) {
+        auto bin = readValue<quint16>(data + position);
+        if (bin < histogram.size()) {
+            histogram[bin] += readValue<quint32>(data + position + 2);
+        }
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef LOUDNESSMETER_HPP
+#define LOUDNESSMETER_HPP
+
+#include <QByteArray>
+#include <QtGlobal>
+#include <vector>
+
+/* Integrated loudness and true peak as EBU R128 / ITU-R BS.1770-4 define them.
+ *
+ * Gating blocks are kept as a histogram of 0.1 LU bins instead of a list, it's what gets stored
+ * per track: adding the histograms of several tracks gives the loudness of all of them together,
+ * which is how album loudness is measured without decoding anything again.
+ */
+class LoudnessMeter
+{
+public:
+    using Histogram = std::vector<quint32>;
+private:
+    struct Biquad
+    {
+        double b0, b1, b2, a1, a2;
+    };
+
+    struct Channel
+    {
+        /* K-weighting is a shelf followed by a high-pass */
+        double z1[2];
+        double z2[2];
+        double energy;
+        double weight;
+        /* The last input samples, newest first, for the oversampling filter */
+        std::vector<float> history;
+    };
+
+    Biquad m_shelf;
+    Biquad m_highPass;
+    std::vector<Channel> m_channels;
+    qint64 m_subBlockFrames;
+    qint64 m_framesInSubBlock;
+    /* The last four 100 ms energies, a gating block is 400 ms long and starts every 100 ms */
+    double m_subBlocks[4];
+    int m_subBlockCount;
+    Histogram m_histogram;
+    int m_oversampling;
+    std::vector<float> m_interpolation;
+    float m_truePeak;
+public:
+    static constexpr double ABSOLUTE_GATE {-70.0};
+    static constexpr double BIN_WIDTH {0.1};
+    static constexpr int BINS {750};
+
+    LoudnessMeter(int sampleRate, int channels);
+    /* Interleaved */
+    void addFrames(const float *samples, qint64 frameCount);
+    const Histogram &histogram() const;
+    double integrated() const;
+    float truePeak() const;
+
+    /* LUFS, or ABSOLUTE_GATE when everything was below it */
+    static double integrated(const Histogram &histogram);
+    static QByteArray toBytes(const Histogram &histogram);
+    static Histogram fromBytes(const QByteArray &bytes);
+    /* Adds a stored histogram to another one */
+    static void accumulate(const QByteArray &bytes, Histogram &histogram);
+};
+
+#endif // LOUDNESSMETER_HPP
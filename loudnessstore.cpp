@@ -0,0 +1,149 @@
+#include <algorithm>
+#include <cstring>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+
+#include "binaryio.hpp"
+#include "loudnessstore.hpp"
+
+static constexpr char MAGIC[4] {'B', 'M', 'L', 'S'};
+/* magic, version, entry count */
+static constexpr qint64 HEADER_SIZE {4 + 4 + 4};
+/* path length, size, modification time, integrated loudness, true peak, histogram length */
+static constexpr qint64 FIXED_ENTRY_SIZE {4 + 8 + 8 + 4 + 4 + 4};
+
+static float readFloat(const uchar *data)
+{
+    auto bits = readValue<quint32>(data);
+    float value {};
+    std::memcpy(&value, &bits, sizeof(float));
+    return value;
+}
+
+static void appendFloat(QByteArray &bytes, float value)
+{
+    quint32 bits {};
+    std::memcpy(&bits, &value, sizeof(float));
+    appendValue<quint32>(bytes, bits);
+}
+
+LoudnessStore::LoudnessStore(QString path)
+    : m_path(std::move(path))
+{
+}
+
+bool LoudnessStore::load()
+{
+    m_results.clear();
+
+    /* Nothing has been analyzed yet */
+    QFile file(m_path);
+    if (not file.exists()) {
+        return true;
+    }
+
+    if (not file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Couldn't open" << m_path << ":" << file.errorString();
+        return false;
+    }
+
+    auto bytes = file.readAll();
+    const auto *data = reinterpret_cast<const uchar *>(bytes.constData());
+    qint64 size = bytes.size();
+    if (size < HEADER_SIZE or std::memcmp(data, MAGIC, sizeof(MAGIC)) != 0 or readValue<quint32>(data + 4) != VERSION) {
+        qDebug() << "Ignoring loudness store" << m_path;
+        return false;
+    }
+
+    auto count = readValue<quint32>(data + 8);
+    /* The count comes from the file, never reserve more entries than it can hold */
+    m_results.reserve(static_cast<int>(std::min<quint64>(count, static_cast<quint64>(size - HEADER_SIZE) / FIXED_ENTRY_SIZE)));
+
+    /* Whatever is wrong with it gets analyzed again */
+    qint64 position {HEADER_SIZE};
+    for (quint32 i {}; i < count and position + FIXED_ENTRY_SIZE <= size; ++i) {
+        auto pathLength = readValue<quint32>(data + position);
+        auto histogramOffset = position + FIXED_ENTRY_SIZE + pathLength;
+        if (histogramOffset > size) {
+            break;
+        }
+
+        auto histogramLength = readValue<quint32>(data + position + 28);
+        if (histogramOffset + histogramLength > size) {
+            break;
+        }
+
+        Result result;
+        result.size = readValue<qint64>(data + position + 4);
+        result.modified = readValue<qint64>(data + position + 12);
+        result.integrated = readFloat(data + position + 20);
+        result.truePeak = readFloat(data + position + 24);
+        result.histogram = QByteArray(reinterpret_cast<const char *>(data + histogramOffset), static_cast<int>(histogramLength));
+        auto path = QString::fromUtf8(reinterpret_cast<const char *>(data + position + FIXED_ENTRY_SIZE), static_cast<int>(pathLength));
+        m_results.insert(path, std::move(result));
+
+        position = histogramOffset + histogramLength;
+    }
+
+    return true;
+}
+
+bool LoudnessStore::save() const
+{
+    QByteArray bytes;
+    bytes.append(MAGIC, sizeof(MAGIC));
+    appendValue<quint32>(bytes, VERSION);
+    appendValue<quint32>(bytes, static_cast<quint32>(m_results.size()));
+
+    for (auto it = m_results.cbegin(); it != m_results.cend(); ++it) {
+        auto path = it.key().toUtf8();
+        const auto &result = it.value();
+        appendValue<quint32>(bytes, static_cast<quint32>(path.size()));
+        appendValue<qint64>(bytes, result.size);
+        appendValue<qint64>(bytes, result.modified);
+        appendFloat(bytes, result.integrated);
+        appendFloat(bytes, result.truePeak);
+        appendValue<quint32>(bytes, static_cast<quint32>(result.histogram.size()));
+        bytes.append(path);
+        bytes.append(result.histogram);
+    }
+
+    QDir().mkpath(QFileInfo(m_path).absolutePath());
+    QSaveFile file(m_path);
+    if (not file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Couldn't save loudness store to" << m_path << ":" << file.errorString();
+        return false;
+    }
+
+    file.write(bytes);
+    if (not file.commit()) {
+        qWarning() << "Couldn't save loudness store to" << m_path << ":" << file.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+const LoudnessStore::Result *LoudnessStore::find(const QString &path) const
+{
+    auto it = m_results.constFind(path);
+    return it == m_results.cend() ? nullptr : &it.value();
+}
+
+const LoudnessStore::Result *LoudnessStore::find(const QString &path, qint64 size, qint64 modified) const
+{
+    const auto *result = find(path);
+    if (result == nullptr or result->size != size or result->modified != modified) {
+        return nullptr;
+    }
+
+    return result;
+}
+
+void LoudnessStore::insert(const QString &path, Result result)
+{
+    m_results.insert(path, std::move(result));
+}
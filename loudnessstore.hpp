@@ -0,0 +1,44 @@
+#ifndef LOUDNESSSTORE_HPP
+#define LOUDNESSSTORE_HPP
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+
+/* Loudness of every analyzed file, kept in the config directory:
+ *
+ *   magic | version | entry count | entries
+ *
+ * An entry is the path, the size and modification time the file had, its integrated loudness,
+ * true peak and gating histogram. It's read whole when the player starts, an entry is only
+ * used while the file keeps its size and modification time.
+ * Saving rewrites the file next to the old one and renames it over.
+ */
+class LoudnessStore
+{
+public:
+    struct Result
+    {
+        qint64 size;
+        qint64 modified;
+        /* LUFS */
+        float integrated;
+        /* Linear */
+        float truePeak;
+        QByteArray histogram;
+    };
+private:
+    QString m_path;
+    QHash<QString, Result> m_results;
+public:
+    static constexpr quint32 VERSION {1};
+
+    explicit LoudnessStore(QString path);
+    bool load();
+    bool save() const;
+    const Result *find(const QString &path) const;
+    const Result *find(const QString &path, qint64 size, qint64 modified) const;
+    void insert(const QString &path, Result result);
+};
+
+#endif // LOUDNESSSTORE_HPP
@@ -1,4 +1,5 @@
 #include "mainwindow.hpp"
+#include "playeroptions.hpp"
 
 #include <QApplication>
 #include <QLocale>
@@ -7,6 +8,8 @@
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
+    a.setApplicationName(PROGRAM_NAME);
+    a.setApplicationVersion(VERSION);
 
     QTranslator translator;
     const QStringList uiLanguages = QLocale::system().uiLanguages();
@@ -18,7 +21,9 @@ int main(int argc, char *argv[])
         }
     }
 
-    MainWindow w;
+    auto options = PlayerOptions::parse(a);
+
+    MainWindow w(options);
     w.show();
     return a.exec();
 }
@@ -1,21 +1,38 @@
 #include "mainwindow.hpp"
 #include "./ui_mainwindow.h"
 
+#include <algorithm>
+#include <cstdlib>
 #include <QAction>
 #include <QDebug>
 #include <QDir>
+#include <QDragEnterEvent>
+#include <QDropEvent>
+#include <QEvent>
 #include <QFileDialog>
+#include <QFileInfo>
+#include <QHash>
 #include <QInputDialog>
 #include <QMessageBox>
 #include <QList>
+#include <QMimeData>
+#include <QPair>
+#include <QSet>
 #include <QStandardPaths>
 #include <QStringListModel>
+#include <QUrl>
+#include <vector>
 
-MainWindow::MainWindow(QWidget *parent)
+#include "tracer.hpp"
+
+MainWindow::MainWindow(const PlayerOptions &options, QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
     , m_firstTime(true)
     , m_musicCount(0)
+    , m_nextProbeId(0)
+    , m_tracePath(options.tracePath)
+    , m_resumePosition(0.0f)
 {
     ui->setupUi(this);
     ui->playingEdit->setToolTip(tr("If you wrote the file path yourself, press enter afterwards."));
@@ -29,22 +46,54 @@ MainWindow::MainWindow(QWidget *parent)
     actions.append(new QAction(tr("Remove from playlist"), this));
 
     for (auto *action : actions) {
-        connect(action, &QAction::triggered, this, &MainWindow::onListWidgetActionClicked);
+        connect(action, &QAction::triggered, this, &MainWindow::onListViewActionClicked);
     }
 
-    ui->listWidget->setContextMenuPolicy(Qt::ActionsContextMenu);
-    ui->listWidget->addActions(actions);
-    ui->listWidget->setSelectionMode(QAbstractItemView::SingleSelection);
-    ui->listWidget->setSelectionBehavior(QAbstractItemView::SelectItems);
-    ui->listWidget->setEditTriggers(QAbstractItemView::NoEditTriggers);
-
-    connect(ui->listWidget, &QAbstractItemView::doubleClicked, this, &MainWindow::onListWidgetClicked);
+    m_trackModel = new TrackListModel(&m_tracks, this);
+    m_filterModel = new TrackFilterModel(&m_tracks, this);
+    m_filterModel->setSourceModel(m_trackModel);
+    ui->listView->setModel(m_filterModel);
+    ui->listView->setContextMenuPolicy(Qt::ActionsContextMenu);
+    ui->listView->addActions(actions);
+    ui->listView->setSelectionMode(QAbstractItemView::SingleSelection);
+    ui->listView->setSelectionBehavior(QAbstractItemView::SelectItems);
+    ui->listView->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    /* Lay out in batches so huge playlists don't block the first paint */
+    ui->listView->setLayoutMode(QListView::Batched);
+
+    /* Lengths show up as the headers are read, the list is usable right away */
+    m_prober = new MetadataProber(QString("%1%2%3").arg(m_playlist->configDirectory(), QDir::separator(), "metadata.bin"), this);
+    connect(m_prober, &MetadataProber::probed, m_trackModel, &TrackListModel::setInfos);
+    connect(m_prober, &MetadataProber::probed, this, &MainWindow::onTracksProbed);
+
+    /* Tracks without ReplayGain tags are measured on demand */
+    m_analyzer = new LoudnessAnalyzer(QString("%1%2%3").arg(m_playlist->configDirectory(), QDir::separator(), "loudness.bin"), this);
+    connect(m_analyzer, &LoudnessAnalyzer::progress, this, &MainWindow::onLoudnessProgress);
+    connect(m_analyzer, &LoudnessAnalyzer::finished, this, &MainWindow::onLoudnessAnalyzed);
+    connect(m_trackModel, &QAbstractItemModel::dataChanged, this, &MainWindow::updatePlaylistLabel);
+    connect(m_trackModel, &QAbstractItemModel::rowsInserted, this, &MainWindow::updatePlaylistLabel);
+    connect(m_trackModel, &QAbstractItemModel::rowsRemoved, this, &MainWindow::updatePlaylistLabel);
+    connect(m_trackModel, &QAbstractItemModel::modelReset, this, &MainWindow::updatePlaylistLabel);
+
+    connect(ui->listView, &QAbstractItemView::doubleClicked, this, &MainWindow::onListViewClicked);
+    connect(ui->searchEdit, &QLineEdit::textChanged, this, &MainWindow::onSearchTextChanged);
+
+    auto *searchAction = new QAction(tr("Search the playlist"), this);
+    searchAction->setShortcut(QKeySequence::Find);
+    connect(searchAction, &QAction::triggered, this, [this] {
+        ui->searchEdit->setFocus();
+        ui->searchEdit->selectAll();
+    });
+    addAction(searchAction);
     connect(ui->playingEdit, &QLineEdit::returnPressed, this, &MainWindow::onReturnAtEditPressed);
     connect(ui->openFilesButton, &QPushButton::clicked, this, &MainWindow::onOpenFileButtonClicked);
+    connect(ui->addFolderButton, &QPushButton::clicked, this, &MainWindow::onAddFolderButtonClicked);
     connect(ui->closePlaylistButton, &QPushButton::clicked, this, &MainWindow::onClosePlaylistButtonClicked);
     connect(ui->openPlayListButton, &QPushButton::clicked, this, &MainWindow::onOpenPlaylistButtonClicked);
     connect(ui->removePlayListsButton, &QPushButton::clicked, this, &MainWindow::onRemovePlaylistsButtonClicked);
     connect(ui->savePlayListButton, &QPushButton::clicked, this, &MainWindow::onSavePlaylistButtonClicked);
+    connect(ui->importPlayListButton, &QPushButton::clicked, this, &MainWindow::onImportPlaylistButtonClicked);
+    connect(ui->exportPlayListButton, &QPushButton::clicked, this, &MainWindow::onExportPlaylistButtonClicked);
     connect(ui->playPauseButton, &QPushButton::clicked, this, &MainWindow::onPlayPauseButtonClicked);
     connect(ui->stopButton, &QPushButton::clicked, this, &MainWindow::onStopButtonClicked);
     connect(ui->previousButton, &QPushButton::clicked, this, &MainWindow::onPreviousButtonClicked);
@@ -52,35 +101,110 @@ MainWindow::MainWindow(QWidget *parent)
     connect(ui->repeatCheckBox, &QCheckBox::clicked, this, &MainWindow::onRepeatCheckBoxClicked);
     connect(ui->playedTimeSlider, &QSlider::sliderReleased, this, &MainWindow::onSliderReleased);
 
-    m_musicTimer.setInterval(1); /* Update every millisecond. This helps to get a smooth music update */
-    m_sliderTimer.setInterval(1'000); /* Update slider every second */
+    /* Folders are walked in the background, their songs are merged in as they're found */
+    m_scanner = new FolderScanner(this);
+    connect(m_scanner, &FolderScanner::found, this, &MainWindow::addTracks);
+    connect(m_scanner, &FolderScanner::finished, this, &MainWindow::onFolderScanFinished);
+    setAcceptDrops(true);
+
+    /* Playlists from other programs come in the same way, a batch at a time */
+    m_importer = new PlaylistImporter(this);
+    connect(m_importer, &PlaylistImporter::found, this, &MainWindow::onPlaylistEntriesFound);
+    connect(m_importer, &PlaylistImporter::failed, this, &MainWindow::onPlaylistImportFailed);
+    connect(m_importer, &PlaylistImporter::finished, this, &MainWindow::onPlaylistImported);
+
+    /* Songs in the queue and in saved playlists follow what happens to them on disk */
+    m_watcher = new LibraryWatcher(this);
+    connect(m_watcher, &LibraryWatcher::changed, this, &MainWindow::onLibraryChanged);
+    m_watchTimer.setSingleShot(true);
+    m_watchTimer.setInterval(1'000);
+    connect(&m_watchTimer, &QTimer::timeout, this, &MainWindow::updateWatchedDirectories);
+    connect(m_trackModel, &QAbstractItemModel::rowsInserted, &m_watchTimer, qOverload<>(&QTimer::start));
+    connect(m_trackModel, &QAbstractItemModel::rowsRemoved, &m_watchTimer, qOverload<>(&QTimer::start));
+    connect(m_trackModel, &QAbstractItemModel::modelReset, &m_watchTimer, qOverload<>(&QTimer::start));
+
     m_statusTimer.setInterval(5'000); /* Show status message for 5 seconds */
-    connect(&m_musicTimer, &QTimer::timeout, this, &MainWindow::onMusicTimeout);
-    connect(&m_sliderTimer, &QTimer::timeout, this, &MainWindow::onSliderTimeout);
     connect(&m_statusTimer, &QTimer::timeout, this, &MainWindow::onStatusTimeout);
 
-    SetTraceLogLevel(LOG_ERROR);
-    InitAudioDevice();
+    /* The engine streams the music on its own thread, so a busy GUI can't starve it */
+    m_engine = new PlaybackEngine(this);
+    connect(m_engine, &PlaybackEngine::loaded, this, &MainWindow::onMusicLoaded);
+    connect(m_engine, &PlaybackEngine::advanced, this, &MainWindow::onMusicAdvanced);
+    connect(m_engine, &PlaybackEngine::loadFailed, this, &MainWindow::onMusicLoadFailed);
+    connect(m_engine, &PlaybackEngine::trackFinished, this, &MainWindow::onTrackFinished);
+    connect(m_engine, &PlaybackEngine::seekIndexBuilt, m_prober, &MetadataProber::storeSeekIndex);
+    m_engine->setStreamLimits(options.streamLimits);
+    m_engine->setBuffering(options.decodeAheadSeconds, options.readaheadSeconds);
+    m_engine->setSink(AudioSink::create(options.sinkKind, options.sinkPath), options.sinkSpeed);
+    m_engine->setAudioCacheBudget(options.audioCacheBytes);
+    m_engine->setProcessing(options.processing);
+    m_engine->setCrossfade(options.crossfadeSeconds);
+    MusicHandle::setMaxMappedBytes(options.maxMappedBytes);
+
+    m_presenter = new PlaybackPresenter(&m_engine->clock(), ui->timePlayedLabel, ui->lengthLabel,
+                                        ui->playedTimeSlider, ui->playPauseButton, this);
+    connect(m_engine, &PlaybackEngine::stateChanged, m_presenter, &PlaybackPresenter::onStateChanged);
+
+    /* Counters are only formatted when somebody looks at them */
+    ui->statusLabel->installEventFilter(this);
+    ui->statusLabel->setContextMenuPolicy(Qt::ActionsContextMenu);
+
+    m_analyzeAction = new QAction(tr("Analyze loudness"), this);
+    m_analyzeAction->setShortcut(QKeySequence(Qt::CTRL | Qt::Key_L));
+    connect(m_analyzeAction, &QAction::triggered, this, &MainWindow::analyzeLoudness);
+    addAction(m_analyzeAction);
+    ui->statusLabel->addAction(m_analyzeAction);
+
+#ifdef BITMPLAYER_TRACING
+    auto *traceAction = new QAction(tr("Save performance trace..."), this);
+    traceAction->setShortcut(QKeySequence(Qt::CTRL | Qt::SHIFT | Qt::Key_T));
+    connect(traceAction, &QAction::triggered, this, &MainWindow::saveTrace);
+    /* The shortcut works anywhere in the window, the status label offers it on right click */
+    addAction(traceAction);
+    ui->statusLabel->addAction(traceAction);
+#endif
+
+    m_sessionPath = QString("%1%2%3").arg(m_playlist->configDirectory(), QDir::separator(), "session.bin");
+    m_sessionTimer.setSingleShot(true);
+    m_sessionTimer.setInterval(2'000);
+    connect(&m_sessionTimer, &QTimer::timeout, this, &MainWindow::saveSession);
+    restoreSession();
+    connect(m_trackModel, &QAbstractItemModel::rowsInserted, &m_sessionTimer, qOverload<>(&QTimer::start));
+    connect(m_trackModel, &QAbstractItemModel::rowsRemoved, &m_sessionTimer, qOverload<>(&QTimer::start));
+    connect(m_trackModel, &QAbstractItemModel::modelReset, &m_sessionTimer, qOverload<>(&QTimer::start));
 }
 
 MainWindow::~MainWindow()
 {
-    CloseAudioDevice();
+    /* While the engine still knows where it was */
+    saveSession();
+    m_engine->shutdown();
+#ifdef BITMPLAYER_TRACING
+    /* After the engine stopped, so its last spans are in */
+    if (not m_tracePath.isEmpty()) {
+        Tracer::exportChromeTrace(m_tracePath);
+    }
+#endif
     delete ui;
 }
 
-void MainWindow::onListWidgetClicked(const QModelIndex &index)
+void MainWindow::onListViewClicked(const QModelIndex &index)
 {
+    auto row = m_filterModel->mapToSource(index).row();
+    if (row < 0) {
+        return;
+    }
+
     stopMusic();
-    m_musicCount = index.row();
+    m_musicCount = row;
     setMusic(m_musicCount);
     setMusicNameToEdit();
     playMusic();
 }
 
-void MainWindow::onListWidgetActionClicked(bool triggered)
+void MainWindow::onListViewActionClicked(bool triggered)
 {
-    auto index = ui->listWidget->currentIndex();
+    auto index = m_filterModel->mapToSource(ui->listView->currentIndex());
     if (index.row() < 0) {
         return;
     }
@@ -96,47 +220,48 @@ void MainWindow::onListWidgetActionClicked(bool triggered)
     }
 
     /* Working with remove from playlist action */
-    auto filename = index.data().toString();
-    auto path = m_splittedSongs[filename];
-    m_filenames.removeOne(QString("%1%2%3").arg(path, QDir::separator(), filename));
-    m_splittedSongs.erase(filename);
-    ui->listWidget->model()->removeRow(index.row());
-
-    /* Because m_musicPlaying holds the full file path of the currently playing music
-     * and the list view just shows the filename.
-     */
-    auto idx = m_musicPlaying.lastIndexOf('/');
-    auto musicPlayingFilename = m_musicPlaying.mid(idx + 1, m_musicPlaying.size());
-
-    if (musicPlayingFilename == filename) {
-        stopMusic();
-        if (ui->playingEdit->text() == filename) {
-            ui->playingEdit->setText("");
+    int row = index.row();
+    bool removingPlayingSong = m_tracks.path(row) == m_musicPlaying;
+    m_trackModel->removeTrack(row);
+
+    if (not removingPlayingSong) {
+        /* Rows after the removed one moved up by one */
+        if (static_cast<int>(m_musicCount) > row) {
+            --m_musicCount;
         }
+        updateNeighbours();
+        return;
+    }
 
-        if (m_musicCount > index.row()) {
-            m_musicCount = index.row();
-        }
+    stopMusic();
+    m_musicPlaying.clear();
+    if (m_tracks.isEmpty()) {
+        m_musicCount = 0;
+        return;
+    }
 
-        setMusic(m_musicCount);
-        ui->listWidget->setCurrentRow(m_musicCount);
-        /* TODO: Check if setMusic() shall ui->playingEdit->setText() */
-        idx = m_musicPlaying.lastIndexOf('/');
-        musicPlayingFilename = m_musicPlaying.mid(idx + 1, m_musicPlaying.size());
-        ui->playingEdit->setText(musicPlayingFilename);
+    if (m_musicCount >= static_cast<unsigned int>(m_tracks.count())) {
+        m_musicCount = m_tracks.count() - 1;
     }
+
+    setMusic(m_musicCount);
+    setCurrentRow(m_musicCount);
+    setMusicNameToEdit();
 }
 
 void MainWindow::onOpenPlaylistButtonClicked()
 {
-    m_splittedSongs = m_playlist->openPlayList();
-    if (m_splittedSongs.size() == 0) {
+    auto paths = m_playlist->openPlayList();
+    if (paths.isEmpty()) {
         return;
     }
 
     m_musicCount = 0;
-    putSongsTogether();
-    setMusicNamesToListWidget();
+    m_scanner->cancel();
+    m_importer->cancel();
+    cancelProbing();
+    m_trackModel->setTracks(paths);
+    probeNewTracks();
     setMusicNameToEdit();
     setMusic(m_musicCount);
 }
@@ -148,6 +273,7 @@ void MainWindow::onRemovePlaylistsButtonClicked()
         return;
     }
 
+    m_watchTimer.start();
     auto message = removed == 1 ? tr("%1 playlist removed.") : tr("%1 playlists removed.");
     message = message.arg(QString::number(removed));
     setStatusText(message);
@@ -155,7 +281,7 @@ void MainWindow::onRemovePlaylistsButtonClicked()
 
 void MainWindow::onSavePlaylistButtonClicked()
 {
-    if (m_filenames.isEmpty()) {
+    if (m_tracks.isEmpty()) {
         QMessageBox::warning(this, tr("Warning"), tr("No song has been loaded."));
         return;
     }
@@ -166,19 +292,110 @@ void MainWindow::onSavePlaylistButtonClicked()
         return;
     }
 
-    m_playlist->savePlayList(playlistName, m_splittedSongs);
+    m_playlist->savePlayList(playlistName, m_tracks.paths());
+    m_watchTimer.start();
     setStatusText(tr("Playlist saved!"), Qt::green);
 }
 
-void MainWindow::resetControllers(bool resetLength, bool resetPlayingEdit)
+void MainWindow::onImportPlaylistButtonClicked()
+{
+    auto path = QFileDialog::getOpenFileName(this,
+                                             tr("Import playlist"),
+                                             QStandardPaths::writableLocation(QStandardPaths::MusicLocation),
+                                             tr("Playlists (*.m3u *.m3u8 *.pls *.xspf)"));
+    if (path.isEmpty()) {
+        return;
+    }
+
+    /* Like opening a saved playlist, it takes the place of the queue */
+    onClosePlaylistButtonClicked();
+    setStatusText(tr("Importing %1...").arg(QFileInfo(path).fileName()));
+    m_importer->import(path);
+}
+
+void MainWindow::onExportPlaylistButtonClicked()
+{
+    if (m_tracks.isEmpty()) {
+        QMessageBox::warning(this, tr("Warning"), tr("No song has been loaded."));
+        return;
+    }
+
+    QString filter;
+    auto path = QFileDialog::getSaveFileName(this,
+                                             tr("Export playlist"),
+                                             QStandardPaths::writableLocation(QStandardPaths::MusicLocation),
+                                             tr("M3U8 playlists (*.m3u8);;M3U playlists (*.m3u);;PLS playlists (*.pls);;XSPF playlists (*.xspf)"),
+                                             &filter);
+    if (path.isEmpty()) {
+        return;
+    }
+
+    /* The chosen filter decides when the name doesn't */
+    if (PlaylistFile::formatOf(path) == PlaylistFile::Format::Unknown) {
+        auto open = filter.lastIndexOf("*.");
+        path += filter.mid(open + 1, filter.lastIndexOf(')') - open - 1);
+    }
+
+    QString error;
+    if (PlaylistFile::write(path, m_tracks, error)) {
+        setStatusText(tr("Playlist exported!"), Qt::green);
+    } else {
+        setStatusText(tr("Couldn't export the playlist: %1").arg(error), Qt::red);
+    }
+}
+
+void MainWindow::onPlaylistEntriesFound(const QVector<PlaylistFile::Entry> &entries)
+{
+    TRACE_SCOPE("MainWindow::onPlaylistEntriesFound");
+    QStringList paths;
+    paths.reserve(entries.size());
+    for (const auto &entry : entries) {
+        paths << entry.path;
+    }
+
+    /* In the playlist's order, not merged into the sorted queue */
+    m_trackModel->appendTracks(paths);
+    probeNewTracks();
+    followPlayingSong();
+
+    /* Lengths the playlist gave show until the files are probed */
+    QVector<ProbeResult> results;
+    for (const auto &entry : entries) {
+        if (entry.duration <= 0.0f) {
+            continue;
+        }
+
+        auto row = m_tracks.indexOf(entry.path);
+        if (row != TrackTable::INVALID_ROW and not m_tracks.info(row).probed) {
+            TrackInfo info;
+            info.duration = entry.duration;
+            results.append({m_tracks.id(row), info});
+        }
+    }
+
+    if (not results.isEmpty()) {
+        m_trackModel->setInfos(results);
+    }
+}
+
+void MainWindow::onPlaylistImportFailed(const QString &path, const QString &error)
 {
-    ui->playPauseButton->setText(tr("Play"));
-    ui->playedTimeSlider->setSingleStep(0);
-    ui->playedTimeSlider->setValue(0);
-    ui->timePlayedLabel->setText("0s");
+    setStatusText(tr("Couldn't import %1: %2").arg(QFileInfo(path).fileName(), error), Qt::red);
+}
+
+void MainWindow::onPlaylistImported(int total, bool cancelled)
+{
+    if (cancelled) {
+        setStatusText(tr("Import stopped."));
+        return;
+    }
 
-    if (resetLength)
-        ui->lengthLabel->setText("0m");
+    setStatusText(tr("%1 songs imported.").arg(total), Qt::green);
+}
+
+void MainWindow::resetControllers(bool resetLength, bool resetPlayingEdit)
+{
+    m_presenter->reset(resetLength);
 
     if (resetPlayingEdit)
         ui->playingEdit->setText("");
@@ -195,122 +412,238 @@ void MainWindow::setStatusText(QString text, QColor color)
 
 void MainWindow::setMusic(unsigned int number)
 {
-    if (number >= m_filenames.count()) {
+    TRACE_SCOPE("MainWindow::setMusic");
+    if (number >= static_cast<unsigned int>(m_tracks.count())) {
         return;
     }
 
-    m_musicPlaying = m_filenames[number];
-    m_music = LoadMusicStream(m_musicPlaying.toStdString().c_str());
-    m_music.looping = false;
-    m_streamLength = GetMusicTimeLength(m_music);
-    auto length = static_cast<int>(m_streamLength);
-    int maximum {length};
-    QString text {};
+    m_resumePath.clear();
+    m_musicPlaying = m_tracks.path(number);
+    m_sessionTimer.start();
+    sendSeekIndex(m_musicPlaying);
+    sendReplayGain(static_cast<int>(number));
+    m_engine->load(m_musicPlaying);
+    updateNeighbours();
+}
 
-    if (length >= 60) {
-        auto minutes = length / 60;
-        length %= 60;
-        if (minutes >= 60) {
-            auto hours = minutes / 60;
-            minutes %= 60;
-            length %= 60;
-            text = tr("%1h, %2m, %3s")
-                       .arg(QString::number(hours), QString::number(minutes), QString::number(length));
-        } else {
-            text = tr("%1m, %2s").arg(QString::number(minutes), QString::number(length));
+void MainWindow::updateNeighbours()
+{
+    /* The engine opens these in the background: the next one so it starts as soon as this one ends,
+     * both of them so previous and next buttons switch instantly.
+     */
+    QString previous {};
+    QString next {};
+
+    auto count = static_cast<unsigned int>(m_tracks.count());
+    if (m_musicCount > 0 and m_musicCount - 1 < count) {
+        previous = m_tracks.path(m_musicCount - 1);
+    }
+
+    if (m_musicCount + 1 < count) {
+        next = m_tracks.path(m_musicCount + 1);
+    }
+
+    m_engine->setNeighbours(previous, next);
+    sendSeekIndex(previous);
+    sendSeekIndex(next);
+    if (not previous.isEmpty()) {
+        sendReplayGain(static_cast<int>(m_musicCount) - 1);
+    }
+    if (not next.isEmpty()) {
+        sendReplayGain(static_cast<int>(m_musicCount) + 1);
+    }
+}
+
+void MainWindow::sendReplayGain(int row)
+{
+    if (row < 0 or row >= m_tracks.count()) {
+        return;
+    }
+
+    /* Tags win, measured loudness fills in what they don't have */
+    auto replayGain = m_tracks.info(row).replayGain;
+    if (not replayGain.hasTrack or not replayGain.hasAlbum) {
+        auto measured = m_analyzer->replayGain(m_tracks.path(row));
+        if (not replayGain.hasTrack and measured.hasTrack) {
+            replayGain.trackGain = measured.trackGain;
+            replayGain.trackPeak = measured.trackPeak;
+            replayGain.hasTrack = true;
+        }
+        if (not replayGain.hasAlbum and measured.hasAlbum) {
+            replayGain.albumGain = measured.albumGain;
+            replayGain.albumPeak = measured.albumPeak;
+            replayGain.hasAlbum = true;
         }
-    } else {
-        text = tr("%1s").arg(QString::number(length));
     }
 
-    ui->lengthLabel->setText(text);
-    ui->playedTimeSlider->setMaximum(maximum);
-    ui->playedTimeSlider->setValue(0);
+    /* Neither, only the preamp applies and the engine falls back to that by itself */
+    if (replayGain.hasTrack or replayGain.hasAlbum) {
+        m_engine->setReplayGain(m_tracks.path(row), replayGain);
+    }
 }
 
-void MainWindow::playMusic()
+void MainWindow::onTracksProbed(const QVector<ProbeResult> &results)
 {
-    PlayMusicStream(m_music);
-    m_musicTimer.start();
-    m_sliderTimer.start();
-    ui->playPauseButton->setText(tr("Pause"));
-    m_firstTime = false;
+    /* The restored song shows its length before it's loaded */
+    if (not m_resumePath.isEmpty()) {
+        auto resumeRow = m_tracks.indexOf(m_resumePath);
+        for (const auto &result : results) {
+            if (resumeRow != TrackTable::INVALID_ROW and m_tracks.row(result.id) == resumeRow) {
+                m_presenter->setLength(result.info.duration);
+                m_presenter->showPosition(m_resumePosition);
+            }
+        }
+        return;
+    }
+
+    if (m_musicPlaying.isEmpty()) {
+        return;
+    }
+
+    /* The tags of the current track or its neighbours may only be known now */
+    for (const auto &result : results) {
+        auto row = m_tracks.row(result.id);
+        if (row != TrackTable::INVALID_ROW and std::abs(row - static_cast<int>(m_musicCount)) <= 1) {
+            sendReplayGain(row);
+        }
+    }
 }
 
-void MainWindow::stopMusic(bool resetLength, bool resetPlayingEdit)
+void MainWindow::sendSeekIndex(const QString &path)
 {
-    m_musicTimer.stop();
-    m_sliderTimer.stop();
+    if (path.isEmpty()) {
+        return;
+    }
 
-    /* ResumeMusicStream for StopMusicStream to work properly.
-     * If user pauses the song and afterward stops it, GetMusicTimePlayed
-     * will return the last time played rather than 0.0f which is the
-     * correct value taking in account that what we actually want is stop the song.
-     * In other words, reset it.
-     */
-    if (not IsMusicStreamPlaying(m_music))
-        ResumeMusicStream(m_music);
+    /* Built by the engine the first time the file was played */
+    auto index = m_prober->seekIndex(path);
+    if (not index.isEmpty()) {
+        m_engine->setSeekIndex(path, index);
+    }
+}
 
-    StopMusicStream(m_music);
-    resetControllers(resetLength, resetPlayingEdit);
-    m_firstTime = true;
+void MainWindow::onMusicLoaded([[maybe_unused]] QString path, float length)
+{
+    m_presenter->setLength(length);
+    m_presenter->showPosition(0.0f);
 }
 
-int MainWindow::setTimePlayedText(int value)
+bool MainWindow::eventFilter(QObject *watched, QEvent *event)
 {
-    QString text {};
+    if (watched == ui->statusLabel and event->type() == QEvent::ToolTip) {
+        updateStatusToolTip();
+    }
 
-    if (value >= 60) {
-        auto minutes = value / 60;
-        value %= 60;
-        if (minutes >= 60) {
-            auto hours = minutes / 60;
-            minutes %= 60;
-            value %= 60;
-            text = tr("%1h, %2m, %3s")
-                       .arg(QString::number(hours), QString::number(minutes), QString::number(value));
-        } else {
-            text = tr("%1m, %2s").arg(QString::number(minutes), QString::number(value));
-        }
-    } else {
-        text = tr("%1s").arg(QString::number(value));
+    if (watched == ui->listView->viewport() and event->type() == QEvent::Paint) {
+        /* Only once, after the restored queue is on screen */
+        ui->listView->viewport()->removeEventFilter(this);
+        QTimer::singleShot(0, this, &MainWindow::probeNewTracks);
     }
 
-    ui->timePlayedLabel->setText(text);
+    return QMainWindow::eventFilter(watched, event);
+}
 
-    return value;
+void MainWindow::updateStatusToolTip()
+{
+    ui->statusLabel->setToolTip(tr("%1 open decoders, %2 KiB resident, %6 MiB of files cached.\n"
+                                   "%3 s prefetched, %4 stalls, %5 underruns.")
+                                    .arg(QString::number(MusicHandle::openHandles()),
+                                         QString::number(MusicHandle::totalResidentBytes() / 1'024),
+                                         QString::number(m_engine->prefetchedSeconds(), 'f', 1),
+                                         QString::number(m_engine->stalls()),
+                                         QString::number(m_engine->underruns()),
+                                         QString::number(m_engine->audioCacheBytes() / (1'024 * 1'024))));
 }
 
-void MainWindow::splitSongs()
+void MainWindow::saveTrace()
 {
-    for (auto file : m_filenames) {
-        auto index = file.lastIndexOf('/');
-        auto songName = file.mid(index + 1, file.size());
-        auto filePath = file.mid(0, index);
-        m_splittedSongs[songName] = filePath;
+#ifdef BITMPLAYER_TRACING
+    auto path = QFileDialog::getSaveFileName(this,
+                                             tr("Save performance trace"),
+                                             QString("%1%2%3").arg(QDir::homePath(), QDir::separator(), "BitMPlayer-trace.json"),
+                                             tr("Chrome traces (*.json)"));
+    if (path.isEmpty()) {
+        return;
+    }
+
+    if (Tracer::exportChromeTrace(path)) {
+        setStatusText(tr("Trace saved!"), Qt::green);
+    } else {
+        setStatusText(tr("Couldn't save the trace."), Qt::red);
     }
+#endif
 }
 
-void MainWindow::putSongsTogether()
+void MainWindow::analyzeLoudness()
 {
-    for (const auto [songName, filePath] : m_splittedSongs) {
-        m_filenames << QString("%1%2%3").arg(filePath, QDir::separator(), songName);
+    if (m_analyzer->isRunning()) {
+        m_analyzer->cancel();
+        return;
+    }
+
+    if (m_tracks.isEmpty()) {
+        setStatusText(tr("There's nothing to analyze."), Qt::red);
+        return;
     }
+
+    m_analyzeAction->setText(tr("Cancel loudness analysis"));
+    m_analyzer->analyze(m_tracks.paths());
 }
 
-void MainWindow::setMusicNamesToListWidget()
+void MainWindow::onLoudnessProgress(int done, int total)
 {
-    QStringList names;
+    setStatusText(tr("Analyzing loudness: %1 of %2 tracks...").arg(done).arg(total));
+}
 
-    for (const auto [songName, filePath] : m_splittedSongs) {
-        names << songName;
+void MainWindow::onLoudnessAnalyzed(int analyzed, bool cancelled)
+{
+    m_analyzeAction->setText(tr("Analyze loudness"));
+    if (cancelled) {
+        setStatusText(tr("Loudness analysis cancelled."));
+        return;
     }
 
-    if (ui->listWidget->count() > 0) {
-        ui->listWidget->clear();
+    setStatusText(tr("Loudness analyzed, %1 tracks measured.").arg(analyzed), Qt::green);
+
+    /* What's playing right now gets normalized too */
+    if (not m_musicPlaying.isEmpty()) {
+        for (auto row = static_cast<int>(m_musicCount) - 1; row <= static_cast<int>(m_musicCount) + 1; ++row) {
+            sendReplayGain(row);
+        }
     }
+}
 
-    ui->listWidget->addItems(names);
+void MainWindow::onMusicAdvanced(QString path)
+{
+    /* The engine already switched to the next track without a gap, catch up */
+    auto index = m_tracks.indexOf(path);
+    if (index == TrackTable::INVALID_ROW) {
+        return;
+    }
+
+    m_musicCount = index;
+    m_musicPlaying = path;
+    m_sessionTimer.start();
+    setMusicNameToEdit();
+    updateNeighbours();
+}
+
+void MainWindow::onMusicLoadFailed(QString path)
+{
+    setStatusText(tr("Couldn't load %1.").arg(path), Qt::red);
+}
+
+void MainWindow::playMusic()
+{
+    m_engine->play();
+    m_firstTime = false;
+}
+
+void MainWindow::stopMusic(bool resetLength, bool resetPlayingEdit)
+{
+    m_engine->stop();
+    resetControllers(resetLength, resetPlayingEdit);
+    m_firstTime = true;
 }
 
 void MainWindow::setMusicNameToEdit()
@@ -318,33 +651,87 @@ void MainWindow::setMusicNameToEdit()
     ui->playingEdit->setText(getCurrentSongName());
 }
 
+void MainWindow::setCurrentRow(int row)
+{
+    /* Nothing is selected while the row is filtered out */
+    ui->listView->setCurrentIndex(m_filterModel->mapFromSource(m_trackModel->index(row)));
+}
+
+void MainWindow::onSearchTextChanged(const QString &text)
+{
+    m_filterModel->setQuery(text);
+    if (not m_tracks.isEmpty()) {
+        /* Keep the playing song in sight when it's still there */
+        setCurrentRow(m_musicCount);
+        ui->listView->scrollTo(ui->listView->currentIndex());
+    }
+}
+
 QString MainWindow::getCurrentSongName()
 {
-    QString songName {};
-    int i {};
-    for (auto it = m_splittedSongs.begin(); it != m_splittedSongs.end(); ++it, ++i) {
-        if (i == m_musicCount) {
-            songName = it->first;
-            break;
+    if (m_musicCount >= static_cast<unsigned int>(m_tracks.count())) {
+        return {};
+    }
+
+    return m_tracks.name(m_musicCount);
+}
+
+void MainWindow::probeNewTracks()
+{
+    QVector<MetadataProber::Request> requests;
+    auto nextProbeId = m_nextProbeId;
+
+    for (int row {}; row < m_tracks.count(); ++row) {
+        auto id = m_tracks.id(row);
+        if (id < m_nextProbeId) {
+            continue;
         }
+
+        /* Renamed songs brought what was known about them along */
+        if (not m_tracks.info(row).probed) {
+            requests.append({id, m_tracks.path(row)});
+        }
+        nextProbeId = std::max(nextProbeId, id + 1);
+    }
+
+    m_nextProbeId = nextProbeId;
+    if (not requests.isEmpty()) {
+        m_prober->probe(std::move(requests));
     }
+}
 
-    return songName;
+void MainWindow::cancelProbing()
+{
+    /* The ids are about to be handed out again */
+    m_prober->cancel();
+    m_nextProbeId = 0;
+}
+
+void MainWindow::updatePlaylistLabel()
+{
+    if (m_tracks.isEmpty()) {
+        ui->playlistLabel->setText(tr("Playlist"));
+        return;
+    }
+
+    auto seconds = static_cast<int>(m_tracks.totalDuration());
+    auto songs = m_tracks.count() == 1 ? tr("1 song") : tr("%1 songs").arg(QString::number(m_tracks.count()));
+    ui->playlistLabel->setText(tr("Playlist (%1, %2h, %3m)")
+                                   .arg(songs, QString::number(seconds / 3'600), QString::number(seconds / 60 % 60)));
 }
 
 void MainWindow::onReturnAtEditPressed()
 {
     auto filename = ui->playingEdit->text();
-    auto index = filename.lastIndexOf('/');
-    auto songName = filename.mid(index + 1, filename.size());
-    auto filePath = filename.mid(0, index + 1);
+    if (filename.isEmpty()) {
+        return;
+    }
 
-    m_filenames.append(filename);
-    m_splittedSongs[songName] = filePath;
-    setMusic(m_filenames.indexOf(m_filenames.last()));
+    m_musicCount = m_trackModel->appendTrack(filename);
+    probeNewTracks();
+    setMusic(m_musicCount);
     setMusicNameToEdit();
-    setMusicNamesToListWidget();
-    ui->listWidget->setCurrentRow(m_filenames.indexOf(m_filenames.last()));
+    setCurrentRow(m_musicCount);
 }
 
 void MainWindow::onOpenFileButtonClicked()
@@ -358,95 +745,333 @@ void MainWindow::onOpenFileButtonClicked()
         return;
     }
 
-    for (auto file : files) {
-        m_filenames.append(file);
+    addTracks(files);
+}
+
+void MainWindow::onAddFolderButtonClicked()
+{
+    auto directory = QFileDialog::getExistingDirectory(this,
+                                                       tr("Add folder"),
+                                                       QStandardPaths::writableLocation(QStandardPaths::MusicLocation));
+    if (directory.isEmpty()) {
+        return;
     }
 
-    m_filenames.sort();
-    splitSongs();
+    setStatusText(tr("Looking for songs in %1...").arg(directory));
+    m_scanner->scan({directory});
+}
 
-    bool restoreTimePlayed {};
-    if (not m_musicPlaying.isEmpty()) {
-        m_lastMusicPlaying = m_musicPlaying;
-        m_lastTimePlayed = GetMusicTimePlayed(m_music);
-        m_musicCount = m_filenames.indexOf(m_lastMusicPlaying);
-        stopMusic(false, false);
-        restoreTimePlayed = true;
+void MainWindow::onFolderScanFinished(int total, bool cancelled)
+{
+    if (cancelled) {
+        setStatusText(tr("Stopped looking for songs."));
+        return;
+    }
+
+    setStatusText(tr("%1 songs found.").arg(total), Qt::green);
+}
+
+void MainWindow::addTracks(const QStringList &paths)
+{
+    /* Merged into the sorted queue, nothing that's playing is interrupted */
+    m_trackModel->addTracks(paths);
+    probeNewTracks();
+    followPlayingSong();
+}
+
+void MainWindow::followPlayingSong()
+{
+    if (m_tracks.isEmpty()) {
+        m_musicCount = 0;
+        m_resumePath.clear();
+        return;
+    }
+
+    /* The last session's song is still waiting to be played */
+    auto resumeRow = m_resumePath.isEmpty() ? TrackTable::INVALID_ROW : m_tracks.indexOf(m_resumePath);
+    if (resumeRow != TrackTable::INVALID_ROW) {
+        m_musicCount = resumeRow;
+        return;
     }
+    m_resumePath.clear();
 
-    setMusicNamesToListWidget();
+    /* The playing song may have moved, and its neighbours may have changed */
+    auto row = m_musicPlaying.isEmpty() ? TrackTable::INVALID_ROW : m_tracks.indexOf(m_musicPlaying);
+    if (row != TrackTable::INVALID_ROW) {
+        m_musicCount = row;
+        updateNeighbours();
+        return;
+    }
+
+    if (m_musicCount >= static_cast<unsigned int>(m_tracks.count())) {
+        m_musicCount = m_tracks.count() - 1;
+    }
     setMusic(m_musicCount);
     setMusicNameToEdit();
-    ui->listWidget->setCurrentRow(m_filenames.indexOf(m_musicPlaying));
+    setCurrentRow(m_musicCount);
+}
 
-    if (restoreTimePlayed) {
-        SeekMusicStream(m_music, m_lastTimePlayed);
-        int timePlayed = static_cast<int>(m_lastTimePlayed);
-        ui->playedTimeSlider->setValue(timePlayed);
-        setTimePlayedText(timePlayed);
-        playMusic();
+void MainWindow::updateWatchedDirectories()
+{
+    auto directories = m_tracks.directories();
+    directories << m_playlist->directories();
+    m_watcher->setDirectories(directories);
+}
+
+void MainWindow::onLibraryChanged(const LibraryWatcher::Changes &changes)
+{
+    TRACE_SCOPE("MainWindow::onLibraryChanged");
+    std::vector<int> removedRows;
+    QStringList added;
+    QVector<QPair<QString, TrackInfo>> carried;
+    QVector<MetadataProber::Request> changed;
+    bool playingRemoved {false};
+
+    auto removeRow = [&](int row) {
+        if (row == TrackTable::INVALID_ROW) {
+            return;
+        }
+
+        removedRows.push_back(row);
+        if (m_tracks.path(row) == m_musicPlaying) {
+            playingRemoved = true;
+        }
+    };
+
+    /* Saved playlists follow renames, deleted songs stay in them in case they come back */
+    QHash<QString, QString> renamed;
+    for (const auto &rename : changes.renamed) {
+        m_prober->renamePath(rename.first, rename.second);
+        renamed.insert(rename.first, rename.second);
+
+        auto row = m_tracks.indexOf(rename.first);
+        if (row == TrackTable::INVALID_ROW) {
+            continue;
+        }
+
+        /* The engine has the file open already, it plays on under the new name */
+        if (rename.first == m_musicPlaying) {
+            m_musicPlaying = rename.second;
+            m_engine->renamePath(rename.first, rename.second);
+        }
+        removedRows.push_back(row);
+        added.append(rename.second);
+        carried.append({rename.second, m_tracks.info(row)});
+    }
+    /* Opening the store just to find nothing to rename is what the lazy loading avoids */
+    if (not renamed.isEmpty()) {
+        m_playlist->renamePaths(renamed);
+    }
+
+    for (const auto &path : changes.removed) {
+        m_prober->forgetPath(path);
+        removeRow(m_tracks.indexOf(path));
+    }
+
+    if (not changes.removedDirectories.isEmpty()) {
+        for (int row {}; row < m_tracks.count(); ++row) {
+            auto directory = m_tracks.directory(row);
+            for (const auto &removed : changes.removedDirectories) {
+                if (directory == removed or directory.startsWith(removed + '/')) {
+                    removeRow(row);
+                    break;
+                }
+            }
+        }
+    }
+
+    /* Edited songs are probed again, new ones only join the queue next to songs it already has */
+    auto directories = m_tracks.directories();
+    QSet<QString> queueDirectories(directories.cbegin(), directories.cend());
+    for (const auto &path : changes.added) {
+        auto row = m_tracks.indexOf(path);
+        if (row != TrackTable::INVALID_ROW) {
+            changed.append({m_tracks.id(row), path});
+        } else if (queueDirectories.contains(QFileInfo(path).path())) {
+            added.append(path);
+        }
+    }
+
+    if (not changed.isEmpty()) {
+        m_prober->probe(std::move(changed));
+    }
+
+    if (removedRows.empty() and added.isEmpty()) {
+        return;
+    }
+
+    m_trackModel->removeTracks(std::move(removedRows));
+    if (playingRemoved) {
+        stopMusic();
+        m_musicPlaying.clear();
+    }
+
+    m_trackModel->addTracks(added);
+    QVector<ProbeResult> results;
+    for (const auto &info : carried) {
+        auto row = m_tracks.indexOf(info.first);
+        if (row != TrackTable::INVALID_ROW) {
+            results.append({m_tracks.id(row), info.second});
+        }
+    }
+    if (not results.isEmpty()) {
+        m_trackModel->setInfos(results);
+    }
+
+    probeNewTracks();
+    followPlayingSong();
+}
+
+void MainWindow::restoreSession()
+{
+    TRACE_SCOPE("MainWindow::restoreSession");
+    SessionStore::Session session;
+    if (not SessionStore(m_sessionPath).load(session) or session.tracks.isEmpty()) {
+        return;
+    }
+
+    /* Only the queue is shown, nothing is opened until it's played.
+     * Probing stats every song, it waits until the queue was painted.
+     */
+    m_trackModel->setTracks(session.tracks, session.keepOrder);
+    ui->listView->viewport()->installEventFilter(this);
+    if (session.current >= 0) {
+        auto row = m_tracks.indexOf(session.tracks[session.current]);
+        if (row != TrackTable::INVALID_ROW) {
+            m_musicCount = row;
+            m_resumePath = m_tracks.path(row);
+            m_resumePosition = session.position;
+            setMusicNameToEdit();
+            setCurrentRow(m_musicCount);
+        }
+    }
+
+    ui->repeatCheckBox->setChecked(session.repeat);
+    onRepeatCheckBoxClicked(session.repeat);
+}
+
+void MainWindow::saveSession()
+{
+    m_sessionTimer.stop();
+
+    SessionStore::Session session;
+    session.tracks = m_tracks.paths();
+    session.keepOrder = not m_tracks.isSorted();
+    if (not m_resumePath.isEmpty()) {
+        session.current = m_tracks.indexOf(m_resumePath);
+        session.position = m_resumePosition;
+    } else if (not m_musicPlaying.isEmpty()) {
+        session.current = m_tracks.indexOf(m_musicPlaying);
+        session.position = m_engine->timePlayed();
+    }
+    session.repeat = ui->repeatCheckBox->isChecked();
+
+    SessionStore(m_sessionPath).save(session);
+}
+
+void MainWindow::dragEnterEvent(QDragEnterEvent *event)
+{
+    if (event->mimeData()->hasUrls()) {
+        event->acceptProposedAction();
+    }
+}
+
+void MainWindow::dropEvent(QDropEvent *event)
+{
+    QStringList files;
+    QStringList directories;
+    for (const auto &url : event->mimeData()->urls()) {
+        if (not url.isLocalFile()) {
+            continue;
+        }
+
+        auto path = url.toLocalFile();
+        if (QFileInfo(path).isDir()) {
+            directories.append(path);
+        } else if (FolderScanner::isSupported(path)) {
+            files.append(path);
+        }
+    }
+
+    event->acceptProposedAction();
+    if (not files.isEmpty()) {
+        addTracks(files);
+    }
+
+    if (not directories.isEmpty()) {
+        setStatusText(tr("Looking for songs in %1...").arg(directories.join(", ")));
+        m_scanner->scan(directories);
     }
 }
 
 void MainWindow::onClosePlaylistButtonClicked()
 {
-    if (m_filenames.isEmpty()) {
+    /* Songs still being found would fill the list again */
+    m_scanner->cancel();
+    m_importer->cancel();
+    if (m_tracks.isEmpty()) {
         return;
     }
 
     stopMusic();
 
-    m_filenames.clear();
-    m_splittedSongs.clear();
     m_musicCount = 0;
     m_musicPlaying.clear();
+    m_resumePath.clear();
     ui->playingEdit->setText("");
     resetControllers();
 
-    int rowCount = ui->listWidget->model()->rowCount();
-    for (int i {}; i < rowCount; ++i) {
-        ui->listWidget->model()->removeRow(0);
-    }
+    cancelProbing();
+    m_trackModel->clear();
 }
 
 void MainWindow::onPlayPauseButtonClicked()
 {
     static bool isTheFirstTime {true};
-    if (m_filenames.isEmpty() or not IsMusicReady(m_music)) {
+    /* The last session's song, it carries on where it was left */
+    auto resumePosition = m_resumePath.isEmpty() ? 0.0f : m_resumePosition;
+    if (not m_resumePath.isEmpty()) {
+        setMusic(m_musicCount);
+    }
+
+    if (m_tracks.isEmpty() or m_musicPlaying.isEmpty()) {
         QMessageBox::warning(this, tr("Warning"), tr("No song has been loaded."));
         return;
     }
 
     if (isTheFirstTime or m_firstTime) {
         playMusic();
+        if (resumePosition > 0.0f) {
+            m_engine->seek(resumePosition);
+        }
         isTheFirstTime = false;
         m_firstTime = false;
         return;
     }
 
-    auto *button = qobject_cast<QPushButton *>(sender());
-    if (button->text() == tr("Play")) {
-        ResumeMusicStream(m_music);
-        button->setText(tr("Pause"));
-        m_musicTimer.start();
-        m_sliderTimer.start();
+    /* The button follows the engine's state once it gets there */
+    if (m_engine->state() == PlaybackEngine::State::Paused) {
+        m_engine->resume();
     } else {
-        PauseMusicStream(m_music);
-        button->setText(tr("Play"));
-        m_musicTimer.stop();
-        m_sliderTimer.stop();
+        m_engine->pause();
     }
 }
 
 void MainWindow::onStopButtonClicked()
 {
-    if (GetMusicTimePlayed(m_music) > 0.0f)
+    if (not m_resumePath.isEmpty()) {
+        m_resumePosition = 0.0f;
+        m_presenter->showPosition(0.0f);
+        return;
+    }
+
+    if (m_engine->timePlayed() > 0.0f)
         stopMusic(false, false);
 }
 
 void MainWindow::onPreviousButtonClicked()
 {
-    if (m_filenames.isEmpty()) {
+    if (m_tracks.isEmpty()) {
         QMessageBox::warning(this, tr("Warning"), tr("No song has been loaded."));
         return;
     }
@@ -461,19 +1086,19 @@ void MainWindow::onPreviousButtonClicked()
     setMusic(--m_musicCount);
     playMusic();
     setMusicNameToEdit();
-    ui->listWidget->setCurrentRow(m_filenames.indexOf(m_musicPlaying));
+    setCurrentRow(m_musicCount);
 }
 
 void MainWindow::onNextButtonClicked()
 {
-    if (m_filenames.isEmpty()) {
+    if (m_tracks.isEmpty()) {
         QMessageBox::warning(this, tr("Warning"), tr("No file has been loaded."));
         return;
     }
 
     stopMusic(false, false);
 
-    if ((m_musicCount + 1) >= m_filenames.count()) {
+    if ((m_musicCount + 1) >= static_cast<unsigned int>(m_tracks.count())) {
         QMessageBox::warning(this, tr("No Music to Play"), tr("There's no next music to play."));
         return;
     }
@@ -481,17 +1106,18 @@ void MainWindow::onNextButtonClicked()
     setMusic(++m_musicCount);
     playMusic();
     setMusicNameToEdit();
-    ui->listWidget->setCurrentRow(m_filenames.indexOf(m_musicPlaying));
+    setCurrentRow(m_musicCount);
 }
 
 void MainWindow::onRepeatCheckBoxClicked(bool checked)
 {
-    if (m_filenames.isEmpty()) {
+    if (m_tracks.isEmpty()) {
         if (checked) {
             ui->repeatCheckBox->setChecked(false);
         }
     } else {
-        m_music.looping = checked;
+        m_engine->setLooping(checked);
+        m_sessionTimer.start();
         if (checked) {
             ui->repeatCheckBox->setToolTip(tr("Current music repeats."));
         } else {
@@ -500,43 +1126,33 @@ void MainWindow::onRepeatCheckBoxClicked(bool checked)
     }
 }
 
-void MainWindow::onMusicTimeout()
+void MainWindow::onTrackFinished()
 {
-    UpdateMusicStream(m_music);
-    auto timePlayed = static_cast<int>(GetMusicTimePlayed(m_music));
-    setTimePlayedText(timePlayed);
-
-    if (not IsMusicStreamPlaying(m_music)) {
-        stopMusic(false, false);
+    resetControllers(false, false);
+    m_firstTime = true;
 
-        if (m_musicCount + 1 < m_filenames.count()) {
-            qDebug() << "Playing next song:" << m_filenames[m_musicCount + 1];
-            setMusic(++m_musicCount);
-            setMusicNameToEdit();
-            playMusic();
-        }
-    } else if (static_cast<int>(GetMusicTimePlayed(m_music)) == static_cast<int>(m_streamLength)) {
-        resetControllers(false, false);
-    } else {
-        ui->playPauseButton->setText(tr("Pause"));
+    if (m_musicCount + 1 < static_cast<unsigned int>(m_tracks.count())) {
+        qDebug() << "Playing next song:" << m_tracks.path(m_musicCount + 1);
+        setMusic(++m_musicCount);
+        setMusicNameToEdit();
+        playMusic();
     }
 }
 
-void MainWindow::onSliderTimeout()
-{
-    ui->playedTimeSlider->setValue(ui->playedTimeSlider->value() + 1);
-}
-
 void MainWindow::onSliderReleased()
 {
-    if (m_filenames.isEmpty()) {
+    if (m_tracks.isEmpty()) {
         return;
     }
 
     int value = ui->playedTimeSlider->value();
 
-    setTimePlayedText(value);
-    SeekMusicStream(m_music, static_cast<float>(value));
+    m_presenter->showPosition(static_cast<float>(value));
+    if (not m_resumePath.isEmpty()) {
+        m_resumePosition = static_cast<float>(value);
+        return;
+    }
+    m_engine->seek(static_cast<float>(value));
 }
 
 void MainWindow::onStatusTimeout()
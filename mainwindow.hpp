@@ -1,14 +1,22 @@
 #ifndef MAINWINDOW_HPP
 #define MAINWINDOW_HPP
 
-#include <map>
 #include <QColor>
 #include <QMainWindow>
 #include <QTimer>
 
-#include <raylib.h>
-
+#include "folderscanner.hpp"
+#include "librarywatcher.hpp"
+#include "loudnessanalyzer.hpp"
+#include "metadataprober.hpp"
+#include "playbackengine.hpp"
+#include "playbackpresenter.hpp"
+#include "playeroptions.hpp"
 #include "playlist.hpp"
+#include "playlistimporter.hpp"
+#include "sessionstore.hpp"
+#include "trackfiltermodel.hpp"
+#include "tracklistmodel.hpp"
 
 QT_BEGIN_NAMESPACE
 namespace Ui {
@@ -20,51 +28,94 @@ class MainWindow : public QMainWindow
 {
     Q_OBJECT
     Ui::MainWindow *ui;
-    QTimer m_musicTimer;
-    QTimer m_sliderTimer;
     QTimer m_statusTimer;
-    Music m_music;
-    QStringList m_filenames;
-    std::map<QString, QString> m_splittedSongs;
+    PlaybackEngine *m_engine;
+    TrackTable m_tracks;
     QString m_musicPlaying;
-    /* Hack to set the last music that were playing when the user opens more songs */
-    QString m_lastMusicPlaying;
-    float m_lastTimePlayed;
     unsigned int m_musicCount;
     bool m_firstTime;
-    float m_streamLength;
     Playlist *m_playlist;
+    TrackListModel *m_trackModel;
+    /* What the list view shows, rows given to the rest of the window are the track model's */
+    TrackFilterModel *m_filterModel;
+    PlaybackPresenter *m_presenter;
+    MetadataProber *m_prober;
+    LoudnessAnalyzer *m_analyzer;
+    QAction *m_analyzeAction;
+    FolderScanner *m_scanner;
+    LibraryWatcher *m_watcher;
+    PlaylistImporter *m_importer;
+    /* The watched directories are worked out once a burst of changes to the queue is over */
+    QTimer m_watchTimer;
+    /* Ids grow until the queue is cleared, everything from here on hasn't been probed yet */
+    TrackId m_nextProbeId;
+    QString m_tracePath;
+    QString m_sessionPath;
+    /* The session is written once changes stop coming, and when the window goes away */
+    QTimer m_sessionTimer;
+    /* The last session's song is only loaded when it's played, from where it was left */
+    QString m_resumePath;
+    float m_resumePosition;
 
     void resetControllers(bool resetLength = true, bool resetPlayingEdit = true);
     void setStatusText(QString text, QColor color = Qt::white);
     void setMusic(unsigned int number);
+    void addTracks(const QStringList &paths);
+    void followPlayingSong();
+    void updateNeighbours();
+    void sendSeekIndex(const QString &path);
+    void sendReplayGain(int row);
     void playMusic();
     void stopMusic(bool resetLength = true, bool resetPlayingEdit = true);
-    int setTimePlayedText(int value);
-    void splitSongs();
-    void putSongsTogether();
-    void setMusicNamesToListWidget();
     void setMusicNameToEdit();
+    void setCurrentRow(int row);
     QString getCurrentSongName();
+    void probeNewTracks();
+    void cancelProbing();
+    void updatePlaylistLabel();
+    void updateStatusToolTip();
+    void saveTrace();
+    void analyzeLoudness();
+    void updateWatchedDirectories();
+    void restoreSession();
+    void saveSession();
 public:
-    MainWindow(QWidget *parent = nullptr);
+    MainWindow(const PlayerOptions &options = {}, QWidget *parent = nullptr);
     ~MainWindow();
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
+    void dragEnterEvent(QDragEnterEvent *event) override;
+    void dropEvent(QDropEvent *event) override;
 private slots:
-    void onListWidgetClicked(const QModelIndex &index);
-    void onListWidgetActionClicked([[maybe_unused]] bool triggered);
+    void onListViewClicked(const QModelIndex &index);
+    void onListViewActionClicked([[maybe_unused]] bool triggered);
+    void onSearchTextChanged(const QString &text);
     void onOpenPlaylistButtonClicked();
     void onRemovePlaylistsButtonClicked();
     void onSavePlaylistButtonClicked();
+    void onImportPlaylistButtonClicked();
+    void onExportPlaylistButtonClicked();
+    void onPlaylistEntriesFound(const QVector<PlaylistFile::Entry> &entries);
+    void onPlaylistImportFailed(const QString &path, const QString &error);
+    void onPlaylistImported(int total, bool cancelled);
     void onReturnAtEditPressed();
     void onOpenFileButtonClicked();
+    void onAddFolderButtonClicked();
+    void onFolderScanFinished(int total, bool cancelled);
+    void onLibraryChanged(const LibraryWatcher::Changes &changes);
     void onClosePlaylistButtonClicked();
     void onPlayPauseButtonClicked();
     void onStopButtonClicked();
     void onPreviousButtonClicked();
     void onNextButtonClicked();
     void onRepeatCheckBoxClicked(bool checked);
-    void onMusicTimeout();
-    void onSliderTimeout();
+    void onMusicLoaded(QString path, float length);
+    void onMusicAdvanced(QString path);
+    void onMusicLoadFailed(QString path);
+    void onTrackFinished();
+    void onTracksProbed(const QVector<ProbeResult> &results);
+    void onLoudnessProgress(int done, int total);
+    void onLoudnessAnalyzed(int analyzed, bool cancelled);
     void onSliderReleased();
     void onStatusTimeout();
 };
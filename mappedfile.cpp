@@ -0,0 +1,63 @@
+#include <QDebug>
+
+#include "mappedfile.hpp"
+
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#endif
+
+MappedFile::MappedFile(const QString &path)
+    : m_file(path)
+    , m_data(nullptr)
+    , m_size(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_data != nullptr) {
+        m_file.unmap(const_cast<uchar *>(m_data));
+    }
+}
+
+bool MappedFile::map(qint64 maxSize)
+{
+    if (not m_file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    /* Too big for the address space we're willing to spend, let the decoder read it instead */
+    auto size = m_file.size();
+    if (size <= 0 or size > maxSize) {
+        m_file.close();
+        return false;
+    }
+
+    m_data = m_file.map(0, size);
+    if (m_data == nullptr) {
+        qDebug() << "Couldn't map" << m_file.fileName() << ":" << m_file.errorString();
+        m_file.close();
+        return false;
+    }
+
+    m_size = size;
+#ifdef Q_OS_UNIX
+    madvise(const_cast<uchar *>(m_data), static_cast<size_t>(m_size), MADV_SEQUENTIAL);
+#endif
+    return true;
+}
+
+bool MappedFile::isMapped() const
+{
+    return m_data != nullptr;
+}
+
+const uchar *MappedFile::data() const
+{
+    return m_data;
+}
+
+qint64 MappedFile::size() const
+{
+    return m_size;
+}
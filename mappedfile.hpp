@@ -0,0 +1,28 @@
+#ifndef MAPPEDFILE_HPP
+#define MAPPEDFILE_HPP
+
+#include <QFile>
+#include <QString>
+
+/* A whole file mapped read-only into memory, for decoders that can read from a buffer.
+ * The kernel is told we read it front to back, so it reads ahead aggressively and
+ * drops pages behind us, and there's no copy from the page cache into a stdio buffer.
+ */
+class MappedFile
+{
+    QFile m_file;
+    const uchar *m_data;
+    qint64 m_size;
+public:
+    explicit MappedFile(const QString &path);
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool map(qint64 maxSize);
+    bool isMapped() const;
+    const uchar *data() const;
+    qint64 size() const;
+};
+
+#endif // MAPPEDFILE_HPP
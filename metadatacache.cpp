@@ -0,0 +1,450 @@
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <vector>
+
+#include "binaryio.hpp"
+#include "metadatacache.hpp"
+
+static constexpr char MAGIC[4] {'B', 'M', 'M', 'C'};
+/* magic, version, entry count, reserved, string table offset, string table size */
+static constexpr qint64 HEADER_SIZE {4 + 4 + 4 + 4 + 8 + 8};
+/* path hash, file size, modification time, path, title, artist, album (offset and length each),
+ * duration, sample rate, channels, codec, ReplayGain flags, reserved, seek index (offset and length),
+ * track gain, track peak, album gain, album peak
+ */
+static constexpr qint64 ENTRY_SIZE {8 + 8 + 8 + 4 * 8 + 4 + 4 + 1 + 1 + 1 + 1 + 4 + 8 + 4 * 4};
+static constexpr quint8 HAS_TRACK_GAIN {0x01};
+static constexpr quint8 HAS_ALBUM_GAIN {0x02};
+
+static float readFloat(const uchar *data)
+{
+    auto bits = readValue<quint32>(data);
+    float value {};
+    std::memcpy(&value, &bits, sizeof(float));
+    return value;
+}
+
+static void appendFloat(QByteArray &bytes, float value)
+{
+    quint32 bits {};
+    std::memcpy(&bits, &value, sizeof(float));
+    appendValue<quint32>(bytes, bits);
+}
+
+/* FNV-1a, qHash() isn't guaranteed to be the same between Qt versions */
+static quint64 hashPath(const QString &path)
+{
+    quint64 hash {14'695'981'039'346'656'037ull};
+    for (auto character : path) {
+        hash ^= character.unicode();
+        hash *= 1'099'511'628'211ull;
+    }
+
+    return hash;
+}
+
+MetadataCache::MetadataCache(QString path)
+    : m_path(std::move(path))
+    , m_data(nullptr)
+    , m_size(0)
+    , m_count(0)
+    , m_stringsOffset(0)
+    , m_stringsSize(0)
+{
+}
+
+MetadataCache::~MetadataCache()
+{
+    unmap();
+}
+
+bool MetadataCache::open()
+{
+    return map();
+}
+
+bool MetadataCache::map()
+{
+    unmap();
+
+    /* Nothing has been probed yet */
+    if (not QFile::exists(m_path)) {
+        return true;
+    }
+
+    m_file.setFileName(m_path);
+    if (not m_file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Couldn't open" << m_path << ":" << m_file.errorString();
+        return false;
+    }
+
+    m_size = m_file.size();
+    if (m_size < HEADER_SIZE) {
+        unmap();
+        return false;
+    }
+
+    m_data = m_file.map(0, m_size);
+    if (m_data == nullptr) {
+        qWarning() << "Couldn't map" << m_path << ":" << m_file.errorString();
+        unmap();
+        return false;
+    }
+
+    auto version = readValue<quint32>(m_data + 4);
+    auto count = readValue<quint32>(m_data + 8);
+    auto stringsOffset = readValue<quint64>(m_data + 16);
+    auto stringsSize = readValue<quint64>(m_data + 24);
+
+    /* It's only a cache, whatever is wrong with it gets fixed by probing again */
+    bool valid = std::memcmp(m_data, MAGIC, sizeof(MAGIC)) == 0
+                 and version == VERSION
+                 and HEADER_SIZE + static_cast<qint64>(count) * ENTRY_SIZE <= m_size
+                 and stringsOffset <= static_cast<quint64>(m_size)
+                 and stringsSize <= static_cast<quint64>(m_size) - stringsOffset;
+    if (not valid) {
+        qDebug() << "Ignoring metadata cache" << m_path;
+        unmap();
+        return false;
+    }
+
+    m_count = count;
+    m_stringsOffset = stringsOffset;
+    m_stringsSize = stringsSize;
+    return true;
+}
+
+void MetadataCache::unmap()
+{
+    if (m_data != nullptr) {
+        m_file.unmap(const_cast<uchar *>(m_data));
+    }
+
+    m_file.close();
+    m_data = nullptr;
+    m_size = 0;
+    m_count = 0;
+    m_stringsOffset = 0;
+    m_stringsSize = 0;
+}
+
+QString MetadataCache::string(quint32 offset, quint32 length) const
+{
+    if (static_cast<quint64>(offset) + length > m_stringsSize) {
+        return {};
+    }
+
+    return QString::fromUtf8(reinterpret_cast<const char *>(m_data + m_stringsOffset + offset), length);
+}
+
+const uchar *MetadataCache::entryAt(quint32 index) const
+{
+    return m_data + HEADER_SIZE + static_cast<qint64>(index) * ENTRY_SIZE;
+}
+
+MetadataCache::Record MetadataCache::recordAt(const uchar *entry) const
+{
+    Record record;
+    record.size = readValue<qint64>(entry + 8);
+    record.modified = readValue<qint64>(entry + 16);
+    record.path = string(readValue<quint32>(entry + 24), readValue<quint32>(entry + 28));
+    record.info.title = string(readValue<quint32>(entry + 32), readValue<quint32>(entry + 36));
+    record.info.artist = string(readValue<quint32>(entry + 40), readValue<quint32>(entry + 44));
+    record.info.album = string(readValue<quint32>(entry + 48), readValue<quint32>(entry + 52));
+
+    record.info.duration = readFloat(entry + 56);
+    record.info.sampleRate = readValue<quint32>(entry + 60);
+    record.info.channels = entry[64];
+    record.info.codec = static_cast<Codec>(entry[65]);
+
+    auto &replayGain = record.info.replayGain;
+    replayGain.hasTrack = entry[66] & HAS_TRACK_GAIN;
+    replayGain.hasAlbum = entry[66] & HAS_ALBUM_GAIN;
+    replayGain.trackGain = readFloat(entry + 80);
+    replayGain.trackPeak = readFloat(entry + 84);
+    replayGain.albumGain = readFloat(entry + 88);
+    replayGain.albumPeak = readFloat(entry + 92);
+    record.info.probed = true;
+    return record;
+}
+
+QByteArray MetadataCache::seekIndexAt(const uchar *entry) const
+{
+    auto offset = readValue<quint32>(entry + 72);
+    auto length = readValue<quint32>(entry + 76);
+    if (length == 0 or static_cast<quint64>(offset) + length > m_stringsSize) {
+        return {};
+    }
+
+    return QByteArray(reinterpret_cast<const char *>(m_data + m_stringsOffset + offset), static_cast<int>(length));
+}
+
+const uchar *MetadataCache::locate(const QString &path) const
+{
+    if (m_count == 0) {
+        return nullptr;
+    }
+
+    auto hash = hashPath(path);
+    quint32 low {};
+    quint32 high {m_count};
+    while (low < high) {
+        auto middle = low + (high - low) / 2;
+        if (readValue<quint64>(entryAt(middle)) < hash) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    auto utf8 = path.toUtf8();
+    for (auto index = low; index < m_count and readValue<quint64>(entryAt(index)) == hash; ++index) {
+        const auto *entry = entryAt(index);
+        auto pathOffset = readValue<quint32>(entry + 24);
+        auto pathLength = readValue<quint32>(entry + 28);
+        if (pathLength == static_cast<quint32>(utf8.size())
+            and static_cast<quint64>(pathOffset) + pathLength <= m_stringsSize
+            and std::memcmp(m_data + m_stringsOffset + pathOffset, utf8.constData(), pathLength) == 0) {
+            return entry;
+        }
+    }
+
+    return nullptr;
+}
+
+bool MetadataCache::find(const QString &path, qint64 size, qint64 modified, TrackInfo &info) const
+{
+    {
+        /* What changed since the last save isn't in the mapping yet */
+        std::lock_guard<std::mutex> lock(m_freshMutex);
+        if (m_removed.contains(path)) {
+            return false;
+        }
+
+        auto fresh = m_fresh.constFind(path);
+        if (fresh != m_fresh.constEnd() and fresh->size == size and fresh->modified == modified) {
+            info = fresh->info;
+            return true;
+        }
+    }
+
+    const auto *entry = locate(path);
+
+    /* Same file, but it changed since it was probed */
+    if (entry == nullptr or readValue<qint64>(entry + 8) != size or readValue<qint64>(entry + 16) != modified) {
+        return false;
+    }
+
+    info = recordAt(entry).info;
+    return true;
+}
+
+bool MetadataCache::findSeekIndex(const QString &path, qint64 size, qint64 modified, QByteArray &seekIndex) const
+{
+    {
+        std::lock_guard<std::mutex> lock(m_freshMutex);
+        if (m_removed.contains(path)) {
+            return false;
+        }
+
+        for (const auto *records : {&m_freshSeekIndexes, &m_fresh}) {
+            auto fresh = records->constFind(path);
+            if (fresh != records->constEnd() and fresh->size == size and fresh->modified == modified
+                and not fresh->seekIndex.isEmpty()) {
+                seekIndex = fresh->seekIndex;
+                return true;
+            }
+        }
+    }
+
+    const auto *entry = locate(path);
+    if (entry == nullptr or readValue<qint64>(entry + 8) != size or readValue<qint64>(entry + 16) != modified) {
+        return false;
+    }
+
+    seekIndex = seekIndexAt(entry);
+    return not seekIndex.isEmpty();
+}
+
+void MetadataCache::insert(Record record)
+{
+    auto path = record.path;
+    std::lock_guard<std::mutex> lock(m_freshMutex);
+    m_fresh.insert(path, std::move(record));
+}
+
+void MetadataCache::insertSeekIndex(const QString &path, qint64 size, qint64 modified, QByteArray seekIndex)
+{
+    std::lock_guard<std::mutex> lock(m_freshMutex);
+    m_freshSeekIndexes.insert(path, {path, size, modified, {}, std::move(seekIndex)});
+}
+
+void MetadataCache::rename(const QString &from, const QString &to)
+{
+    std::lock_guard<std::mutex> lock(m_freshMutex);
+    Record record;
+    auto fresh = m_fresh.constFind(from);
+    if (fresh != m_fresh.constEnd()) {
+        record = fresh.value();
+    } else if (const auto *entry = locate(from)) {
+        record = recordAt(entry);
+        record.seekIndex = seekIndexAt(entry);
+    } else {
+        return;
+    }
+
+    auto freshSeekIndex = m_freshSeekIndexes.take(from);
+    m_fresh.remove(from);
+    m_removed.insert(from);
+
+    /* Renaming keeps the size and the modification time, so the entry is still good */
+    record.path = to;
+    m_removed.remove(to);
+    m_fresh.insert(to, std::move(record));
+    if (not freshSeekIndex.seekIndex.isEmpty()) {
+        freshSeekIndex.path = to;
+        m_freshSeekIndexes.insert(to, std::move(freshSeekIndex));
+    }
+}
+
+void MetadataCache::remove(const QString &path)
+{
+    std::lock_guard<std::mutex> lock(m_freshMutex);
+    m_fresh.remove(path);
+    m_freshSeekIndexes.remove(path);
+    m_removed.insert(path);
+}
+
+bool MetadataCache::save()
+{
+    std::lock_guard<std::mutex> lock(m_freshMutex);
+    if (m_fresh.isEmpty() and m_freshSeekIndexes.isEmpty() and m_removed.isEmpty()) {
+        return true;
+    }
+
+    /* Keep what's still there, replacing what was probed again */
+    std::vector<Record> records;
+    records.reserve(m_count + m_fresh.size());
+    for (quint32 i {}; i < m_count; ++i) {
+        const auto *entry = entryAt(i);
+        auto record = recordAt(entry);
+        if (m_removed.contains(record.path)) {
+            continue;
+        }
+        record.seekIndex = seekIndexAt(entry);
+
+        auto fresh = m_fresh.find(record.path);
+        if (fresh == m_fresh.end()) {
+            records.push_back(std::move(record));
+        } else if (fresh->size == record.size and fresh->modified == record.modified and fresh->seekIndex.isEmpty()) {
+            /* Probed again, but the file is the same and so is its index */
+            fresh->seekIndex = std::move(record.seekIndex);
+        }
+    }
+
+    for (auto &record : m_fresh) {
+        records.push_back(std::move(record));
+    }
+    m_fresh.clear();
+
+    /* Only attached to files whose metadata is known, and only while they're the same file */
+    for (auto &record : records) {
+        auto fresh = m_freshSeekIndexes.constFind(record.path);
+        if (fresh != m_freshSeekIndexes.constEnd() and fresh->size == record.size and fresh->modified == record.modified) {
+            record.seekIndex = fresh->seekIndex;
+        }
+    }
+    m_freshSeekIndexes.clear();
+    m_removed.clear();
+
+    std::vector<std::pair<quint64, const Record *>> sorted;
+    sorted.reserve(records.size());
+    for (const auto &record : records) {
+        sorted.emplace_back(hashPath(record.path), &record);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const auto &left, const auto &right) {
+        return left.first < right.first;
+    });
+
+    QByteArray strings;
+    QHash<QString, std::pair<quint32, quint32>> stringRefs;
+    auto intern = [&strings, &stringRefs](const QString &text) {
+        auto it = stringRefs.constFind(text);
+        if (it != stringRefs.constEnd()) {
+            return it.value();
+        }
+
+        auto utf8 = text.toUtf8();
+        std::pair<quint32, quint32> ref {static_cast<quint32>(strings.size()), static_cast<quint32>(utf8.size())};
+        strings.append(utf8);
+        stringRefs.insert(text, ref);
+        return ref;
+    };
+
+    QByteArray entries;
+    entries.reserve(static_cast<int>(sorted.size() * ENTRY_SIZE));
+    for (const auto &[hash, record] : sorted) {
+        appendValue<quint64>(entries, hash);
+        appendValue<qint64>(entries, record->size);
+        appendValue<qint64>(entries, record->modified);
+        for (const auto *text : {&record->path, &record->info.title, &record->info.artist, &record->info.album}) {
+            auto ref = intern(*text);
+            appendValue<quint32>(entries, ref.first);
+            appendValue<quint32>(entries, ref.second);
+        }
+
+        const auto &replayGain = record->info.replayGain;
+        appendFloat(entries, record->info.duration);
+        appendValue<quint32>(entries, record->info.sampleRate);
+        appendValue<quint8>(entries, record->info.channels);
+        appendValue<quint8>(entries, static_cast<quint8>(record->info.codec));
+        appendValue<quint8>(entries, (replayGain.hasTrack ? HAS_TRACK_GAIN : 0) | (replayGain.hasAlbum ? HAS_ALBUM_GAIN : 0));
+        appendValue<quint8>(entries, 0);
+        appendValue<quint32>(entries, 0);
+
+        /* Binary, never shared with another entry */
+        appendValue<quint32>(entries, static_cast<quint32>(strings.size()));
+        appendValue<quint32>(entries, static_cast<quint32>(record->seekIndex.size()));
+        strings.append(record->seekIndex);
+
+        appendFloat(entries, replayGain.trackGain);
+        appendFloat(entries, replayGain.trackPeak);
+        appendFloat(entries, replayGain.albumGain);
+        appendFloat(entries, replayGain.albumPeak);
+    }
+
+    QByteArray header;
+    header.append(MAGIC, sizeof(MAGIC));
+    appendValue<quint32>(header, VERSION);
+    appendValue<quint32>(header, static_cast<quint32>(sorted.size()));
+    appendValue<quint32>(header, 0);
+    appendValue<quint64>(header, static_cast<quint64>(HEADER_SIZE + entries.size()));
+    appendValue<quint64>(header, static_cast<quint64>(strings.size()));
+
+    /* The old file can't be replaced while it's mapped on some platforms */
+    unmap();
+
+    QDir().mkpath(QFileInfo(m_path).absolutePath());
+    QSaveFile file(m_path);
+    if (not file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Couldn't save metadata cache to" << m_path << ":" << file.errorString();
+        map();
+        return false;
+    }
+
+    file.write(header);
+    file.write(entries);
+    file.write(strings);
+    if (not file.commit()) {
+        qWarning() << "Couldn't save metadata cache to" << m_path << ":" << file.errorString();
+        map();
+        return false;
+    }
+
+    return map();
+}
@@ -0,0 +1,73 @@
+#ifndef METADATACACHE_HPP
+#define METADATACACHE_HPP
+
+#include <mutex>
+#include <QFile>
+#include <QHash>
+#include <QSet>
+#include <QString>
+
+#include "trackinfo.hpp"
+
+/* Probed metadata from previous runs in a memory-mapped binary file:
+ *
+ *   header | entries (sorted by path hash) | string table
+ *
+ * An entry is only used while the file keeps the size and modification time it had when it was probed,
+ * so edited files are probed again and everything else never has to be read.
+ * Looking up doesn't load the file, it's a binary search over the mapped entries.
+ * MP3s that were played also keep their seek index there, so it's built only once.
+ * Renamed files take their entry along, deleted files lose it, both when it's next saved.
+ * Until then lookups see those changes and anything probed since from the in-memory maps first.
+ *
+ * find() may be called from any thread, the maps it shares with the owner's thread are locked.
+ * Everything else belongs to the owner's thread, and save() must not run while somebody else
+ * is still looking up since it remaps the file.
+ */
+class MetadataCache
+{
+public:
+    struct Record
+    {
+        QString path;
+        qint64 size;
+        qint64 modified;
+        TrackInfo info;
+        QByteArray seekIndex {};
+    };
+private:
+    QString m_path;
+    QFile m_file;
+    const uchar *m_data;
+    qint64 m_size;
+    quint32 m_count;
+    quint64 m_stringsOffset;
+    quint64 m_stringsSize;
+    QHash<QString, Record> m_fresh;
+    QHash<QString, Record> m_freshSeekIndexes;
+    QSet<QString> m_removed;
+    mutable std::mutex m_freshMutex;
+
+    bool map();
+    void unmap();
+    QString string(quint32 offset, quint32 length) const;
+    const uchar *entryAt(quint32 index) const;
+    const uchar *locate(const QString &path) const;
+    Record recordAt(const uchar *entry) const;
+    QByteArray seekIndexAt(const uchar *entry) const;
+public:
+    static constexpr quint32 VERSION {3};
+
+    explicit MetadataCache(QString path);
+    ~MetadataCache();
+    bool open();
+    bool find(const QString &path, qint64 size, qint64 modified, TrackInfo &info) const;
+    bool findSeekIndex(const QString &path, qint64 size, qint64 modified, QByteArray &seekIndex) const;
+    void insert(Record record);
+    void insertSeekIndex(const QString &path, qint64 size, qint64 modified, QByteArray seekIndex);
+    void rename(const QString &from, const QString &to);
+    void remove(const QString &path);
+    bool save();
+};
+
+#endif // METADATACACHE_HPP
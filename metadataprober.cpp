@@ -0,0 +1,592 @@
+#include <algorithm>
+#include <QFile>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QThread>
+#include <QtEndian>
+
+#include "metadataprober.hpp"
+#include "mp3frame.hpp"
+#include "tracer.hpp"
+
+/* Files per pool task, results of a task are handed over at once */
+static constexpr int BATCH_SIZE {128};
+/* Enough for the headers of every supported format */
+static constexpr qint64 HEAD_BYTES {4 * 1'024};
+static constexpr qint64 TAIL_BYTES {64 * 1'024};
+/* Text tags come first, anything beyond this is cover art */
+static constexpr qint64 TAG_BYTES {64 * 1'024};
+/* Write new results to disk once the pool has been idle this long */
+static constexpr int CACHE_SAVE_DELAY {2'000};
+
+static const uchar *bytes(const QByteArray &data)
+{
+    return reinterpret_cast<const uchar *>(data.constData());
+}
+
+/* ID3v2 sizes are stored 7 bits per byte so they never look like a frame sync */
+static quint32 syncsafe(quint32 value)
+{
+    return (value >> 24 & 0x7f) << 21 | (value >> 16 & 0x7f) << 14 | (value >> 8 & 0x7f) << 7 | (value & 0x7f);
+}
+
+static qint64 id3v2Size(const QByteArray &head)
+{
+    if (head.size() < 10 or not head.startsWith("ID3")) {
+        return 0;
+    }
+
+    const auto *data = bytes(head);
+    qint64 size = syncsafe(qFromBigEndian<quint32>(data + 6));
+    bool hasFooter = data[5] & 0x10;
+    return 10 + size + (hasFooter ? 10 : 0);
+}
+
+/* Every value of a text frame, several values are separated by nulls */
+static QString id3Values(const uchar *data, qint64 size)
+{
+    if (size < 1) {
+        return {};
+    }
+
+    auto encoding = data[0];
+    ++data;
+    --size;
+
+    QString text;
+    if (encoding == 0) {
+        text = QString::fromLatin1(reinterpret_cast<const char *>(data), static_cast<int>(size));
+    } else if (encoding == 3) {
+        text = QString::fromUtf8(reinterpret_cast<const char *>(data), static_cast<int>(size));
+    } else {
+        /* UTF-16 with a byte order mark, or big-endian without one */
+        bool littleEndian {false};
+        bool hasByteOrderMark = size >= 2 and ((data[0] == 0xff and data[1] == 0xfe) or (data[0] == 0xfe and data[1] == 0xff));
+        if (encoding == 1 and hasByteOrderMark) {
+            littleEndian = data[0] == 0xff;
+            data += 2;
+            size -= 2;
+        }
+
+        text.reserve(static_cast<int>(size / 2));
+        for (qint64 i {}; i + 1 < size; i += 2) {
+            text.append(QChar(littleEndian ? qFromLittleEndian<quint16>(data + i) : qFromBigEndian<quint16>(data + i)));
+        }
+    }
+
+    /* Later UTF-16 values start with their own byte order mark */
+    return text.remove(QChar(0xfeff));
+}
+
+static QString id3Text(const uchar *data, qint64 size)
+{
+    /* Frames may be null terminated, and hold several values separated by nulls */
+    auto text = id3Values(data, size);
+    auto end = text.indexOf(QChar(0));
+    return end < 0 ? text : text.left(end);
+}
+
+/* REPLAYGAIN_* comments and TXXX frames, gains look like "-6.54 dB" */
+static void readReplayGain(QStringView key, QStringView value, ReplayGain &replayGain)
+{
+    auto number = value.trimmed();
+    if (number.endsWith(QLatin1String("dB"), Qt::CaseInsensitive)) {
+        number.chop(2);
+    }
+
+    bool ok {};
+    auto parsed = number.trimmed().toString().toFloat(&ok);
+    if (not ok) {
+        return;
+    }
+
+    if (key.compare(QLatin1String("REPLAYGAIN_TRACK_GAIN"), Qt::CaseInsensitive) == 0) {
+        replayGain.trackGain = parsed;
+        replayGain.hasTrack = true;
+    } else if (key.compare(QLatin1String("REPLAYGAIN_TRACK_PEAK"), Qt::CaseInsensitive) == 0) {
+        replayGain.trackPeak = parsed;
+    } else if (key.compare(QLatin1String("REPLAYGAIN_ALBUM_GAIN"), Qt::CaseInsensitive) == 0) {
+        replayGain.albumGain = parsed;
+        replayGain.hasAlbum = true;
+    } else if (key.compare(QLatin1String("REPLAYGAIN_ALBUM_PEAK"), Qt::CaseInsensitive) == 0) {
+        replayGain.albumPeak = parsed;
+    }
+}
+
+static void readId3v2Tags(QFile &file, TrackInfo &info)
+{
+    if (not file.seek(0)) {
+        return;
+    }
+
+    auto tag = file.read(TAG_BYTES);
+    auto tagSize = std::min<qint64>(id3v2Size(tag), tag.size());
+    if (tagSize < 10) {
+        return;
+    }
+
+    const auto *data = bytes(tag);
+    auto version = data[3];
+    if (version != 3 and version != 4) {
+        return;
+    }
+
+    qint64 position {10};
+    /* Skip the extended header */
+    if (data[5] & 0x40 and position + 4 <= tagSize) {
+        auto size = qFromBigEndian<quint32>(data + position);
+        position += version == 4 ? syncsafe(size) : size + 4;
+    }
+
+    while (position + 10 <= tagSize and data[position] != 0) {
+        auto id = tag.mid(position, 4);
+        auto size = qFromBigEndian<quint32>(data + position + 4);
+        if (version == 4) {
+            size = syncsafe(size);
+        }
+
+        position += 10;
+        if (position + size > tagSize) {
+            break;
+        }
+
+        if (id == "TIT2") {
+            info.title = id3Text(data + position, size);
+        } else if (id == "TPE1") {
+            info.artist = id3Text(data + position, size);
+        } else if (id == "TALB") {
+            info.album = id3Text(data + position, size);
+        } else if (id == "TXXX") {
+            /* A description, then the value */
+            auto values = id3Values(data + position, size);
+            auto separator = values.indexOf(QChar(0));
+            if (separator > 0) {
+                auto value = QStringView(values).mid(separator + 1);
+                auto end = value.indexOf(QChar(0));
+                readReplayGain(QStringView(values).left(separator), end < 0 ? value : value.left(end), info.replayGain);
+            }
+        }
+        position += size;
+    }
+}
+
+static void readVorbisComments(const uchar *data, qint64 size, TrackInfo &info)
+{
+    /* vendor string, comment count, then "KEY=value" comments, lengths are 32 bits little-endian */
+    if (size < 8) {
+        return;
+    }
+
+    qint64 position = 4 + qFromLittleEndian<quint32>(data);
+    if (position + 4 > size) {
+        return;
+    }
+
+    auto count = qFromLittleEndian<quint32>(data + position);
+    position += 4;
+
+    for (quint32 i {}; i < count and position + 4 <= size; ++i) {
+        auto length = qFromLittleEndian<quint32>(data + position);
+        position += 4;
+        if (position + length > size) {
+            break;
+        }
+
+        auto comment = QString::fromUtf8(reinterpret_cast<const char *>(data + position), static_cast<int>(length));
+        position += length;
+
+        auto separator = comment.indexOf('=');
+        if (separator < 0) {
+            continue;
+        }
+
+        auto key = QStringView(comment).left(separator);
+        auto value = comment.mid(separator + 1);
+        if (key.compare(QLatin1String("TITLE"), Qt::CaseInsensitive) == 0) {
+            info.title = value;
+        } else if (key.compare(QLatin1String("ARTIST"), Qt::CaseInsensitive) == 0) {
+            info.artist = value;
+        } else if (key.compare(QLatin1String("ALBUM"), Qt::CaseInsensitive) == 0) {
+            info.album = value;
+        } else if (key.startsWith(QLatin1String("REPLAYGAIN_"), Qt::CaseInsensitive)) {
+            readReplayGain(key, value, info.replayGain);
+        }
+    }
+}
+
+static void probeWav(QFile &file, TrackInfo &info)
+{
+    quint32 byteRate {};
+    qint64 chunkStart {12};
+
+    while (file.seek(chunkStart)) {
+        auto chunkHeader = file.read(8);
+        if (chunkHeader.size() < 8) {
+            break;
+        }
+
+        auto chunkSize = qFromLittleEndian<quint32>(bytes(chunkHeader) + 4);
+        if (chunkHeader.startsWith("fmt ")) {
+            auto format = file.read(16);
+            if (format.size() < 16) {
+                break;
+            }
+
+            info.channels = static_cast<quint8>(qFromLittleEndian<quint16>(bytes(format) + 2));
+            info.sampleRate = qFromLittleEndian<quint32>(bytes(format) + 4);
+            byteRate = qFromLittleEndian<quint32>(bytes(format) + 8);
+        } else if (chunkHeader.startsWith("data")) {
+            if (byteRate > 0) {
+                info.duration = static_cast<float>(static_cast<double>(chunkSize) / byteRate);
+            }
+            break;
+        }
+
+        /* Chunks are padded to an even size */
+        chunkStart += 8 + chunkSize + (chunkSize & 1);
+    }
+}
+
+static void probeFlac(QFile &file, qint64 offset, TrackInfo &info)
+{
+    /* STREAMINFO is always the first metadata block, right after "fLaC" */
+    if (not file.seek(offset + 4)) {
+        return;
+    }
+
+    auto block = file.read(4 + 34);
+    if (block.size() < 4 + 34 or (bytes(block)[0] & 0x7f) != 0) {
+        return;
+    }
+
+    const auto *streamInfo = bytes(block) + 4 + 10;
+    info.sampleRate = (static_cast<quint32>(streamInfo[0]) << 12) | (streamInfo[1] << 4) | (streamInfo[2] >> 4);
+    info.channels = static_cast<quint8>(((streamInfo[2] >> 1) & 0x07) + 1);
+    quint64 totalSamples = (static_cast<quint64>(streamInfo[3] & 0x0f) << 32)
+                           | (static_cast<quint64>(streamInfo[4]) << 24) | (streamInfo[5] << 16)
+                           | (streamInfo[6] << 8) | streamInfo[7];
+    if (info.sampleRate > 0) {
+        info.duration = static_cast<float>(static_cast<double>(totalSamples) / info.sampleRate);
+    }
+
+    /* Walk the metadata blocks up to the Vorbis comment one */
+    qint64 position = offset + 4 + 4 + 34;
+    bool last = bytes(block)[0] & 0x80;
+    while (not last and file.seek(position)) {
+        auto header = file.read(4);
+        if (header.size() < 4) {
+            return;
+        }
+
+        last = bytes(header)[0] & 0x80;
+        auto type = bytes(header)[0] & 0x7f;
+        qint64 length = (static_cast<qint64>(bytes(header)[1]) << 16) | (bytes(header)[2] << 8) | bytes(header)[3];
+        if (type == 4) {
+            auto comments = file.read(std::min(length, TAG_BYTES));
+            readVorbisComments(bytes(comments), comments.size(), info);
+            return;
+        }
+        position += 4 + length;
+    }
+}
+
+static void probeOgg(QFile &file, const QByteArray &head, TrackInfo &info)
+{
+    /* The first packet of the first page is the Vorbis identification header */
+    if (head.size() < 27) {
+        return;
+    }
+
+    int packetStart = 27 + bytes(head)[26];
+    if (head.size() < packetStart + 16 or head.mid(packetStart + 1, 6) != "vorbis") {
+        return;
+    }
+
+    info.channels = bytes(head)[packetStart + 11];
+    info.sampleRate = qFromLittleEndian<quint32>(bytes(head) + packetStart + 12);
+    if (info.sampleRate == 0) {
+        return;
+    }
+
+    /* The comment header starts the second page. Comments that go on into a third page are cut short */
+    qint64 secondPage = packetStart;
+    for (int i {}; i < bytes(head)[26]; ++i) {
+        secondPage += bytes(head)[27 + i];
+    }
+    if (file.seek(secondPage)) {
+        auto page = file.read(TAG_BYTES);
+        if (page.size() >= 27 and page.startsWith("OggS")) {
+            int segments = bytes(page)[26];
+            qint64 bodyStart = 27 + segments;
+            qint64 bodySize {};
+            for (int i {}; i < segments and 27 + i < page.size(); ++i) {
+                bodySize += bytes(page)[27 + i];
+            }
+
+            bodySize = std::min<qint64>(bodySize, page.size() - bodyStart);
+            if (bodySize > 7 and bytes(page)[bodyStart] == 3 and page.mid(bodyStart + 1, 6) == "vorbis") {
+                readVorbisComments(bytes(page) + bodyStart + 7, bodySize - 7, info);
+            }
+        }
+    }
+
+    /* The granule position of the last page is the total number of samples */
+    file.seek(std::max<qint64>(0, file.size() - TAIL_BYTES));
+    auto tail = file.read(TAIL_BYTES);
+    auto lastPage = tail.lastIndexOf("OggS");
+    if (lastPage < 0 or lastPage + 14 > tail.size()) {
+        return;
+    }
+
+    auto granule = qFromLittleEndian<qint64>(bytes(tail) + lastPage + 6);
+    if (granule > 0) {
+        info.duration = static_cast<float>(static_cast<double>(granule) / info.sampleRate);
+    }
+}
+
+static void probeMp3(QFile &file, qint64 offset, TrackInfo &info)
+{
+    if (not file.seek(offset)) {
+        return;
+    }
+
+    auto head = file.read(HEAD_BYTES);
+    const auto *data = bytes(head);
+
+    for (int i {}; i + 4 <= head.size(); ++i) {
+        Mp3Frame frame;
+        if (not Mp3Frame::parse(data + i, frame)) {
+            continue;
+        }
+
+        info.sampleRate = frame.sampleRate;
+        info.channels = frame.channels;
+        bool mono = frame.channels == 1;
+
+        /* VBR files carry their frame count in a Xing/Info or VBRI header inside the first frame */
+        int sideInfo = frame.mpeg1 ? (mono ? 17 : 32) : (mono ? 9 : 17);
+        int xing = i + 4 + sideInfo;
+        int vbri = i + 4 + 32;
+        quint32 frames {};
+
+        if (xing + 12 <= head.size() and (head.mid(xing, 4) == "Xing" or head.mid(xing, 4) == "Info")) {
+            auto flags = qFromBigEndian<quint32>(data + xing + 4);
+            if (flags & 0x01) {
+                frames = qFromBigEndian<quint32>(data + xing + 8);
+            }
+        } else if (vbri + 18 <= head.size() and head.mid(vbri, 4) == "VBRI") {
+            frames = qFromBigEndian<quint32>(data + vbri + 14);
+        }
+
+        if (frames > 0) {
+            info.duration = static_cast<float>(static_cast<double>(frames) * frame.samples / info.sampleRate);
+            return;
+        }
+
+        /* Constant bitrate, the size tells the length. Leave out an ID3v1 tag at the end */
+        qint64 audioBytes = file.size() - offset - i;
+        if (file.seek(file.size() - 128) and file.read(3) == "TAG") {
+            audioBytes -= 128;
+        }
+        info.duration = static_cast<float>(static_cast<double>(audioBytes) * 8 / (frame.bitrate * 1'000.0));
+        return;
+    }
+}
+
+static void probeQoa(const QByteArray &head, TrackInfo &info)
+{
+    /* File header: "qoaf", samples per channel. First frame header: channels, 24 bits sample rate */
+    if (head.size() < 12) {
+        return;
+    }
+
+    auto samples = qFromBigEndian<quint32>(bytes(head) + 4);
+    info.channels = bytes(head)[8];
+    info.sampleRate = (static_cast<quint32>(bytes(head)[9]) << 16) | (bytes(head)[10] << 8) | bytes(head)[11];
+    if (info.sampleRate > 0) {
+        info.duration = static_cast<float>(static_cast<double>(samples) / info.sampleRate);
+    }
+}
+
+static bool isModule(const QByteArray &head)
+{
+    static const QByteArray signatures[] {"M.K.", "M!K!", "FLT4", "FLT8", "4CHN", "6CHN", "8CHN"};
+    if (head.size() < 1'084) {
+        return false;
+    }
+
+    auto signature = head.mid(1'080, 4);
+    return std::find(std::begin(signatures), std::end(signatures), signature) != std::end(signatures);
+}
+
+MetadataProber::MetadataProber(const QString &cachePath, QObject *parent)
+    : QObject(parent)
+    , m_generation(0)
+    , m_cache(cachePath)
+{
+    /* Most of the time is spent waiting for the disk (or the network), not parsing */
+    m_pool.setMaxThreadCount(QThread::idealThreadCount() * 2);
+    m_cache.open();
+
+    m_saveTimer.setSingleShot(true);
+    m_saveTimer.setInterval(CACHE_SAVE_DELAY);
+    connect(&m_saveTimer, &QTimer::timeout, this, &MetadataProber::saveCache);
+}
+
+MetadataProber::~MetadataProber()
+{
+    cancel();
+    m_pool.waitForDone();
+    m_cache.save();
+}
+
+void MetadataProber::saveCache()
+{
+    /* Saving remaps the cache, which can't happen while a task is looking up */
+    if (m_pool.activeThreadCount() > 0) {
+        m_saveTimer.start();
+        return;
+    }
+
+    m_cache.save();
+}
+
+void MetadataProber::probe(QVector<Request> requests)
+{
+    auto generation = m_generation.load();
+
+    for (int start {}; start < requests.size(); start += BATCH_SIZE) {
+        auto batch = requests.mid(start, BATCH_SIZE);
+        m_pool.start([this, generation, batch] {
+            TRACE_SCOPE("MetadataProber batch");
+            QVector<ProbeResult> results;
+            QVector<MetadataCache::Record> misses;
+            results.reserve(batch.size());
+
+            for (const auto &request : batch) {
+                if (m_generation.load() != generation) {
+                    return;
+                }
+
+                /* A stat is all it takes when the file didn't change */
+                QFileInfo fileInfo(request.path);
+                auto size = fileInfo.size();
+                auto modified = fileInfo.lastModified().toMSecsSinceEpoch();
+
+                TrackInfo info;
+                if (not m_cache.find(request.path, size, modified, info)) {
+                    info = probeFile(request.path);
+                    if (fileInfo.exists()) {
+                        misses.append({request.path, size, modified, info});
+                    }
+                }
+                results.append({request.id, std::move(info)});
+            }
+
+            QMetaObject::invokeMethod(this, [this, generation, results, misses] {
+                for (const auto &record : misses) {
+                    m_cache.insert(record);
+                }
+                if (not misses.isEmpty()) {
+                    m_saveTimer.start();
+                }
+
+                /* Track ids are reused once the queue is cleared, drop results for the old queue */
+                if (m_generation.load() == generation) {
+                    emit probed(results);
+                }
+            }, Qt::QueuedConnection);
+        });
+    }
+}
+
+void MetadataProber::cancel()
+{
+    ++m_generation;
+    m_pool.clear();
+}
+
+SeekIndex MetadataProber::seekIndex(const QString &path) const
+{
+    QFileInfo fileInfo(path);
+    QByteArray bytes;
+    if (not m_cache.findSeekIndex(path, fileInfo.size(), fileInfo.lastModified().toMSecsSinceEpoch(), bytes)) {
+        return {};
+    }
+
+    return SeekIndex::fromBytes(bytes);
+}
+
+void MetadataProber::storeSeekIndex(const QString &path, const SeekIndex &index)
+{
+    QFileInfo fileInfo(path);
+    if (index.isEmpty() or not fileInfo.exists()) {
+        return;
+    }
+
+    m_cache.insertSeekIndex(path, fileInfo.size(), fileInfo.lastModified().toMSecsSinceEpoch(), index.toBytes());
+    m_saveTimer.start();
+}
+
+void MetadataProber::renamePath(const QString &from, const QString &to)
+{
+    m_cache.rename(from, to);
+    m_saveTimer.start();
+}
+
+void MetadataProber::forgetPath(const QString &path)
+{
+    m_cache.remove(path);
+    m_saveTimer.start();
+}
+
+TrackInfo MetadataProber::probeFile(const QString &path)
+{
+    TrackInfo info;
+    info.probed = true;
+
+    QFile file(path);
+    if (not file.open(QIODevice::ReadOnly)) {
+        return info;
+    }
+
+    auto head = file.read(HEAD_BYTES);
+    auto offset = id3v2Size(head);
+    if (offset > 0) {
+        /* Some taggers put ID3v2 in front of FLAC as well */
+        file.seek(offset);
+        head = file.read(HEAD_BYTES);
+    }
+
+    auto suffix = QFileInfo(path).suffix().toLower();
+
+    if (head.startsWith("RIFF") and head.mid(8, 4) == "WAVE") {
+        info.codec = Codec::Wav;
+        probeWav(file, info);
+    } else if (head.startsWith("fLaC")) {
+        info.codec = Codec::Flac;
+        probeFlac(file, offset, info);
+    } else if (head.startsWith("OggS")) {
+        info.codec = Codec::Ogg;
+        probeOgg(file, head, info);
+    } else if (head.startsWith("qoaf")) {
+        info.codec = Codec::Qoa;
+        probeQoa(head, info);
+    } else if (head.startsWith("Extended Module: ")) {
+        /* Trackers have no length until they're rendered */
+        info.codec = Codec::Xm;
+        info.channels = 2;
+    } else if (isModule(head) or suffix == "mod") {
+        info.codec = Codec::Mod;
+        info.channels = 2;
+    } else if (suffix == "mp3" or offset > 0) {
+        info.codec = Codec::Mp3;
+        probeMp3(file, offset, info);
+    }
+
+    if (offset > 0 and info.title.isEmpty()) {
+        readId3v2Tags(file, info);
+    }
+
+    return info;
+}
@@ -0,0 +1,55 @@
+#ifndef METADATAPROBER_HPP
+#define METADATAPROBER_HPP
+
+#include <atomic>
+#include <QObject>
+#include <QThreadPool>
+#include <QTimer>
+#include <QVector>
+
+#include "metadatacache.hpp"
+#include "seekindex.hpp"
+#include "trackinfo.hpp"
+#include "tracktable.hpp"
+
+struct ProbeResult
+{
+    TrackId id;
+    TrackInfo info;
+};
+
+/* Reads duration, sample rate, channels, codec and tags from the file headers on a thread pool,
+ * without decoding anything. Results come back in batches on the thread the prober lives in.
+ * Files that didn't change since the last time they were probed are answered by the cache.
+ */
+class MetadataProber : public QObject
+{
+    Q_OBJECT
+    QThreadPool m_pool;
+    std::atomic<quint64> m_generation;
+    MetadataCache m_cache;
+    QTimer m_saveTimer;
+
+    void saveCache();
+public:
+    struct Request
+    {
+        TrackId id;
+        QString path;
+    };
+
+    explicit MetadataProber(const QString &cachePath, QObject *parent = nullptr);
+    ~MetadataProber();
+    void probe(QVector<Request> requests);
+    void cancel();
+    SeekIndex seekIndex(const QString &path) const;
+    void storeSeekIndex(const QString &path, const SeekIndex &index);
+    /* Files renamed or deleted behind our back */
+    void renamePath(const QString &from, const QString &to);
+    void forgetPath(const QString &path);
+    static TrackInfo probeFile(const QString &path);
+signals:
+    void probed(QVector<ProbeResult> results);
+};
+
+#endif // METADATAPROBER_HPP
@@ -0,0 +1,49 @@
+#ifndef MP3FRAME_HPP
+#define MP3FRAME_HPP
+
+#include <QtGlobal>
+
+/* An MPEG audio layer II or III frame header, the part of it needed to walk a file frame by frame */
+struct Mp3Frame
+{
+    quint32 sampleRate {};
+    quint8 channels {};
+    bool mpeg1 {};
+    int samples {};
+    int bitrate {};
+    int bytes {};
+
+    /* The four bytes at data must be there */
+    static bool parse(const uchar *data, Mp3Frame &frame)
+    {
+        static constexpr int LAYER3_MPEG1_BITRATES[] {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320};
+        static constexpr int LAYER2_MPEG1_BITRATES[] {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384};
+        static constexpr int MPEG2_BITRATES[] {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160};
+        static constexpr int MPEG1_SAMPLE_RATES[] {44'100, 48'000, 32'000};
+
+        if (data[0] != 0xff or (data[1] & 0xe0) != 0xe0) {
+            return false;
+        }
+
+        int version = (data[1] >> 3) & 0x03; /* 0: MPEG 2.5, 2: MPEG 2, 3: MPEG 1 */
+        int layer = (data[1] >> 1) & 0x03;   /* 1: layer III, 2: layer II */
+        int bitrateIndex = data[2] >> 4;
+        int sampleRateIndex = (data[2] >> 2) & 0x03;
+        if (version == 1 or (layer != 1 and layer != 2) or bitrateIndex == 0 or bitrateIndex == 15
+            or sampleRateIndex == 3) {
+            return false;
+        }
+
+        frame.mpeg1 = version == 3;
+        frame.sampleRate = MPEG1_SAMPLE_RATES[sampleRateIndex] >> (frame.mpeg1 ? 0 : version == 2 ? 1 : 2);
+        frame.channels = (data[3] >> 6) == 0x03 ? 1 : 2;
+        frame.samples = layer == 1 and not frame.mpeg1 ? 576 : 1'152;
+        frame.bitrate = frame.mpeg1 ? (layer == 1 ? LAYER3_MPEG1_BITRATES[bitrateIndex] : LAYER2_MPEG1_BITRATES[bitrateIndex])
+                                    : MPEG2_BITRATES[bitrateIndex];
+        bool padding = (data[2] >> 1) & 0x01;
+        frame.bytes = frame.samples / 8 * frame.bitrate * 1'000 / static_cast<int>(frame.sampleRate) + (padding ? 1 : 0);
+        return true;
+    }
+};
+
+#endif // MP3FRAME_HPP
@@ -0,0 +1,325 @@
+#include <algorithm>
+#include <limits>
+#include <QDebug>
+#include <QFileInfo>
+#include <utility>
+
+#include "musichandle.hpp"
+#include "tracer.hpp"
+
+/* raylib's default sub-buffer, sampleRate / 30 frames */
+static constexpr int DEFAULT_BUFFER_FRAMES {48'000 / 30};
+/* The stream is reopened this much before the target at least, so the frames holding
+ * the target's bit reservoir are decoded first
+ */
+static constexpr float RESERVOIR_MARGIN {0.1f};
+/* Rough size of the state kept by the mp3, ogg, flac, wav and qoa decoders */
+static constexpr qint64 DECODER_STATE_BYTES {128 * 1'024};
+
+std::atomic<int> MusicHandle::s_openHandles {0};
+std::atomic<qint64> MusicHandle::s_residentBytes {0};
+std::atomic<qint64> MusicHandle::s_maxMappedBytes {1'024ll * 1'024 * 1'024};
+std::atomic<int> MusicHandle::s_bufferFrames {DEFAULT_BUFFER_FRAMES};
+
+/* raylib converts both sub-buffers to stereo floats */
+static qint64 streamBufferBytes(int frames)
+{
+    return 2 * static_cast<qint64>(frames) * 2 * sizeof(float);
+}
+
+MusicHandle::MusicHandle()
+    : m_music {}
+    , m_residentBytes(0)
+    , m_fileSize(0)
+    , m_timeOffset(0.0f)
+    , m_looping(false)
+{
+}
+
+MusicHandle::MusicHandle(Music music, QString path)
+    : m_music {}
+    , m_path(std::move(path))
+    , m_residentBytes(0)
+    , m_fileSize(0)
+    , m_timeOffset(0.0f)
+    , m_looping(false)
+{
+    adopt(music);
+}
+
+MusicHandle::~MusicHandle()
+{
+    reset();
+}
+
+MusicHandle::MusicHandle(MusicHandle &&other) noexcept
+    : m_music(std::exchange(other.m_music, Music {}))
+    , m_path(std::move(other.m_path))
+    , m_residentBytes(std::exchange(other.m_residentBytes, 0))
+    , m_fileSize(std::exchange(other.m_fileSize, 0))
+    , m_mapping(std::move(other.m_mapping))
+    , m_bytes(std::move(other.m_bytes))
+    , m_seekIndex(std::move(other.m_seekIndex))
+    , m_timeOffset(std::exchange(other.m_timeOffset, 0.0f))
+    , m_looping(std::exchange(other.m_looping, false))
+{
+}
+
+MusicHandle &MusicHandle::operator=(MusicHandle &&other) noexcept
+{
+    if (this != &other) {
+        reset();
+        m_music = std::exchange(other.m_music, Music {});
+        m_path = std::move(other.m_path);
+        m_residentBytes = std::exchange(other.m_residentBytes, 0);
+        m_fileSize = std::exchange(other.m_fileSize, 0);
+        m_mapping = std::move(other.m_mapping);
+        m_bytes = std::move(other.m_bytes);
+        m_seekIndex = std::move(other.m_seekIndex);
+        m_timeOffset = std::exchange(other.m_timeOffset, 0.0f);
+        m_looping = std::exchange(other.m_looping, false);
+    }
+
+    return *this;
+}
+
+MusicHandle MusicHandle::load(const QString &path, const AudioCache *cache)
+{
+    TRACE_SCOPE("MusicHandle::load");
+
+    /* raylib picks the decoder by the extension, dot included */
+    auto fileType = QString(".%1").arg(QFileInfo(path).suffix().toLower()).toStdString();
+
+    auto bytes = cache != nullptr ? cache->find(path) : AudioCache::Bytes {};
+    if (bytes and bytes->size() <= std::numeric_limits<int>::max()) {
+        auto music = LoadMusicStreamFromMemory(fileType.c_str(),
+                                               reinterpret_cast<const unsigned char *>(bytes->constData()),
+                                               static_cast<int>(bytes->size()));
+        if (IsMusicReady(music)) {
+            MusicHandle handle(music, path);
+            handle.m_bytes = std::move(bytes);
+            return handle;
+        }
+    }
+
+    /* raylib takes the size as an int */
+    auto maxMappedBytes = std::min<qint64>(s_maxMappedBytes.load(), std::numeric_limits<int>::max());
+    if (maxMappedBytes > 0) {
+        auto mapping = std::make_unique<MappedFile>(path);
+        if (mapping->map(maxMappedBytes)) {
+            auto music = LoadMusicStreamFromMemory(fileType.c_str(), mapping->data(), static_cast<int>(mapping->size()));
+            if (IsMusicReady(music)) {
+                MusicHandle handle(music, path);
+                handle.m_mapping = std::move(mapping);
+                return handle;
+            }
+        }
+    }
+
+    return MusicHandle(LoadMusicStream(path.toStdString().c_str()), path);
+}
+
+qint64 MusicHandle::estimateResidentBytes(const QString &path)
+{
+    /* Trackers are loaded into memory as a whole */
+    QFileInfo info(path);
+    auto suffix = info.suffix().toLower();
+    if (suffix == "xm" or suffix == "mod") {
+        return streamBufferBytes(s_bufferFrames.load()) + info.size();
+    }
+
+    return streamBufferBytes(s_bufferFrames.load()) + DECODER_STATE_BYTES;
+}
+
+int MusicHandle::openHandles()
+{
+    return s_openHandles.load();
+}
+
+qint64 MusicHandle::totalResidentBytes()
+{
+    return s_residentBytes.load();
+}
+
+void MusicHandle::setMaxMappedBytes(qint64 bytes)
+{
+    s_maxMappedBytes.store(bytes);
+}
+
+void MusicHandle::setBufferFrames(int frames)
+{
+    /* Streams opened from now on get sub-buffers of this many frames */
+    s_bufferFrames.store(frames);
+    SetAudioStreamBufferSizeDefault(frames);
+}
+
+int MusicHandle::bufferFrames()
+{
+    return s_bufferFrames.load();
+}
+
+void MusicHandle::adopt(Music music)
+{
+    m_music = music;
+    if (not IsMusicReady(m_music)) {
+        return;
+    }
+
+    m_looping = m_music.looping;
+    m_residentBytes = estimateResidentBytes(m_path);
+    m_fileSize = QFileInfo(m_path).size();
+    s_openHandles.fetch_add(1);
+    s_residentBytes.fetch_add(m_residentBytes);
+}
+
+bool MusicHandle::isReady() const
+{
+    return IsMusicReady(m_music);
+}
+
+Music &MusicHandle::music()
+{
+    return m_music;
+}
+
+const Music &MusicHandle::music() const
+{
+    return m_music;
+}
+
+const QString &MusicHandle::path() const
+{
+    return m_path;
+}
+
+void MusicHandle::rename(QString path)
+{
+    /* The stream keeps reading the file it opened, only the name changed */
+    m_path = std::move(path);
+}
+
+qint64 MusicHandle::residentBytes() const
+{
+    return m_residentBytes;
+}
+
+qint64 MusicHandle::fileSize() const
+{
+    return m_fileSize;
+}
+
+bool MusicHandle::isMapped() const
+{
+    return m_mapping != nullptr;
+}
+
+bool MusicHandle::isCached() const
+{
+    return m_bytes != nullptr;
+}
+
+void MusicHandle::setSeekIndex(SeekIndex index)
+{
+    m_seekIndex = std::move(index);
+}
+
+bool MusicHandle::hasSeekIndex() const
+{
+    return not m_seekIndex.isEmpty();
+}
+
+bool MusicHandle::reopen(qint64 offset, float timeOffset)
+{
+    TRACE_SCOPE("MusicHandle::reopen");
+
+    const uchar *data {};
+    qint64 size {};
+    if (m_mapping) {
+        data = m_mapping->data();
+        size = m_mapping->size();
+    } else if (m_bytes) {
+        data = reinterpret_cast<const uchar *>(m_bytes->constData());
+        size = m_bytes->size();
+    }
+
+    if (data == nullptr or offset >= size or size - offset > std::numeric_limits<int>::max()) {
+        return false;
+    }
+
+    auto fileType = QString(".%1").arg(QFileInfo(m_path).suffix().toLower()).toStdString();
+    auto music = LoadMusicStreamFromMemory(fileType.c_str(), data + offset, static_cast<int>(size - offset));
+    if (not IsMusicReady(music)) {
+        return false;
+    }
+
+    /* Still the same open handle as far as the counters go */
+    StopMusicStream(m_music);
+    UnloadMusicStream(m_music);
+    m_music = music;
+    m_timeOffset = timeOffset;
+    /* Looping a stream that starts midway would start over from there */
+    m_music.looping = m_looping and m_timeOffset == 0.0f;
+    return true;
+}
+
+void MusicHandle::seek(float seconds)
+{
+    const auto *point = m_seekIndex.find(seconds - RESERVOIR_MARGIN);
+    auto offset = point != nullptr ? point->offset : 0;
+    auto timeOffset = point != nullptr ? point->seconds : 0.0f;
+
+    /* Deep into the track and not where the stream already begins, start a new stream close to the target */
+    if (timeOffset != m_timeOffset and not reopen(timeOffset > 0.0f ? offset : 0, timeOffset)) {
+        qDebug() << "Couldn't reopen" << m_path << "at" << timeOffset << "s, decoding from where it is.";
+    }
+
+    TRACE_SCOPE("SeekMusicStream");
+    SeekMusicStream(m_music, std::max(seconds - m_timeOffset, 0.0f));
+}
+
+void MusicHandle::stop()
+{
+    /* Back to a stream that starts at the beginning of the track */
+    if (m_timeOffset > 0.0f and reopen(0, 0.0f)) {
+        return;
+    }
+
+    StopMusicStream(m_music);
+}
+
+void MusicHandle::setLooping(bool looping)
+{
+    m_looping = looping;
+    m_music.looping = m_looping and m_timeOffset == 0.0f;
+}
+
+float MusicHandle::timePlayed() const
+{
+    return m_timeOffset + GetMusicTimePlayed(m_music);
+}
+
+float MusicHandle::timeOffset() const
+{
+    return m_timeOffset;
+}
+
+void MusicHandle::reset()
+{
+    if (IsMusicReady(m_music)) {
+        StopMusicStream(m_music);
+        UnloadMusicStream(m_music);
+        s_openHandles.fetch_sub(1);
+        s_residentBytes.fetch_sub(m_residentBytes);
+    }
+
+    /* Only once the decoder is gone, it reads straight from the mapping or the cached bytes */
+    m_mapping.reset();
+    m_bytes.reset();
+    m_seekIndex = {};
+    m_timeOffset = 0.0f;
+    m_looping = false;
+    m_music = {};
+    m_path.clear();
+    m_residentBytes = 0;
+    m_fileSize = 0;
+}
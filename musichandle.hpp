@@ -0,0 +1,76 @@
+#ifndef MUSICHANDLE_HPP
+#define MUSICHANDLE_HPP
+
+#include <atomic>
+#include <memory>
+#include <QString>
+
+#include <raylib.h>
+
+#include "audiocache.hpp"
+#include "mappedfile.hpp"
+#include "seekindex.hpp"
+
+/* Owns a raylib Music stream and unloads it when it goes out of scope.
+ * Every live handle is accounted for, so leaks show up in the counters.
+ * Files are decoded from the audio cache when it has them, otherwise straight from a memory mapping
+ * when they fit. Either lives as long as the stream.
+ * With a seek index, seeking reopens the stream at an indexed frame instead of decoding from the start,
+ * the handle then keeps track of where in the track its stream begins.
+ */
+class MusicHandle
+{
+    Music m_music;
+    QString m_path;
+    qint64 m_residentBytes;
+    qint64 m_fileSize;
+    std::unique_ptr<MappedFile> m_mapping;
+    AudioCache::Bytes m_bytes;
+    SeekIndex m_seekIndex;
+    float m_timeOffset;
+    bool m_looping;
+
+    static std::atomic<int> s_openHandles;
+    static std::atomic<qint64> s_residentBytes;
+    static std::atomic<qint64> s_maxMappedBytes;
+    static std::atomic<int> s_bufferFrames;
+
+    void adopt(Music music);
+    bool reopen(qint64 offset, float timeOffset);
+public:
+    MusicHandle();
+    MusicHandle(Music music, QString path);
+    ~MusicHandle();
+    MusicHandle(const MusicHandle &) = delete;
+    MusicHandle &operator=(const MusicHandle &) = delete;
+    MusicHandle(MusicHandle &&other) noexcept;
+    MusicHandle &operator=(MusicHandle &&other) noexcept;
+
+    static MusicHandle load(const QString &path, const AudioCache *cache = nullptr);
+    static qint64 estimateResidentBytes(const QString &path);
+    static int openHandles();
+    static qint64 totalResidentBytes();
+    static void setMaxMappedBytes(qint64 bytes);
+    static void setBufferFrames(int frames);
+    static int bufferFrames();
+
+    bool isReady() const;
+    Music &music();
+    const Music &music() const;
+    const QString &path() const;
+    void rename(QString path);
+    qint64 residentBytes() const;
+    qint64 fileSize() const;
+    bool isMapped() const;
+    bool isCached() const;
+    void setSeekIndex(SeekIndex index);
+    bool hasSeekIndex() const;
+    void seek(float seconds);
+    void stop();
+    void setLooping(bool looping);
+    float timePlayed() const;
+    float timeOffset() const;
+    void reset();
+};
+
+#endif // MUSICHANDLE_HPP
@@ -0,0 +1,69 @@
+#include <algorithm>
+
+#include "playbackclock.hpp"
+
+/* The playback thread publishes every few milliseconds, if it stops doing so the audio stops too */
+static constexpr double MAX_EXTRAPOLATION {0.25};
+
+PlaybackClock::PlaybackClock()
+    : m_sequence(0)
+    , m_position(0.0)
+    , m_stamp(0)
+    , m_limit(0.0)
+    , m_running(false)
+{
+}
+
+void PlaybackClock::publish(double position, bool running, double limit)
+{
+    /* Odd while writing, so readers know to try again */
+    auto sequence = m_sequence.load(std::memory_order_relaxed);
+    m_sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    m_position.store(position, std::memory_order_relaxed);
+    m_stamp.store(Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+    m_limit.store(limit, std::memory_order_relaxed);
+    m_running.store(running, std::memory_order_relaxed);
+
+    m_sequence.store(sequence + 2, std::memory_order_release);
+}
+
+double PlaybackClock::position() const
+{
+    double position {};
+    Clock::rep stamp {};
+    double limit {};
+    bool running {};
+
+    while (true) {
+        auto before = m_sequence.load(std::memory_order_acquire);
+        if (before & 1) {
+            continue;
+        }
+
+        position = m_position.load(std::memory_order_relaxed);
+        stamp = m_stamp.load(std::memory_order_relaxed);
+        limit = m_limit.load(std::memory_order_relaxed);
+        running = m_running.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (m_sequence.load(std::memory_order_relaxed) == before) {
+            break;
+        }
+    }
+
+    if (not running) {
+        return position;
+    }
+
+    /* The device kept playing since the last publish */
+    auto elapsed = std::chrono::duration<double>(Clock::now().time_since_epoch() - Clock::duration(stamp)).count();
+    position += std::min(elapsed, MAX_EXTRAPOLATION);
+    return limit > 0.0 ? std::min(position, limit) : position;
+}
+
+bool PlaybackClock::isRunning() const
+{
+    return m_running.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,28 @@
+#ifndef PLAYBACKCLOCK_HPP
+#define PLAYBACKCLOCK_HPP
+
+#include <atomic>
+#include <chrono>
+#include <QtGlobal>
+
+/* The position of what's coming out of the speakers, readable from any thread without locking.
+ * The playback thread publishes the position the device reached and when, readers extrapolate
+ * from there while it's running. A sequence counter tells readers when they raced a publish.
+ */
+class PlaybackClock
+{
+    using Clock = std::chrono::steady_clock;
+
+    std::atomic<quint32> m_sequence;
+    std::atomic<double> m_position;
+    std::atomic<Clock::rep> m_stamp;
+    std::atomic<double> m_limit;
+    std::atomic<bool> m_running;
+public:
+    PlaybackClock();
+    void publish(double position, bool running, double limit);
+    double position() const;
+    bool isRunning() const;
+};
+
+#endif // PLAYBACKCLOCK_HPP
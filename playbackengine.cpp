@@ -0,0 +1,1018 @@
+#include <algorithm>
+#include <chrono>
+#include <QDebug>
+#include <QFileInfo>
+
+#include "playbackengine.hpp"
+#include "tracer.hpp"
+
+/* raylib streams in two sub-buffers of roughly 33 ms each,
+ * so refilling every 10 ms keeps the device fed without busy looping.
+ */
+static constexpr std::chrono::milliseconds PUMP_INTERVAL {10};
+/* Refilling a sub-buffer normally takes well under a millisecond, this long means the decoder waited for I/O */
+static constexpr std::chrono::milliseconds STALL_THRESHOLD {50};
+/* How much of the next track is read before it starts */
+static constexpr qint64 HEAD_PREFETCH_BYTES {4 * 1'024 * 1'024};
+/* raylib mixes at the device rate, we ask for 48 kHz */
+static constexpr int DEVICE_SAMPLE_RATE {48'000};
+/* raylib leaves miniaudio's low latency defaults, three periods of 10 ms of which
+ * one is being played and the rest is queued when a period was just mixed
+ */
+static constexpr float OUTPUT_LATENCY {0.02f};
+/* Shorter MP3s seek fast enough by decoding from the start */
+static constexpr float SEEK_INDEX_MIN_LENGTH {120.0f};
+
+PlaybackEngine::PlaybackEngine(QObject *parent)
+    : QThread(parent)
+    , m_wakePending(false)
+    , m_crossfadeSeconds(0.0f)
+    , m_readaheadSeconds(0.0f)
+    , m_sinkSpeed(1.0f)
+    , m_cursor(0)
+    , m_paceFrames(0)
+    , m_looping(false)
+    , m_quit(false)
+    , m_lastSecondReported(-1)
+    , m_position(0.0f)
+    , m_state(State::Stopped)
+    , m_length(0.0f)
+    , m_prefetchedSeconds(0.0f)
+    , m_stalls(0)
+    , m_underruns(0)
+{
+    m_streams.setCache(&m_cache);
+    /* Names the thread in debuggers and traces */
+    setObjectName("PlaybackEngine");
+    /* stateChanged crosses threads */
+    qRegisterMetaType<PlaybackEngine::State>("PlaybackEngine::State");
+    qRegisterMetaType<SeekIndex>("SeekIndex");
+}
+
+PlaybackEngine::~PlaybackEngine()
+{
+    shutdown();
+}
+
+void PlaybackEngine::load(QString path)
+{
+    post({Command::Type::Load, path});
+}
+
+void PlaybackEngine::renamePath(QString from, QString to)
+{
+    post({Command::Type::Rename, from, {}, to});
+}
+
+void PlaybackEngine::setNeighbours(QString previous, QString next)
+{
+    post({Command::Type::SetNeighbours, previous, {}, next});
+}
+
+void PlaybackEngine::setSeekIndex(QString path, SeekIndex index)
+{
+    post({Command::Type::SetSeekIndex, path, {}, {}, index});
+}
+
+void PlaybackEngine::setReplayGain(QString path, ReplayGain replayGain)
+{
+    Command command {Command::Type::SetReplayGain, path};
+    command.replayGain = replayGain;
+    post(std::move(command));
+}
+
+void PlaybackEngine::play()
+{
+    post({Command::Type::Play});
+}
+
+void PlaybackEngine::pause()
+{
+    post({Command::Type::Pause});
+}
+
+void PlaybackEngine::resume()
+{
+    post({Command::Type::Resume});
+}
+
+void PlaybackEngine::stop()
+{
+    post({Command::Type::Stop});
+}
+
+void PlaybackEngine::seek(float seconds)
+{
+    post({Command::Type::Seek, {}, seconds});
+}
+
+void PlaybackEngine::setLooping(bool looping)
+{
+    /* Not worth opening the audio device for */
+    if (not isRunning()) {
+        m_looping = looping;
+        return;
+    }
+
+    post({Command::Type::SetLooping, {}, looping ? 1.0f : 0.0f});
+}
+
+void PlaybackEngine::setStreamLimits(StreamManager::Limits limits)
+{
+    /* Only read by the playback thread, which isn't running yet */
+    Q_ASSERT(not isRunning());
+    m_streams.setLimits(limits);
+}
+
+void PlaybackEngine::setBuffering(float decodeAheadSeconds, float readaheadSeconds)
+{
+    Q_ASSERT(not isRunning());
+
+    /* Two sub-buffers, one is played while the other is decoded into */
+    if (decodeAheadSeconds > 0.0f) {
+        MusicHandle::setBufferFrames(static_cast<int>(decodeAheadSeconds * DEVICE_SAMPLE_RATE / 2));
+    }
+    m_readaheadSeconds = readaheadSeconds;
+}
+
+void PlaybackEngine::setSink(std::unique_ptr<AudioSink> sink, float speed)
+{
+    Q_ASSERT(not isRunning());
+    m_sink = std::move(sink);
+    /* 0 writes as fast as the decoders go */
+    m_sinkSpeed = speed;
+}
+
+void PlaybackEngine::setProcessing(const DspChain::Config &config)
+{
+    Q_ASSERT(not isRunning());
+    m_dsp.configure(config);
+}
+
+void PlaybackEngine::setCrossfade(float seconds)
+{
+    Q_ASSERT(not isRunning());
+    /* 0 plays the tracks back to back, only a sink leaves nothing in between */
+    m_crossfadeSeconds = std::max(seconds, 0.0f);
+}
+
+void PlaybackEngine::setAudioCacheBudget(qint64 bytes)
+{
+    m_cache.setBudget(bytes);
+}
+
+void PlaybackEngine::shutdown()
+{
+    if (not isRunning()) {
+        return;
+    }
+
+    post({Command::Type::Quit});
+    wait();
+}
+
+PlaybackEngine::State PlaybackEngine::state() const
+{
+    return m_state.load();
+}
+
+float PlaybackEngine::timePlayed() const
+{
+    return static_cast<float>(m_clock.position());
+}
+
+const PlaybackClock &PlaybackEngine::clock() const
+{
+    return m_clock;
+}
+
+float PlaybackEngine::length() const
+{
+    return m_length.load();
+}
+
+float PlaybackEngine::prefetchedSeconds() const
+{
+    return m_prefetchedSeconds.load();
+}
+
+int PlaybackEngine::stalls() const
+{
+    return m_stalls.load();
+}
+
+int PlaybackEngine::underruns() const
+{
+    return m_underruns.load();
+}
+
+qint64 PlaybackEngine::audioCacheBytes() const
+{
+    return m_cache.usedBytes();
+}
+
+void PlaybackEngine::post(Command command)
+{
+    /* Opening the audio device takes a while, it waits until there's something to play */
+    if (not isRunning() and not isFinished()) {
+        start();
+    }
+
+    /* Every command changes what's played, none can be lost. A full queue means the playback thread
+     * is busy with something slow, so waiting for it a round at a time is all there is to do.
+     */
+    while (not m_commands.push(std::move(command))) {
+        if (isFinished()) {
+            qWarning() << "Playback engine is gone, dropping command.";
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(m_wakeMutex);
+        m_wakePending = true;
+        m_wakeCondition.notify_one();
+        m_roomCondition.wait_for(lock, PUMP_INTERVAL);
+    }
+
+    {
+        /* The mutex only protects the wake up flag, commands travel through the lock-free queue */
+        std::lock_guard<std::mutex> lock(m_wakeMutex);
+        m_wakePending = true;
+    }
+    m_wakeCondition.notify_one();
+}
+
+void PlaybackEngine::run()
+{
+    SetTraceLogLevel(LOG_ERROR);
+    if (m_sink) {
+        if (not m_sink->open(m_sinkFormat)) {
+            qWarning() << "Couldn't open the audio sink, nothing will be written.";
+        }
+        m_dsp.setSampleRate(m_sinkFormat.sampleRate);
+    } else {
+        InitAudioDevice();
+#ifdef BITMPLAYER_TRACING
+        Tracer::prepareAudioCallback();
+        AttachAudioMixedProcessor(Tracer::audioCallback);
+#endif
+        m_dsp.setSampleRate(DEVICE_SAMPLE_RATE);
+        m_dsp.attach();
+    }
+    qDebug() << "DSP chain runs on" << DspChain::instructionSet();
+
+    while (not m_quit) {
+        processCommands();
+        if (m_quit) {
+            break;
+        }
+
+        m_streams.collect();
+        collectSeekIndexes();
+        collectDecoded();
+
+        if (m_state.load() == State::Playing) {
+            updateMusic();
+        }
+
+        /* Keep polling while a preload is still on its way so it gets primed as soon as it's ready */
+        bool busy = m_state.load() == State::Playing or m_streams.hasPending() or not m_seekIndexBuilds.empty()
+                    or not m_abandonedDecodes.empty();
+
+        /* Unpaced sinks only stop to look at the commands, a sink that sets its own pace is topped up every round */
+        bool unpaced = m_sink and m_sinkSpeed <= 0.0f and m_sink->framesWritable() < 0;
+        auto interval = unpaced ? std::chrono::milliseconds(0) : PUMP_INTERVAL;
+
+        std::unique_lock<std::mutex> lock(m_wakeMutex);
+        if (busy) {
+            m_wakeCondition.wait_for(lock, interval, [this] { return m_wakePending; });
+        } else {
+            /* Nothing to stream, sleep until the GUI asks for something */
+            m_wakeCondition.wait(lock, [this] { return m_wakePending; });
+        }
+        m_wakePending = false;
+    }
+
+    unloadMusic();
+    m_streams.clear();
+    m_prefetcher.clear();
+    if (m_sink) {
+        qDebug() << "Frames written to the sink:" << m_sink->framesWritten();
+        m_sink->close();
+    } else {
+        m_dsp.detach();
+#ifdef BITMPLAYER_TRACING
+        DetachAudioMixedProcessor(Tracer::audioCallback);
+#endif
+        CloseAudioDevice();
+    }
+}
+
+void PlaybackEngine::processCommands()
+{
+    Command command;
+    while (m_commands.pop(command)) {
+        /* The GUI may be waiting for room */
+        m_roomCondition.notify_one();
+
+        switch (command.type) {
+        case Command::Type::Load:
+            loadMusic(command.path);
+            break;
+        case Command::Type::Rename:
+            renameTrack(command.path, command.otherPath);
+            break;
+        case Command::Type::SetNeighbours:
+            applyNeighbours(command.path, command.otherPath);
+            break;
+        case Command::Type::SetSeekIndex:
+            m_seekIndexes.insert(command.path, command.seekIndex);
+            if (command.path == m_music.path() and not m_music.hasSeekIndex()) {
+                m_music.setSeekIndex(command.seekIndex);
+            }
+            break;
+        case Command::Type::SetReplayGain:
+            m_replayGains.insert(command.path, command.replayGain);
+            if (command.path == (m_sink ? m_decoded.path() : m_music.path())) {
+                applyReplayGain();
+            }
+            break;
+        case Command::Type::Play:
+            if (m_sink and m_decoded.isReady()) {
+                restartPacing();
+                m_sink->setPaused(false);
+                setState(State::Playing);
+                reportPosition(true);
+            } else if (m_music.isReady()) {
+                PlayMusicStream(m_music.music());
+                setState(State::Playing);
+                reportPosition(true);
+            }
+            break;
+        case Command::Type::Pause:
+            if (m_state.load() == State::Playing) {
+                if (m_sink) {
+                    m_sink->setPaused(true);
+                } else {
+                    PauseMusicStream(m_music.music());
+                    /* Resuming brings back only the current track */
+                    finishCrossfade();
+                }
+                setState(State::Paused);
+            }
+            break;
+        case Command::Type::Resume:
+            if (m_state.load() == State::Paused) {
+                if (m_sink) {
+                    restartPacing();
+                    m_sink->setPaused(false);
+                } else {
+                    ResumeMusicStream(m_music.music());
+                }
+                setState(State::Playing);
+            }
+            break;
+        case Command::Type::Stop:
+            if (m_sink) {
+                m_sink->discard();
+            }
+            stopMusic();
+            break;
+        case Command::Type::Seek:
+            seekMusic(command.value);
+            break;
+        case Command::Type::SetLooping:
+            m_looping = command.value != 0.0f;
+            if (m_music.isReady()) {
+                m_music.setLooping(m_looping);
+            }
+            break;
+        case Command::Type::Quit:
+            m_quit = true;
+            return;
+        }
+    }
+}
+
+void PlaybackEngine::loadMusic(const QString &path)
+{
+    TRACE_SCOPE("PlaybackEngine::loadMusic");
+    if (m_sink) {
+        /* A stopped sink may still be playing the end of the last track, that one is heard out */
+        if (m_state.load() != State::Stopped) {
+            m_sink->discard();
+        }
+        if (not m_decoded.isReady() or path != m_decoded.path()) {
+            m_decoded = takeDecoded(path);
+        }
+
+        if (not m_decoded.isReady()) {
+            m_length = 0.0f;
+            emit loadFailed(path);
+            return;
+        }
+
+        m_length = static_cast<float>(m_decoded.frameCount()) / m_decoded.sampleRate();
+        m_cursor = 0;
+        m_position = 0.0f;
+        m_lastSecondReported = -1;
+        setState(State::Stopped);
+        applyReplayGain();
+        emit loaded(path, m_length.load());
+        return;
+    }
+
+    /* Same track again, rewinding it is enough */
+    if (m_music.isReady() and path == m_music.path()) {
+        stopMusic();
+        emit loaded(path, m_length.load());
+        return;
+    }
+
+    releaseMusic();
+
+    MusicHandle music;
+    if (not m_streams.take(path, music)) {
+        music = MusicHandle::load(path, &m_cache);
+    }
+
+    if (not music.isReady()) {
+        m_length = 0.0f;
+        emit loadFailed(path);
+        return;
+    }
+
+    m_music = std::move(music);
+    m_music.setLooping(m_looping);
+    /* Going back to it later, or replaying it, won't need the disk */
+    m_cache.retain(path);
+    m_length = GetMusicTimeLength(m_music.music());
+    m_position = 0.0f;
+    m_lastSecondReported = -1;
+    setState(State::Stopped);
+    attachSeekIndex();
+    applyReplayGain();
+    qDebug() << "Open decoders:" << MusicHandle::openHandles()
+             << "resident KiB:" << MusicHandle::totalResidentBytes() / 1'024
+             << "mapped:" << m_music.isMapped()
+             << "cached:" << m_music.isCached();
+    emit loaded(path, m_length.load());
+}
+
+void PlaybackEngine::unloadMusic()
+{
+    finishCrossfade();
+    if (m_decoded.isReady()) {
+        m_decoded.reset();
+        setState(State::Stopped);
+    }
+
+    if (not m_music.isReady()) {
+        return;
+    }
+
+    m_music.reset();
+    setState(State::Stopped);
+}
+
+void PlaybackEngine::releaseMusic()
+{
+    if (not m_music.isReady()) {
+        return;
+    }
+
+    /* The user is likely to come back to a neighbour, keep its decoder around */
+    if (m_music.path() != m_previousPath and m_music.path() != m_nextPath) {
+        unloadMusic();
+        return;
+    }
+
+    stopMusic();
+    m_streams.store(std::move(m_music));
+}
+
+void PlaybackEngine::renameTrack(const QString &from, const QString &to)
+{
+    /* Whatever has the file open keeps playing it, it's only known by another name now */
+    for (auto *handle : {&m_music, &m_fadingOut}) {
+        if (handle->isReady() and handle->path() == from) {
+            handle->rename(to);
+        }
+    }
+    if (m_decoded.isReady() and m_decoded.path() == from) {
+        m_decoded.rename(to);
+    }
+
+    for (auto *path : {&m_previousPath, &m_nextPath}) {
+        if (*path == from) {
+            *path = to;
+        }
+    }
+
+    if (m_seekIndexes.contains(from)) {
+        m_seekIndexes.insert(to, m_seekIndexes.take(from));
+    }
+    if (m_replayGains.contains(from)) {
+        m_replayGains.insert(to, m_replayGains.take(from));
+    }
+    /* So the index is stored under the name the GUI knows */
+    for (auto &build : m_seekIndexBuilds) {
+        if (build.first == from) {
+            build.first = to;
+        }
+    }
+}
+
+void PlaybackEngine::applyNeighbours(const QString &previous, const QString &next)
+{
+    m_previousPath = previous;
+    m_nextPath = next;
+
+    /* What was sent along for tracks that aren't around anymore */
+    auto current = m_sink ? m_decoded.path() : m_music.path();
+    auto prune = [&](auto &byPath) {
+        for (auto it = byPath.begin(); it != byPath.end();) {
+            if (it.key() == current or it.key() == previous or it.key() == next) {
+                ++it;
+            } else {
+                it = byPath.erase(it);
+            }
+        }
+    };
+    prune(m_seekIndexes);
+    prune(m_replayGains);
+
+    /* Sinks have no decoders to keep open, the next track is decoded whole instead */
+    if (m_sink) {
+        preloadDecoded(next);
+        return;
+    }
+
+    m_streams.keepOnly(previous, next);
+    if (not next.isEmpty() and m_readaheadSeconds > 0.0f) {
+        m_prefetcher.prefetchHead(next, HEAD_PREFETCH_BYTES);
+    }
+
+    /* The next track matters the most, it's the one that starts by itself when this one ends */
+    for (const auto &path : {next, previous}) {
+        m_cache.retain(path);
+        if (path != m_music.path()) {
+            m_streams.preload(path);
+        }
+    }
+}
+
+bool PlaybackEngine::advanceToNext(float fadeSeconds)
+{
+    if (m_nextPath.isEmpty()) {
+        return false;
+    }
+
+    MusicHandle next;
+    if (not m_streams.take(m_nextPath, next)) {
+        return false;
+    }
+
+    /* A short next track would be over before it's all the way in */
+    fadeSeconds = std::min(fadeSeconds, GetMusicTimeLength(next.music()) / 2.0f);
+    auto fadeFrames = static_cast<qint64>(fadeSeconds * DEVICE_SAMPLE_RATE);
+    next.setLooping(m_looping);
+    if (fadeFrames > 0) {
+        TRACE_INSTANT("Crossfade");
+        /* The DSP chain moves to the incoming track's ReplayGain, the outgoing one keeps its own */
+        auto level = m_dsp.gain(m_replayGains.value(m_music.path())) / m_dsp.gain(m_replayGains.value(next.path()));
+        m_crossfade.start(m_music.music().stream, next.music().stream, fadeFrames, level);
+    } else {
+        TRACE_INSTANT("Advance");
+    }
+
+    /* The primed decoder starts on the pump round that noticed the current stream stopped.
+     * That's up to a pump interval after its last samples were queued, so the handover is quick but not
+     * sample exact, the device may play a few milliseconds of silence in between.
+     */
+    PlayMusicStream(next.music());
+
+    /* The finished track becomes the previous one, keep it ready for the previous button */
+    m_previousPath = m_music.path();
+    m_nextPath.clear();
+    if (m_crossfade.isRunning()) {
+        m_fadingOut = std::move(m_music);
+    } else {
+        m_streams.store(std::move(m_music));
+    }
+    m_music = std::move(next);
+    m_length = GetMusicTimeLength(m_music.music());
+    m_position = 0.0f;
+    m_lastSecondReported = -1;
+    attachSeekIndex();
+    applyReplayGain();
+
+    emit advanced(m_music.path());
+    emit loaded(m_music.path(), m_length.load());
+    reportPosition(true);
+    return true;
+}
+
+void PlaybackEngine::finishCrossfade()
+{
+    if (not m_crossfade.isRunning()) {
+        return;
+    }
+
+    /* Silenced before its processor goes, storing it may reopen the stream */
+    if (m_fadingOut.isReady()) {
+        StopMusicStream(m_fadingOut.music());
+    }
+    m_crossfade.finish();
+    m_streams.store(std::move(m_fadingOut));
+}
+
+void PlaybackEngine::attachSeekIndex()
+{
+    if (not m_music.isReady() or m_music.hasSeekIndex()) {
+        return;
+    }
+
+    auto path = m_music.path();
+    auto known = m_seekIndexes.constFind(path);
+    if (known != m_seekIndexes.constEnd()) {
+        m_music.setSeekIndex(known.value());
+        return;
+    }
+
+    /* Only MP3s seek by decoding from the start, and reopening the stream needs the file in memory */
+    if (QFileInfo(path).suffix().toLower() != "mp3" or m_length.load() < SEEK_INDEX_MIN_LENGTH
+        or not (m_music.isMapped() or m_music.isCached())) {
+        return;
+    }
+
+    for (const auto &build : m_seekIndexBuilds) {
+        if (build.first == path) {
+            return;
+        }
+    }
+
+    m_seekIndexBuilds.emplace_back(path, std::async(std::launch::async, [path] { return SeekIndex::build(path); }));
+}
+
+void PlaybackEngine::collectSeekIndexes()
+{
+    for (auto it = m_seekIndexBuilds.begin(); it != m_seekIndexBuilds.end();) {
+        if (it->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            ++it;
+            continue;
+        }
+
+        auto path = it->first;
+        auto index = it->second.get();
+        it = m_seekIndexBuilds.erase(it);
+        if (index.isEmpty()) {
+            continue;
+        }
+
+        m_seekIndexes.insert(path, index);
+        if (path == m_music.path() and not m_music.hasSeekIndex()) {
+            m_music.setSeekIndex(index);
+        }
+
+        /* Stored with the metadata, so it's only ever built once */
+        emit seekIndexBuilt(path, index);
+    }
+}
+
+void PlaybackEngine::applyReplayGain()
+{
+    /* Untagged tracks only get the preamp */
+    auto current = m_sink ? m_decoded.path() : m_music.path();
+    m_dsp.setReplayGain(m_replayGains.value(current));
+}
+
+void PlaybackEngine::stopMusic()
+{
+    finishCrossfade();
+    if (m_sink) {
+        m_cursor = 0;
+        m_position = 0.0f;
+        m_lastSecondReported = -1;
+        setState(State::Stopped);
+        return;
+    }
+
+    if (not m_music.isReady()) {
+        return;
+    }
+
+    /* ResumeMusicStream for StopMusicStream to work properly.
+     * If user pauses the song and afterward stops it, GetMusicTimePlayed
+     * will return the last time played rather than 0.0f.
+     */
+    if (not IsMusicStreamPlaying(m_music.music()))
+        ResumeMusicStream(m_music.music());
+
+    m_music.stop();
+    m_position = 0.0f;
+    m_lastSecondReported = -1;
+    setState(State::Stopped);
+}
+
+void PlaybackEngine::updateMusic()
+{
+    if (m_sink) {
+        updateSink();
+        return;
+    }
+
+    auto started = std::chrono::steady_clock::now();
+    {
+        TRACE_SCOPE("UpdateMusicStream");
+        UpdateMusicStream(m_music.music());
+        if (m_fadingOut.isReady()) {
+            UpdateMusicStream(m_fadingOut.music());
+        }
+    }
+    auto finished = std::chrono::steady_clock::now();
+    auto elapsed = finished - started;
+
+    /* Both sub-buffers were full after the last refill, taking longer than both of them play means
+     * the device ran dry. Shorter gaps may have starved it too, these are only the certain ones.
+     */
+    auto sampleRate = m_music.music().stream.sampleRate;
+    if (m_lastRefill != std::chrono::steady_clock::time_point {} and sampleRate > 0) {
+        std::chrono::duration<double> buffered(2.0 * MusicHandle::bufferFrames() / sampleRate);
+        if (finished - m_lastRefill > buffered) {
+            ++m_underruns;
+            TRACE_COUNTER("Underruns", m_underruns.load());
+        }
+    }
+    m_lastRefill = finished;
+
+    if (elapsed > STALL_THRESHOLD) {
+        ++m_stalls;
+        TRACE_COUNTER("Stalls", m_stalls.load());
+        qDebug() << "Decoder stalled for"
+                 << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << "ms,"
+                 << m_prefetchedSeconds.load() << "s were prefetched.";
+    }
+
+    if (m_fadingOut.isReady() and (m_crossfade.isFinished() or not IsMusicStreamPlaying(m_fadingOut.music()))) {
+        finishCrossfade();
+    }
+
+    if (not IsMusicStreamPlaying(m_music.music())) {
+        /* A stream reopened by a seek can't loop by itself, start over from the beginning of the track */
+        if (m_looping and m_music.timeOffset() > 0.0f) {
+            m_music.stop();
+            PlayMusicStream(m_music.music());
+            reportPosition(true);
+            return;
+        }
+
+        if (advanceToNext()) {
+            return;
+        }
+
+        stopMusic();
+        emit trackFinished();
+        return;
+    }
+
+    /* Close enough to the end, the next track comes in while this one goes. Its decoder was primed
+     * from the cache or a mapping long ago, so starting it doesn't wait for the disk either.
+     */
+    if (m_crossfadeSeconds > 0.0f and not m_looping and not m_fadingOut.isReady()) {
+        auto played = m_music.timePlayed();
+        auto remaining = m_length.load() - played;
+        if (remaining <= m_crossfadeSeconds and remaining <= played and advanceToNext(remaining)) {
+            return;
+        }
+    }
+
+    reportPosition();
+    updateReadahead();
+}
+
+void PlaybackEngine::updateReadahead()
+{
+    auto length = m_length.load();
+    auto fileSize = m_music.fileSize();
+    if (m_music.isCached()) {
+        /* The whole file is in memory already */
+        m_prefetchedSeconds = std::max(length - m_position, 0.0f);
+        return;
+    }
+
+    if (m_readaheadSeconds <= 0.0f or length <= 0.0f or fileSize <= 0) {
+        return;
+    }
+
+    /* Close enough for variable bitrates, the window is many seconds long anyway */
+    auto bytesPerSecond = static_cast<double>(fileSize) / length;
+    auto position = static_cast<qint64>(m_position * bytesPerSecond);
+    auto end = std::min(fileSize, position + static_cast<qint64>(m_readaheadSeconds * bytesPerSecond));
+    m_prefetcher.setWindow(m_music.path(), position, end);
+
+    auto prefetched = m_prefetcher.readUntil(m_music.path()) - position;
+    m_prefetchedSeconds = static_cast<float>(std::max<qint64>(prefetched, 0) / bytesPerSecond);
+}
+
+void PlaybackEngine::seekMusic(float seconds)
+{
+    if (m_sink) {
+        if (m_decoded.isReady()) {
+            auto frame = static_cast<qint64>(seconds * m_decoded.sampleRate());
+            m_cursor = static_cast<unsigned int>(std::clamp<qint64>(frame, 0, m_decoded.frameCount()));
+            m_sink->discard();
+            restartPacing();
+            reportPosition(true);
+        }
+        return;
+    }
+
+    if (not m_music.isReady()) {
+        return;
+    }
+
+    TRACE_SCOPE("PlaybackEngine::seekMusic");
+    finishCrossfade();
+
+    /* With a long decode-ahead buffer the old position would keep playing until it drains,
+     * restarting the stream drops whatever was queued.
+     */
+    auto state = m_state.load();
+    auto &music = m_music.music();
+    if (not IsMusicStreamPlaying(music)) {
+        ResumeMusicStream(music);
+    }
+    StopMusicStream(music);
+    /* MP3s with an index reopen the stream close to the target, music still refers to it */
+    m_music.seek(seconds);
+
+    if (state != State::Stopped) {
+        PlayMusicStream(music);
+        if (state == State::Paused) {
+            PauseMusicStream(music);
+        }
+        UpdateMusicStream(music);
+    }
+
+    reportPosition(true);
+    updateReadahead();
+}
+
+void PlaybackEngine::setState(State state)
+{
+    auto previous = m_state.exchange(state);
+    if (state != State::Playing) {
+        m_lastRefill = {};
+    }
+    publishClock();
+    if (previous != state) {
+        emit stateChanged(state);
+    }
+}
+
+void PlaybackEngine::publishClock()
+{
+    /* Only a running clock has audio in flight */
+    bool running = m_state.load() == State::Playing;
+    auto latency = m_sink ? 0.0f : OUTPUT_LATENCY;
+    auto position = running ? std::max(m_position - latency, 0.0f) : m_position;
+    m_clock.publish(position, running, m_length.load());
+}
+
+void PlaybackEngine::reportPosition(bool force)
+{
+    if (m_sink) {
+        /* What's still queued in the sink wasn't heard yet, right after an advance that's the previous track's end */
+        auto played = std::max<qint64>(m_cursor - m_sink->framesQueued(), 0);
+        m_position = m_decoded.isReady() ? static_cast<float>(played) / m_decoded.sampleRate() : 0.0f;
+    } else {
+        /* raylib counts what the mixer consumed, not what was decoded */
+        m_position = m_music.timePlayed();
+    }
+    publishClock();
+
+    /* The GUI only shows whole seconds, there's no point in flooding it */
+    auto heard = static_cast<float>(m_clock.position());
+    auto second = static_cast<int>(heard);
+    if (force or second != m_lastSecondReported) {
+        m_lastSecondReported = second;
+        emit positionChanged(heard);
+    }
+}
+
+void PlaybackEngine::restartPacing()
+{
+    m_paceStart = std::chrono::steady_clock::now();
+    m_paceFrames = 0;
+}
+
+void PlaybackEngine::updateSink()
+{
+    TRACE_SCOPE("PlaybackEngine::updateSink");
+    auto sampleRate = m_decoded.sampleRate();
+    /* The sound card sets its own pace, each round refills what it played since the last one */
+    auto due = m_sink->framesWritable();
+    if (due < 0 and m_sinkSpeed <= 0.0f) {
+        /* A tenth of a second per round, so commands are still seen in between */
+        due = sampleRate / 10;
+    } else if (due < 0) {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - m_paceStart;
+        due = static_cast<qint64>(elapsed.count() * sampleRate * m_sinkSpeed) - m_paceFrames;
+    }
+
+    while (due > 0) {
+        auto remaining = static_cast<qint64>(m_decoded.frameCount()) - m_cursor;
+        if (remaining <= 0) {
+            if (m_looping) {
+                m_cursor = 0;
+                continue;
+            }
+
+            /* The next track's first frame follows this one's last frame right away */
+            if (advanceDecoded()) {
+                continue;
+            }
+
+            stopMusic();
+            emit trackFinished();
+            return;
+        }
+
+        auto count = static_cast<int>(std::min(due, remaining));
+        const void *frames = m_decoded.frames(m_cursor);
+        if (m_dsp.isActive()) {
+            const auto *samples = static_cast<const qint16 *>(frames);
+            m_sinkFrames.assign(samples, samples + static_cast<size_t>(count) * m_sinkFormat.channels);
+            m_dsp.process(m_sinkFrames.data(), static_cast<unsigned int>(count));
+            frames = m_sinkFrames.data();
+        }
+        m_sink->write(frames, count);
+        m_cursor += count;
+        m_paceFrames += count;
+        due -= count;
+    }
+
+    reportPosition();
+}
+
+bool PlaybackEngine::advanceDecoded()
+{
+    if (m_nextPath.isEmpty()) {
+        return false;
+    }
+
+    auto next = takeDecoded(m_nextPath);
+    if (not next.isReady()) {
+        return false;
+    }
+
+    m_previousPath = m_decoded.path();
+    m_nextPath.clear();
+    m_decoded = std::move(next);
+    m_cursor = 0;
+    m_length = static_cast<float>(m_decoded.frameCount()) / m_decoded.sampleRate();
+    m_lastSecondReported = -1;
+    applyReplayGain();
+
+    emit advanced(m_decoded.path());
+    emit loaded(m_decoded.path(), m_length.load());
+    return true;
+}
+
+void PlaybackEngine::preloadDecoded(const QString &path)
+{
+    if (path.isEmpty() or path == m_decodingPath or path == m_decoded.path()) {
+        return;
+    }
+
+    /* A future from std::async waits for its task when it's destroyed, the old one is dropped once it's done */
+    if (m_decoding.valid()) {
+        m_abandonedDecodes.push_back(std::move(m_decoding));
+    }
+
+    m_decodingPath = path;
+    m_decoding = std::async(std::launch::async, [path, format = m_sinkFormat] { return DecodedTrack::load(path, format); });
+}
+
+DecodedTrack PlaybackEngine::takeDecoded(const QString &path)
+{
+    if (path != m_decodingPath or not m_decoding.valid()) {
+        return DecodedTrack::load(path, m_sinkFormat);
+    }
+
+    /* It's already on its way, waiting for it is still faster than starting over */
+    m_decodingPath.clear();
+    return m_decoding.get();
+}
+
+void PlaybackEngine::collectDecoded()
+{
+    m_abandonedDecodes.erase(std::remove_if(m_abandonedDecodes.begin(), m_abandonedDecodes.end(), [](std::future<DecodedTrack> &pending) {
+        if (pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return false;
+        }
+
+        pending.get();
+        return true;
+    }), m_abandonedDecodes.end());
+}
@@ -0,0 +1,169 @@
+#ifndef PLAYBACKENGINE_HPP
+#define PLAYBACKENGINE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <QHash>
+#include <QString>
+#include <QThread>
+#include <vector>
+
+#include "audiocache.hpp"
+#include "audiosink.hpp"
+#include "commandqueue.hpp"
+#include "crossfade.hpp"
+#include "decodedtrack.hpp"
+#include "dspchain.hpp"
+#include "musichandle.hpp"
+#include "playbackclock.hpp"
+#include "prefetcher.hpp"
+#include "seekindex.hpp"
+#include "streammanager.hpp"
+
+/* Owns the raylib audio device and the music stream on its own thread.
+ * The GUI thread only posts commands and listens to the signals, it never touches the stream.
+ * With a sink set, there are no music streams: tracks are decoded whole and written to the sink
+ * at the configured speed, or as fast as the sound card plays them for the gapless one.
+ * The thread, and the device with it, is started by the first command posted.
+ */
+class PlaybackEngine : public QThread
+{
+    Q_OBJECT
+public:
+    enum class State { Stopped, Playing, Paused };
+    Q_ENUM(State)
+private:
+    struct Command
+    {
+        enum class Type { Load, Rename, SetNeighbours, SetSeekIndex, SetReplayGain, Play, Pause, Resume, Stop, Seek, SetLooping, Quit };
+        Type type {Type::Stop};
+        QString path {};
+        float value {};
+        QString otherPath {};
+        SeekIndex seekIndex {};
+        ReplayGain replayGain {};
+    };
+
+    CommandQueue<Command, 64> m_commands;
+    std::mutex m_wakeMutex;
+    std::condition_variable m_wakeCondition;
+    bool m_wakePending;
+    /* Signalled whenever the playback thread took commands out of a full queue */
+    std::condition_variable m_roomCondition;
+    /* Only touched from the playback thread */
+    MusicHandle m_music;
+    /* The previous track while it fades out under the current one */
+    MusicHandle m_fadingOut;
+    Crossfade m_crossfade;
+    float m_crossfadeSeconds;
+    /* Before the stream manager, its preloads read from it */
+    AudioCache m_cache;
+    StreamManager m_streams;
+    Prefetcher m_prefetcher;
+    float m_readaheadSeconds;
+    std::unique_ptr<AudioSink> m_sink;
+    AudioSink::Format m_sinkFormat;
+    float m_sinkSpeed;
+    DecodedTrack m_decoded;
+    /* The next track, decoded in the background so advancing doesn't wait for it */
+    QString m_decodingPath;
+    std::future<DecodedTrack> m_decoding;
+    std::vector<std::future<DecodedTrack>> m_abandonedDecodes;
+    unsigned int m_cursor;
+    /* What's written to the sink when the DSP chain changes it */
+    std::vector<qint16> m_sinkFrames;
+    DspChain m_dsp;
+    std::chrono::steady_clock::time_point m_paceStart;
+    /* When the device was last refilled, unset while it isn't playing */
+    std::chrono::steady_clock::time_point m_lastRefill;
+    qint64 m_paceFrames;
+    QString m_previousPath;
+    QString m_nextPath;
+    /* Indexes of the current track and its neighbours, and the ones being built */
+    QHash<QString, SeekIndex> m_seekIndexes;
+    std::vector<std::pair<QString, std::future<SeekIndex>>> m_seekIndexBuilds;
+    QHash<QString, ReplayGain> m_replayGains;
+    bool m_looping;
+    bool m_quit;
+    int m_lastSecondReported;
+    /* Where the decoder is, the clock subtracts what's still on its way to the speakers */
+    float m_position;
+    /* Published to the GUI thread */
+    std::atomic<State> m_state;
+    PlaybackClock m_clock;
+    std::atomic<float> m_length;
+    std::atomic<float> m_prefetchedSeconds;
+    std::atomic<int> m_stalls;
+    std::atomic<int> m_underruns;
+
+    void post(Command command);
+    void processCommands();
+    void loadMusic(const QString &path);
+    void unloadMusic();
+    void releaseMusic();
+    void renameTrack(const QString &from, const QString &to);
+    void applyNeighbours(const QString &previous, const QString &next);
+    bool advanceToNext(float fadeSeconds = 0.0f);
+    void finishCrossfade();
+    void attachSeekIndex();
+    void collectSeekIndexes();
+    void applyReplayGain();
+    void stopMusic();
+    void updateMusic();
+    void updateReadahead();
+    void updateSink();
+    bool advanceDecoded();
+    void preloadDecoded(const QString &path);
+    DecodedTrack takeDecoded(const QString &path);
+    void collectDecoded();
+    void restartPacing();
+    void seekMusic(float seconds);
+    void setState(State state);
+    void reportPosition(bool force = false);
+    void publishClock();
+protected:
+    void run() override;
+public:
+    explicit PlaybackEngine(QObject *parent = nullptr);
+    ~PlaybackEngine();
+    void load(QString path);
+    void renamePath(QString from, QString to);
+    void setNeighbours(QString previous, QString next);
+    void setSeekIndex(QString path, SeekIndex index);
+    void setReplayGain(QString path, ReplayGain replayGain);
+    void play();
+    void pause();
+    void resume();
+    void stop();
+    void seek(float seconds);
+    void setLooping(bool looping);
+    void setStreamLimits(StreamManager::Limits limits);
+    void setBuffering(float decodeAheadSeconds, float readaheadSeconds);
+    void setSink(std::unique_ptr<AudioSink> sink, float speed);
+    void setProcessing(const DspChain::Config &config);
+    void setCrossfade(float seconds);
+    void setAudioCacheBudget(qint64 bytes);
+    void shutdown();
+    State state() const;
+    float timePlayed() const;
+    const PlaybackClock &clock() const;
+    float length() const;
+    float prefetchedSeconds() const;
+    int stalls() const;
+    int underruns() const;
+    qint64 audioCacheBytes() const;
+signals:
+    void loaded(QString path, float length);
+    void advanced(QString path);
+    void loadFailed(QString path);
+    void stateChanged(PlaybackEngine::State state);
+    void positionChanged(float seconds);
+    void trackFinished();
+    void seekIndexBuilt(QString path, SeekIndex index);
+};
+
+#endif // PLAYBACKENGINE_HPP
@@ -0,0 +1,145 @@
+#include <algorithm>
+#include <cmath>
+#include <QGuiApplication>
+#include <QScreen>
+
+#include "playbackpresenter.hpp"
+
+/* Longer tracks are rare, their texts are formatted on the spot */
+static constexpr int MAX_CACHED_SECONDS {2 * 60 * 60};
+
+PlaybackPresenter::PlaybackPresenter(const PlaybackClock *clock, QLabel *timeLabel, QLabel *lengthLabel,
+                                     QSlider *slider, QPushButton *playPauseButton, QObject *parent)
+    : QObject(parent)
+    , m_clock(clock)
+    , m_timeLabel(timeLabel)
+    , m_lengthLabel(lengthLabel)
+    , m_slider(slider)
+    , m_playPauseButton(playPauseButton)
+    , m_frameInterval(16)
+    , m_shownSecond(-1)
+    , m_shownLength(-1)
+    , m_shownPlaying(false)
+{
+    if (auto *screen = QGuiApplication::primaryScreen(); screen != nullptr and screen->refreshRate() > 0) {
+        m_frameInterval = static_cast<int>(std::ceil(1'000.0 / screen->refreshRate()));
+    }
+
+    m_timer.setSingleShot(true);
+    m_timer.setTimerType(Qt::PreciseTimer);
+    connect(&m_timer, &QTimer::timeout, this, &PlaybackPresenter::refresh);
+}
+
+const QString &PlaybackPresenter::durationText(int seconds)
+{
+    static QString uncached;
+    seconds = std::max(seconds, 0);
+
+    if (seconds < static_cast<int>(m_durationTexts.size()) and not m_durationTexts[seconds].isNull()) {
+        return m_durationTexts[seconds];
+    }
+
+    QString text {};
+    auto minutes = seconds / 60;
+    if (minutes >= 60) {
+        text = tr("%1h, %2m, %3s")
+                   .arg(QString::number(minutes / 60), QString::number(minutes % 60), QString::number(seconds % 60));
+    } else if (minutes > 0) {
+        text = tr("%1m, %2s").arg(QString::number(minutes), QString::number(seconds % 60));
+    } else {
+        text = tr("%1s").arg(QString::number(seconds));
+    }
+
+    if (seconds >= MAX_CACHED_SECONDS) {
+        uncached = text;
+        return uncached;
+    }
+
+    if (seconds >= static_cast<int>(m_durationTexts.size())) {
+        m_durationTexts.resize(seconds + 1);
+    }
+    m_durationTexts[seconds] = text;
+    return m_durationTexts[seconds];
+}
+
+void PlaybackPresenter::setLength(float length)
+{
+    auto seconds = static_cast<int>(length);
+    if (seconds == m_shownLength) {
+        return;
+    }
+
+    m_shownLength = seconds;
+    m_lengthLabel->setText(durationText(seconds));
+    m_slider->setMaximum(seconds);
+}
+
+void PlaybackPresenter::showPosition(float seconds)
+{
+    showSecond(static_cast<int>(seconds));
+}
+
+void PlaybackPresenter::reset(bool resetLength)
+{
+    m_timer.stop();
+    showPlaying(false);
+    m_slider->setSingleStep(0);
+    showSecond(0);
+
+    if (resetLength) {
+        m_shownLength = -1;
+        m_lengthLabel->setText("0m");
+    }
+}
+
+void PlaybackPresenter::onStateChanged(PlaybackEngine::State state)
+{
+    showPlaying(state == PlaybackEngine::State::Playing);
+    if (state == PlaybackEngine::State::Stopped) {
+        m_timer.stop();
+        showSecond(0);
+        return;
+    }
+
+    refresh();
+}
+
+void PlaybackPresenter::refresh()
+{
+    auto position = m_clock->position();
+    showSecond(static_cast<int>(position));
+
+    if (m_clock->isRunning()) {
+        schedule(position);
+    }
+}
+
+void PlaybackPresenter::schedule(double position)
+{
+    /* Wake up right after the next second starts, but never more often than the screen can show */
+    auto untilNextSecond = static_cast<int>(std::ceil((std::floor(position) + 1.0 - position) * 1'000.0));
+    m_timer.start(std::max(untilNextSecond, m_frameInterval));
+}
+
+void PlaybackPresenter::showSecond(int second)
+{
+    if (second != m_shownSecond) {
+        m_shownSecond = second;
+        m_timeLabel->setText(durationText(second));
+    }
+
+    /* Don't fight the user while they're dragging the slider */
+    if (not m_slider->isSliderDown() and m_slider->value() != second) {
+        m_slider->setValue(second);
+    }
+}
+
+void PlaybackPresenter::showPlaying(bool playing)
+{
+    if (playing == m_shownPlaying) {
+        return;
+    }
+
+    m_shownPlaying = playing;
+    m_playPauseButton->setText(playing ? tr("Pause") : tr("Play"));
+}
@@ -0,0 +1,48 @@
+#ifndef PLAYBACKPRESENTER_HPP
+#define PLAYBACKPRESENTER_HPP
+
+#include <QLabel>
+#include <QObject>
+#include <QPushButton>
+#include <QSlider>
+#include <QTimer>
+#include <vector>
+
+#include "playbackclock.hpp"
+#include "playbackengine.hpp"
+
+/* Shows the playback state in the widgets. It samples the clock no more often than the screen refreshes,
+ * and in practice only when the shown second changes, and it only touches a widget when
+ * what it shows is different. Duration texts are formatted once and reused.
+ */
+class PlaybackPresenter : public QObject
+{
+    Q_OBJECT
+    const PlaybackClock *m_clock;
+    QLabel *m_timeLabel;
+    QLabel *m_lengthLabel;
+    QSlider *m_slider;
+    QPushButton *m_playPauseButton;
+    QTimer m_timer;
+    int m_frameInterval;
+    int m_shownSecond;
+    int m_shownLength;
+    bool m_shownPlaying;
+    std::vector<QString> m_durationTexts;
+
+    void schedule(double position);
+    void showSecond(int second);
+    void showPlaying(bool playing);
+public:
+    PlaybackPresenter(const PlaybackClock *clock, QLabel *timeLabel, QLabel *lengthLabel,
+                      QSlider *slider, QPushButton *playPauseButton, QObject *parent = nullptr);
+    const QString &durationText(int seconds);
+    void setLength(float length);
+    void showPosition(float seconds);
+    void reset(bool resetLength = true);
+public slots:
+    void onStateChanged(PlaybackEngine::State state);
+    void refresh();
+};
+
+#endif // PLAYBACKPRESENTER_HPP
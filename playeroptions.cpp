@@ -0,0 +1,174 @@
+#include <QCommandLineParser>
+#include <QDebug>
+
+#include "playeroptions.hpp"
+
+PlayerOptions PlayerOptions::parse(const QCoreApplication &app)
+{
+    PlayerOptions options;
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QCoreApplication::translate("PlayerOptions", "Music Player written in C++"));
+    parser.addHelpOption();
+    parser.addVersionOption();
+
+    QCommandLineOption maxDecodersOption("max-decoders",
+                                         QCoreApplication::translate("PlayerOptions", "Maximum number of open decoders."),
+                                         "count",
+                                         QString::number(options.streamLimits.maxOpenDecoders));
+    QCommandLineOption maxStreamMemoryOption("max-stream-memory",
+                                             QCoreApplication::translate("PlayerOptions", "Maximum memory used by open decoders, in MiB."),
+                                             "mib",
+                                             QString::number(options.streamLimits.maxResidentBytes / (1'024 * 1'024)));
+    QCommandLineOption maxMapSizeOption("max-map-size",
+                                        QCoreApplication::translate("PlayerOptions", "Largest file decoded from a memory mapping, in MiB. 0 disables mapping."),
+                                        "mib",
+                                        QString::number(options.maxMappedBytes / (1'024 * 1'024)));
+    QCommandLineOption audioCacheOption("audio-cache",
+                                        QCoreApplication::translate("PlayerOptions", "Memory for recently played and neighbouring files, in MiB. 0 disables it."),
+                                        "mib",
+                                        QString::number(options.audioCacheBytes / (1'024 * 1'024)));
+    QCommandLineOption decodeAheadOption("decode-ahead",
+                                         QCoreApplication::translate("PlayerOptions", "Decoded audio buffered ahead of the device, in seconds."),
+                                         "seconds",
+                                         QString::number(options.decodeAheadSeconds));
+    QCommandLineOption readaheadOption("readahead",
+                                       QCoreApplication::translate("PlayerOptions", "File data read ahead of the decoder, in seconds of music. 0 disables it."),
+                                       "seconds",
+                                       QString::number(options.readaheadSeconds));
+    QCommandLineOption sinkOption("sink",
+                                  QCoreApplication::translate("PlayerOptions", "Where audio goes: device, gapless, null or wav. gapless plays through the sound card from tracks decoded whole."),
+                                  "sink",
+                                  "device");
+    QCommandLineOption sinkFileOption("sink-file",
+                                      QCoreApplication::translate("PlayerOptions", "File written by the wav sink."),
+                                      "path",
+                                      options.sinkPath);
+    QCommandLineOption sinkSpeedOption("sink-speed",
+                                       QCoreApplication::translate("PlayerOptions", "Playback speed of the null and wav sinks, 0 is as fast as possible. The gapless sink plays in real time."),
+                                       "factor",
+                                       QString::number(options.sinkSpeed));
+    QCommandLineOption crossfadeOption("crossfade",
+                                       QCoreApplication::translate("PlayerOptions", "Seconds the end of a track overlaps the start of the next one. 0 plays them back to back, only the gapless sink leaves no silence in between."),
+                                       "seconds",
+                                       QString::number(options.crossfadeSeconds));
+    QCommandLineOption preampOption("preamp",
+                                    QCoreApplication::translate("PlayerOptions", "Gain added to every track, in dB."),
+                                    "db",
+                                    QString::number(options.processing.preamp));
+    QCommandLineOption replayGainOption("replaygain",
+                                        QCoreApplication::translate("PlayerOptions", "ReplayGain tags applied: off, track or album."),
+                                        "mode",
+                                        "track");
+    QCommandLineOption eqOption("eq",
+                                QCoreApplication::translate("PlayerOptions", "Equalizer bands as frequency:gain:q, separated by commas. Gains are in dB."),
+                                "bands");
+    parser.addOption(maxDecodersOption);
+    parser.addOption(maxStreamMemoryOption);
+    parser.addOption(maxMapSizeOption);
+    parser.addOption(audioCacheOption);
+    parser.addOption(decodeAheadOption);
+    parser.addOption(readaheadOption);
+    parser.addOption(sinkOption);
+    parser.addOption(sinkFileOption);
+    parser.addOption(sinkSpeedOption);
+    parser.addOption(crossfadeOption);
+    parser.addOption(preampOption);
+    parser.addOption(replayGainOption);
+    parser.addOption(eqOption);
+#ifdef BITMPLAYER_TRACING
+    QCommandLineOption traceOption("trace",
+                                   QCoreApplication::translate("PlayerOptions", "Write a Chrome trace of this session here on exit."),
+                                   "path");
+    parser.addOption(traceOption);
+#endif
+    parser.process(app);
+
+    bool ok {};
+    auto maxDecoders = parser.value(maxDecodersOption).toInt(&ok);
+    /* The current track plus at least one neighbour */
+    if (ok and maxDecoders >= 2) {
+        options.streamLimits.maxOpenDecoders = maxDecoders;
+    }
+
+    auto maxStreamMemory = parser.value(maxStreamMemoryOption).toLongLong(&ok);
+    if (ok and maxStreamMemory > 0) {
+        options.streamLimits.maxResidentBytes = maxStreamMemory * 1'024 * 1'024;
+    }
+
+    auto maxMapSize = parser.value(maxMapSizeOption).toLongLong(&ok);
+    if (ok and maxMapSize >= 0) {
+        options.maxMappedBytes = maxMapSize * 1'024 * 1'024;
+    }
+
+    auto audioCache = parser.value(audioCacheOption).toLongLong(&ok);
+    if (ok and audioCache >= 0) {
+        options.audioCacheBytes = audioCache * 1'024 * 1'024;
+    }
+
+    /* Below raylib's own 33 ms the device underruns */
+    auto decodeAhead = parser.value(decodeAheadOption).toFloat(&ok);
+    if (ok and decodeAhead >= 0.05f) {
+        options.decodeAheadSeconds = decodeAhead;
+    }
+
+    auto readahead = parser.value(readaheadOption).toFloat(&ok);
+    if (ok and readahead >= 0.0f) {
+        options.readaheadSeconds = readahead;
+    }
+
+    auto sink = parser.value(sinkOption).toLower();
+    if (sink == "gapless") {
+        options.sinkKind = AudioSink::Kind::GaplessDevice;
+    } else if (sink == "null") {
+        options.sinkKind = AudioSink::Kind::Null;
+    } else if (sink == "wav") {
+        options.sinkKind = AudioSink::Kind::WavFile;
+    }
+
+    options.sinkPath = parser.value(sinkFileOption);
+    auto sinkSpeed = parser.value(sinkSpeedOption).toFloat(&ok);
+    if (ok and sinkSpeed >= 0.0f) {
+        options.sinkSpeed = sinkSpeed;
+    }
+
+    auto crossfade = parser.value(crossfadeOption).toFloat(&ok);
+    if (ok and crossfade >= 0.0f) {
+        options.crossfadeSeconds = crossfade;
+    }
+
+    auto preamp = parser.value(preampOption).toFloat(&ok);
+    if (ok) {
+        options.processing.preamp = preamp;
+    }
+
+    auto replayGain = parser.value(replayGainOption).toLower();
+    if (replayGain == "off") {
+        options.processing.replayGainMode = DspChain::ReplayGainMode::Off;
+    } else if (replayGain == "album") {
+        options.processing.replayGainMode = DspChain::ReplayGainMode::Album;
+    }
+
+    for (const auto &band : parser.value(eqOption).split(',', Qt::SkipEmptyParts)) {
+        auto fields = band.split(':');
+        bool frequencyOk {};
+        bool gainOk {};
+        bool qOk {true};
+        DspChain::Band parsed {};
+        parsed.frequency = fields.value(0).toFloat(&frequencyOk);
+        parsed.gain = fields.value(1).toFloat(&gainOk);
+        /* A Q of 1 is about an octave and a third wide */
+        parsed.q = fields.size() > 2 ? fields.at(2).toFloat(&qOk) : 1.0f;
+        if (frequencyOk and gainOk and qOk and options.processing.bands.size() < DspChain::MAX_BANDS) {
+            options.processing.bands.append(parsed);
+        } else {
+            qWarning() << "Ignoring equalizer band" << band;
+        }
+    }
+
+#ifdef BITMPLAYER_TRACING
+    options.tracePath = parser.value(traceOption);
+#endif
+
+    return options;
+}
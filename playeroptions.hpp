@@ -0,0 +1,37 @@
+#ifndef PLAYEROPTIONS_HPP
+#define PLAYEROPTIONS_HPP
+
+#include <QCoreApplication>
+
+#include "audiosink.hpp"
+#include "dspchain.hpp"
+#include "streammanager.hpp"
+
+/* Everything that can be tuned from the command line */
+struct PlayerOptions
+{
+    StreamManager::Limits streamLimits {};
+    /* Bigger files are read by the decoders instead of being mapped, 0 never maps */
+    qint64 maxMappedBytes {1'024ll * 1'024 * 1'024};
+    /* Whole files of recent and neighbouring tracks kept in memory, 0 disables it */
+    qint64 audioCacheBytes {256ll * 1'024 * 1'024};
+    /* Decoded audio queued for the device, covers short stalls of the decoder */
+    float decodeAheadSeconds {1.0f};
+    /* File data kept in memory ahead of the decoder, covers long stalls of the storage. 0 disables it */
+    float readaheadSeconds {30.0f};
+    /* Anything but the device and the gapless sink plays without a sound card */
+    AudioSink::Kind sinkKind {AudioSink::Kind::Device};
+    QString sinkPath {"BitMPlayer.wav"};
+    /* 1 is real time, 0 is as fast as the decoders go */
+    float sinkSpeed {1.0f};
+    /* Overlap between consecutive tracks, 0 plays them back to back with a few milliseconds in between on the device */
+    float crossfadeSeconds {0.0f};
+    /* ReplayGain, preamp and EQ applied to everything that's played */
+    DspChain::Config processing {};
+    /* Chrome trace written on exit, only builds with BITMPLAYER_TRACING record one */
+    QString tracePath {};
+
+    static PlayerOptions parse(const QCoreApplication &app);
+};
+
+#endif // PLAYEROPTIONS_HPP
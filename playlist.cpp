@@ -1,5 +1,7 @@
+#include <QDebug>
 #include <QDir>
 #include <QEventLoop>
+#include <QFile>
 #include <QStandardPaths>
 
 #include "playlist.hpp"
@@ -8,18 +10,42 @@
 Playlist::Playlist(QWidget *parent)
     : QObject(parent)
     , m_parent(parent)
+    , m_configDirectory(QString("%1%2%3")
+                            .arg(QStandardPaths::writableLocation(QStandardPaths::ConfigLocation),
+                                 QDir::separator(), PROGRAM_NAME))
+    , m_store(QString("%1%2%3").arg(m_configDirectory, QDir::separator(), "playlists.bin"))
+    , m_opened(false)
 {
-    m_configFile = QString("%1%2%3%4%5")
-                       .arg(QStandardPaths::writableLocation(QStandardPaths::ConfigLocation),
-                            QDir::separator(), PROGRAM_NAME, QDir::separator(), PROGRAM_NAME".ini");
-    m_settings = new QSettings(m_configFile, QSettings::IniFormat, this);
 }
 
-std::map<QString, QString> Playlist::openPlayList()
+PlaylistStore &Playlist::store()
 {
-    std::map<QString, QString> playlist;
+    /* Nobody needs the playlists to start up */
+    if (m_opened) {
+        return m_store;
+    }
+    m_opened = true;
+
+    /* Playlists used to live in the INI file, move them over once */
+    auto iniFile = QString("%1%2%3").arg(m_configDirectory, QDir::separator(), PROGRAM_NAME".ini");
+    if (not m_store.exists() and QFile::exists(iniFile)) {
+        if (m_store.importIni(iniFile)) {
+            qDebug() << "Playlists migrated from" << iniFile;
+        }
+    }
+
+    m_store.open();
+    return m_store;
+}
 
-    auto playlistNames = m_settings->childGroups();
+const QString &Playlist::configDirectory() const
+{
+    return m_configDirectory;
+}
+
+QStringList Playlist::openPlayList()
+{
+    auto playlistNames = store().names();
     QEventLoop loop;
     PlaylistSelector selector(playlistNames);
     connect(&selector, &PlaylistSelector::closed, &loop, &QEventLoop::quit);
@@ -31,19 +57,13 @@ std::map<QString, QString> Playlist::openPlayList()
         return {};
     }
 
-    m_settings->beginGroup(playlistName[0]); /* PlaylistSelector will return a QStringList with just one QString */
-    for (auto key : m_settings->childKeys()) {
-        playlist[key] = m_settings->value(key).toString();
-    }
-    m_settings->endGroup();
-
-    return playlist;
+    /* PlaylistSelector will return a QStringList with just one QString */
+    return store().tracks(playlistName[0]);
 }
 
 int Playlist::removePlaylists()
 {
-    int removed {};
-    auto playlistNames = m_settings->childGroups();
+    auto playlistNames = store().names();
     QEventLoop loop;
     PlaylistSelector selector(playlistNames, QAbstractItemView::MultiSelection);
     connect(&selector, &PlaylistSelector::closed, &loop, &QEventLoop::quit);
@@ -52,25 +72,32 @@ int Playlist::removePlaylists()
 
     auto selection = selector.getSelection();
     if (selection.isEmpty()) {
-        goto exit;
+        return 0;
     }
 
-    for (auto group : selection) {
-        m_settings->beginGroup(group);
-        m_settings->remove("");
-        m_settings->endGroup();
-        ++removed;
+    return store().remove(selection);
+}
+
+void Playlist::savePlayList(QString playlistName, QStringList songs)
+{
+    store().save(playlistName, songs);
+}
+
+QStringList Playlist::directories() const
+{
+    /* Saved playlists are only watched once something read them, starting up never does */
+    if (not m_opened) {
+        return {};
     }
 
-exit:
-    return removed;
+    return m_store.directories();
 }
 
-void Playlist::savePlayList(QString playlistName, std::map<QString, QString> songs)
+int Playlist::renamePaths(const QHash<QString, QString> &renamed)
 {
-    m_settings->beginGroup(playlistName);
-    for (const auto [songName, filePath] : songs) {
-        m_settings->setValue(songName, filePath);
+    if (renamed.isEmpty()) {
+        return 0;
     }
-    m_settings->endGroup();
+
+    return store().renamePaths(renamed);
 }
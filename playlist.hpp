@@ -1,22 +1,29 @@
 #ifndef PLAYLIST_HPP
 #define PLAYLIST_HPP
 
-#include <map>
 #include <QObject>
-#include <QSettings>
+#include <QStringList>
 #include <QWidget>
 
+#include "playliststore.hpp"
+
 class Playlist : public QObject
 {
     Q_OBJECT
     QWidget *m_parent;
-    QString m_configFile;
-    QSettings *m_settings;
+    QString m_configDirectory;
+    PlaylistStore m_store;
+    bool m_opened;
+
+    PlaylistStore &store();
 public:
     explicit Playlist(QWidget *parent = nullptr);
-    std::map<QString, QString> openPlayList();
+    const QString &configDirectory() const;
+    QStringList openPlayList();
     int removePlaylists();
-    void savePlayList(QString playlistName, std::map<QString, QString> songs);
+    void savePlayList(QString playlistName, QStringList songs);
+    QStringList directories() const;
+    int renamePaths(const QHash<QString, QString> &renamed);
 };
 
 #endif // PLAYLIST_HPP
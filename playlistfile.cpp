@@ -0,0 +1,321 @@
+#include <algorithm>
+#include <cmath>
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QUrl>
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
+
+#include "folderscanner.hpp"
+#include "playlistfile.hpp"
+#include "tracer.hpp"
+
+/* What's written is handed to the file in pieces of this size */
+static constexpr int WRITE_CHUNK {64 * 1'024};
+static constexpr char UTF8_BOM[] {"\xEF\xBB\xBF"};
+
+/* The path a playlist line refers to, empty when it isn't a local song */
+static QString resolve(const QDir &base, QString location)
+{
+    location = location.trimmed();
+    if (location.isEmpty()) {
+        return {};
+    }
+
+    if (location.contains("://")) {
+        QUrl url(location);
+        if (not url.isLocalFile()) {
+            return {};
+        }
+        location = url.toLocalFile();
+    } else {
+        /* Playlists written on Windows use backslashes, fromNativeSeparators only turns them around there */
+        location = QDir::fromNativeSeparators(location).replace('\\', '/');
+    }
+
+    auto path = QDir::cleanPath(base.absoluteFilePath(location));
+    return FolderScanner::isSupported(path) ? path : QString();
+}
+
+static bool readM3u(QFile &file, const QDir &base, bool utf8, const PlaylistFile::EntryHandler &handler)
+{
+    float duration {};
+    bool first {true};
+    while (not file.atEnd()) {
+        auto line = file.readLine();
+        if (first and line.startsWith(UTF8_BOM)) {
+            line.remove(0, 3);
+        }
+        first = false;
+
+        line = line.trimmed();
+        if (line.isEmpty()) {
+            continue;
+        }
+
+        /* #EXTINF:<seconds>,<title>, -1 for unknown */
+        if (line.startsWith('#')) {
+            if (line.startsWith("#EXTINF:")) {
+                auto comma = line.indexOf(',');
+                duration = std::max(line.mid(8, comma < 0 ? -1 : comma - 8).trimmed().toFloat(), 0.0f);
+            }
+            continue;
+        }
+
+        auto path = resolve(base, utf8 ? QString::fromUtf8(line) : QString::fromLocal8Bit(line));
+        if (not path.isEmpty() and not handler({path, duration})) {
+            return false;
+        }
+        duration = 0.0f;
+    }
+
+    return true;
+}
+
+static bool readPls(QFile &file, const QDir &base, const PlaylistFile::EntryHandler &handler)
+{
+    /* FileN, TitleN and LengthN come together, a song is handed over once the next number shows up */
+    PlaylistFile::Entry entry;
+    QByteArray number;
+    auto flush = [&] {
+        bool keepGoing = entry.path.isEmpty() or handler(std::move(entry));
+        entry = {};
+        return keepGoing;
+    };
+
+    while (not file.atEnd()) {
+        auto line = file.readLine().trimmed();
+        auto equals = line.indexOf('=');
+        if (equals < 0) {
+            continue;
+        }
+
+        auto key = line.left(equals).trimmed().toLower();
+        auto value = line.mid(equals + 1).trimmed();
+        QByteArray prefix;
+        if (key.startsWith("file")) {
+            prefix = "file";
+        } else if (key.startsWith("length")) {
+            prefix = "length";
+        } else {
+            continue;
+        }
+
+        auto keyNumber = key.mid(prefix.size());
+        if (keyNumber != number) {
+            if (not flush()) {
+                return false;
+            }
+            number = keyNumber;
+        }
+
+        if (prefix == "file") {
+            entry.path = resolve(base, QString::fromUtf8(value));
+        } else {
+            entry.duration = std::max(value.toFloat(), 0.0f);
+        }
+    }
+
+    return flush();
+}
+
+static bool readXspf(QFile &file, const QString &playlistPath, const PlaylistFile::EntryHandler &handler, QString &error)
+{
+    /* Locations are URIs, relative ones are relative to the playlist */
+    auto baseUrl = QUrl::fromLocalFile(playlistPath);
+    QDir base(QFileInfo(playlistPath).absolutePath());
+
+    QXmlStreamReader xml(&file);
+    PlaylistFile::Entry entry;
+    bool inTrack {false};
+    while (not xml.atEnd()) {
+        auto token = xml.readNext();
+        if (token == QXmlStreamReader::StartElement) {
+            auto name = xml.name();
+            if (name == QLatin1String("track")) {
+                inTrack = true;
+                entry = {};
+            } else if (inTrack and name == QLatin1String("location") and entry.path.isEmpty()) {
+                auto url = baseUrl.resolved(QUrl(xml.readElementText().trimmed()));
+                entry.path = url.isLocalFile() ? resolve(base, url.toLocalFile()) : QString();
+            } else if (inTrack and name == QLatin1String("duration")) {
+                /* Milliseconds */
+                entry.duration = std::max(xml.readElementText().trimmed().toFloat() / 1'000.0f, 0.0f);
+            }
+        } else if (token == QXmlStreamReader::EndElement and xml.name() == QLatin1String("track")) {
+            inTrack = false;
+            if (not entry.path.isEmpty() and not handler(std::move(entry))) {
+                return false;
+            }
+            entry = {};
+        }
+    }
+
+    if (xml.hasError()) {
+        error = xml.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+PlaylistFile::Format PlaylistFile::formatOf(const QString &path)
+{
+    auto suffix = QFileInfo(path).suffix().toLower();
+    if (suffix == "m3u") {
+        return Format::M3u;
+    } else if (suffix == "m3u8") {
+        return Format::M3u8;
+    } else if (suffix == "pls") {
+        return Format::Pls;
+    } else if (suffix == "xspf") {
+        return Format::Xspf;
+    }
+
+    return Format::Unknown;
+}
+
+bool PlaylistFile::read(const QString &path, const EntryHandler &handler, QString &error)
+{
+    TRACE_SCOPE("PlaylistFile::read");
+    auto format = formatOf(path);
+    if (format == Format::Unknown) {
+        error = QCoreApplication::translate("PlaylistFile", "Unknown playlist format");
+        return false;
+    }
+
+    QFile file(path);
+    if (not file.open(QIODevice::ReadOnly)) {
+        error = file.errorString();
+        return false;
+    }
+
+    QDir base(QFileInfo(path).absolutePath());
+    switch (format) {
+    case Format::M3u:
+        /* Plain M3U is in the system's encoding, M3U8 says UTF-8 in its name */
+        return readM3u(file, base, false, handler);
+    case Format::M3u8:
+        return readM3u(file, base, true, handler);
+    case Format::Pls:
+        return readPls(file, base, handler);
+    case Format::Xspf:
+        return readXspf(file, path, handler, error);
+    case Format::Unknown:
+        break;
+    }
+
+    return false;
+}
+
+/* "Artist - Title" when the tags say, the file name otherwise */
+static QString displayName(const TrackTable &tracks, int row)
+{
+    const auto &info = tracks.info(row);
+    if (info.title.isEmpty()) {
+        return QFileInfo(tracks.name(row)).completeBaseName();
+    }
+
+    return info.artist.isEmpty() ? info.title : QString("%1 - %2").arg(info.artist, info.title);
+}
+
+/* Whole seconds, -1 when the song hasn't been probed */
+static int seconds(const TrackInfo &info)
+{
+    return info.probed ? static_cast<int>(std::lround(info.duration)) : -1;
+}
+
+static void writeXspf(QSaveFile &file, const TrackTable &tracks)
+{
+    QXmlStreamWriter xml(&file);
+    xml.setAutoFormatting(true);
+    xml.writeStartDocument();
+    xml.writeStartElement("playlist");
+    xml.writeDefaultNamespace("http://xspf.org/ns/0/");
+    xml.writeAttribute("version", "1");
+    xml.writeStartElement("trackList");
+
+    for (int row {}; row < tracks.count(); ++row) {
+        const auto &info = tracks.info(row);
+        xml.writeStartElement("track");
+        xml.writeTextElement("location", QString::fromUtf8(QUrl::fromLocalFile(tracks.path(row)).toEncoded()));
+        if (not info.title.isEmpty()) {
+            xml.writeTextElement("title", info.title);
+        }
+        if (not info.artist.isEmpty()) {
+            xml.writeTextElement("creator", info.artist);
+        }
+        if (not info.album.isEmpty()) {
+            xml.writeTextElement("album", info.album);
+        }
+        if (info.probed) {
+            xml.writeTextElement("duration", QString::number(std::lround(info.duration * 1'000.0f)));
+        }
+        xml.writeEndElement();
+    }
+
+    xml.writeEndElement();
+    xml.writeEndElement();
+    xml.writeEndDocument();
+}
+
+bool PlaylistFile::write(const QString &path, const TrackTable &tracks, QString &error)
+{
+    TRACE_SCOPE("PlaylistFile::write");
+    auto format = formatOf(path);
+    if (format == Format::Unknown) {
+        error = QCoreApplication::translate("PlaylistFile", "Unknown playlist format");
+        return false;
+    }
+
+    QSaveFile file(path);
+    if (not file.open(QIODevice::WriteOnly)) {
+        error = file.errorString();
+        return false;
+    }
+
+    if (format == Format::Xspf) {
+        writeXspf(file, tracks);
+    } else {
+        /* Absolute paths, so the playlist can be moved around */
+        QByteArray chunk;
+        chunk.reserve(WRITE_CHUNK + 4'096);
+        auto encode = [format](const QString &text) {
+            return format == Format::M3u ? text.toLocal8Bit() : text.toUtf8();
+        };
+
+        chunk += format == Format::Pls ? "[playlist]\n" : "#EXTM3U\n";
+        for (int row {}; row < tracks.count(); ++row) {
+            auto number = QByteArray::number(row + 1);
+            auto length = QByteArray::number(seconds(tracks.info(row)));
+            if (format == Format::Pls) {
+                chunk += "File" + number + '=' + encode(tracks.path(row)) + '\n';
+                chunk += "Title" + number + '=' + encode(displayName(tracks, row)) + '\n';
+                chunk += "Length" + number + '=' + length + '\n';
+            } else {
+                chunk += "#EXTINF:" + length + ',' + encode(displayName(tracks, row)) + '\n';
+                chunk += encode(tracks.path(row)) + '\n';
+            }
+
+            if (chunk.size() >= WRITE_CHUNK) {
+                file.write(chunk);
+                chunk.clear();
+            }
+        }
+
+        if (format == Format::Pls) {
+            chunk += "NumberOfEntries=" + QByteArray::number(tracks.count()) + "\nVersion=2\n";
+        }
+        file.write(chunk);
+    }
+
+    if (not file.commit()) {
+        error = file.errorString();
+        return false;
+    }
+
+    return true;
+}
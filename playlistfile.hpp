@@ -0,0 +1,35 @@
+#ifndef PLAYLISTFILE_HPP
+#define PLAYLISTFILE_HPP
+
+#include <functional>
+#include <QString>
+
+#include "tracktable.hpp"
+
+/* Playlists other programs read and write: M3U and M3U8 (with #EXTINF), PLS and XSPF.
+ * Files are read in a single pass and every song is handed over as soon as it's parsed,
+ * nothing but the current line or element is kept. Relative paths are taken from where
+ * the playlist is, remote locations and formats we can't play are left out.
+ * Writing streams the track table out the same way.
+ */
+class PlaylistFile
+{
+public:
+    enum class Format { Unknown, M3u, M3u8, Pls, Xspf };
+
+    struct Entry
+    {
+        QString path;
+        /* Seconds, 0 when the playlist doesn't say */
+        float duration {};
+    };
+
+    /* Returns false to stop reading */
+    using EntryHandler = std::function<bool(Entry entry)>;
+
+    static Format formatOf(const QString &path);
+    static bool read(const QString &path, const EntryHandler &handler, QString &error);
+    static bool write(const QString &path, const TrackTable &tracks, QString &error);
+};
+
+#endif // PLAYLISTFILE_HPP
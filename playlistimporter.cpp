@@ -0,0 +1,103 @@
+#include <QElapsedTimer>
+
+#include "playlistimporter.hpp"
+#include "tracer.hpp"
+
+/* Like the folder scanner: often enough to see the list grow, rarely enough that merging keeps up */
+static constexpr qint64 FLUSH_INTERVAL {250};
+/* Memory held by a batch on its way stays bounded however fast the file is read */
+static constexpr int MAX_BATCH {64 * 1'024};
+
+PlaylistImporter::PlaylistImporter(QObject *parent)
+    : QObject(parent)
+    , m_generation(0)
+    , m_running(false)
+    , m_total(0)
+{
+    /* One file at a time, reading it is sequential anyway */
+    m_pool.setMaxThreadCount(1);
+}
+
+PlaylistImporter::~PlaylistImporter()
+{
+    /* Whoever listens may be gone already, nothing is emitted from here */
+    ++m_generation;
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+void PlaylistImporter::import(const QString &path)
+{
+    cancel();
+
+    auto generation = m_generation.load();
+    m_running = true;
+    m_total = 0;
+
+    m_pool.start([this, path, generation] {
+        TRACE_SCOPE("PlaylistImporter::import");
+        QVector<PlaylistFile::Entry> batch;
+        QElapsedTimer sinceFlush;
+        sinceFlush.start();
+
+        auto flush = [this, generation, &batch, &sinceFlush] {
+            QMetaObject::invokeMethod(this, [this, generation, entries = std::move(batch)] {
+                if (m_generation.load() != generation) {
+                    return;
+                }
+
+                m_total += static_cast<int>(entries.size());
+                emit found(entries);
+            }, Qt::QueuedConnection);
+            batch = {};
+            sinceFlush.restart();
+        };
+
+        QString error;
+        bool read = PlaylistFile::read(path, [this, generation, &batch, &sinceFlush, &flush](PlaylistFile::Entry entry) {
+            if (m_generation.load() != generation) {
+                return false;
+            }
+
+            batch.append(std::move(entry));
+            /* Looking at the clock every song would cost more than parsing it */
+            if (batch.size() >= MAX_BATCH or (batch.size() % 1'024 == 0 and sinceFlush.elapsed() >= FLUSH_INTERVAL)) {
+                flush();
+            }
+            return true;
+        }, error);
+
+        if (not batch.isEmpty()) {
+            flush();
+        }
+
+        QMetaObject::invokeMethod(this, [this, generation, path, read, error] {
+            if (m_generation.load() != generation) {
+                return;
+            }
+
+            m_running = false;
+            if (not read) {
+                emit failed(path, error);
+                return;
+            }
+            emit finished(m_total, false);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void PlaylistImporter::cancel()
+{
+    ++m_generation;
+    m_pool.clear();
+
+    if (m_running) {
+        m_running = false;
+        emit finished(m_total, true);
+    }
+}
+
+bool PlaylistImporter::isRunning() const
+{
+    return m_running;
+}
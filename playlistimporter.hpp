@@ -0,0 +1,35 @@
+#ifndef PLAYLISTIMPORTER_HPP
+#define PLAYLISTIMPORTER_HPP
+
+#include <atomic>
+#include <QObject>
+#include <QThreadPool>
+#include <QVector>
+
+#include "playlistfile.hpp"
+
+/* Reads M3U, PLS and XSPF playlists on a thread of its own. Songs come back in batches on the thread
+ * the importer lives in, a few times a second at most, so huge playlists are merged into the queue
+ * a handful of times rather than once per song. A playlist that can't be read ends with failed()
+ * instead of finished(), whatever was read of it until then stays.
+ */
+class PlaylistImporter : public QObject
+{
+    Q_OBJECT
+    QThreadPool m_pool;
+    std::atomic<quint64> m_generation;
+    bool m_running;
+    int m_total;
+public:
+    explicit PlaylistImporter(QObject *parent = nullptr);
+    ~PlaylistImporter();
+    void import(const QString &path);
+    void cancel();
+    bool isRunning() const;
+signals:
+    void found(QVector<PlaylistFile::Entry> entries);
+    void failed(QString path, QString error);
+    void finished(int total, bool cancelled);
+};
+
+#endif // PLAYLISTIMPORTER_HPP
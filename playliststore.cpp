@@ -0,0 +1,424 @@
+#include <algorithm>
+#include <cstring>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QHash>
+#include <QPair>
+#include <QSaveFile>
+#include <QSet>
+#include <QSettings>
+
+#include "binaryio.hpp"
+#include "playliststore.hpp"
+#include "tracer.hpp"
+
+static constexpr char MAGIC[4] {'B', 'M', 'P', 'L'};
+/* magic, version, playlist count, reserved, string table offset, string table size */
+static constexpr qint64 HEADER_SIZE {4 + 4 + 4 + 4 + 8 + 8};
+/* name offset, name length, tracks offset, track count, reserved */
+static constexpr qint64 ENTRY_SIZE {4 + 4 + 8 + 4 + 4};
+/* directory offset, directory length, file name offset, file name length */
+static constexpr qint64 TRACK_SIZE {4 + 4 + 4 + 4};
+
+PlaylistStore::PlaylistStore(QString path)
+    : m_path(std::move(path))
+    , m_data(nullptr)
+    , m_size(0)
+    , m_version(0)
+    , m_count(0)
+    , m_stringsOffset(0)
+    , m_stringsSize(0)
+{
+}
+
+PlaylistStore::~PlaylistStore()
+{
+    unmap();
+}
+
+bool PlaylistStore::open()
+{
+    TRACE_SCOPE("PlaylistStore::open");
+    return map();
+}
+
+bool PlaylistStore::exists() const
+{
+    return QFile::exists(m_path);
+}
+
+bool PlaylistStore::map()
+{
+    unmap();
+
+    /* No playlist has been saved yet */
+    if (not exists()) {
+        return true;
+    }
+
+    m_file.setFileName(m_path);
+    if (not m_file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Couldn't open" << m_path << ":" << m_file.errorString();
+        return false;
+    }
+
+    m_size = m_file.size();
+    if (m_size < HEADER_SIZE) {
+        qWarning() << m_path << "is not a playlist file.";
+        unmap();
+        return false;
+    }
+
+    m_data = m_file.map(0, m_size);
+    if (m_data == nullptr) {
+        qWarning() << "Couldn't map" << m_path << ":" << m_file.errorString();
+        unmap();
+        return false;
+    }
+
+    auto version = readValue<quint32>(m_data + 4);
+    auto count = readValue<quint32>(m_data + 8);
+    auto stringsOffset = readValue<quint64>(m_data + 16);
+    auto stringsSize = readValue<quint64>(m_data + 24);
+
+    bool valid = std::memcmp(m_data, MAGIC, sizeof(MAGIC)) == 0
+                 and version >= 1 and version <= VERSION
+                 and HEADER_SIZE + static_cast<qint64>(count) * ENTRY_SIZE <= m_size
+                 and stringsOffset <= static_cast<quint64>(m_size)
+                 and stringsSize <= static_cast<quint64>(m_size) - stringsOffset;
+    if (not valid) {
+        qWarning() << m_path << "is corrupted or was written by a newer version.";
+        unmap();
+        return false;
+    }
+
+    m_version = version;
+    m_count = count;
+    m_stringsOffset = stringsOffset;
+    m_stringsSize = stringsSize;
+    return true;
+}
+
+void PlaylistStore::unmap()
+{
+    if (m_data != nullptr) {
+        m_file.unmap(const_cast<uchar *>(m_data));
+    }
+
+    m_file.close();
+    m_data = nullptr;
+    m_size = 0;
+    m_version = 0;
+    m_count = 0;
+    m_stringsOffset = 0;
+    m_stringsSize = 0;
+}
+
+QString PlaylistStore::string(quint32 offset, quint32 length) const
+{
+    if (static_cast<quint64>(offset) + length > m_stringsSize) {
+        return {};
+    }
+
+    return QString::fromUtf8(reinterpret_cast<const char *>(m_data + m_stringsOffset + offset), length);
+}
+
+int PlaylistStore::compareString(quint32 offset, quint32 length, const QByteArray &utf8) const
+{
+    /* A broken reference reads as an empty string, like string() gives back */
+    if (static_cast<quint64>(offset) + length > m_stringsSize) {
+        length = 0;
+    }
+
+    auto size = static_cast<quint32>(utf8.size());
+    auto common = std::min(length, size);
+    auto result = common > 0 ? std::memcmp(m_data + m_stringsOffset + offset, utf8.constData(), common) : 0;
+    if (result != 0) {
+        return result;
+    }
+
+    return length < size ? -1 : (length > size ? 1 : 0);
+}
+
+bool PlaylistStore::tracksFit(quint64 tracksOffset, quint32 trackCount) const
+{
+    /* Checked one by one, adding them up could wrap around */
+    return tracksOffset >= static_cast<quint64>(HEADER_SIZE + static_cast<qint64>(m_count) * ENTRY_SIZE)
+           and tracksOffset <= m_stringsOffset
+           and trackCount <= (m_stringsOffset - tracksOffset) / TRACK_SIZE;
+}
+
+QStringList PlaylistStore::tracksAt(quint32 index) const
+{
+    const auto *entry = m_data + HEADER_SIZE + static_cast<qint64>(index) * ENTRY_SIZE;
+    auto tracksOffset = readValue<quint64>(entry + 8);
+    auto trackCount = readValue<quint32>(entry + 16);
+
+    if (not tracksFit(tracksOffset, trackCount)) {
+        qWarning() << m_path << "has a broken playlist entry.";
+        return {};
+    }
+
+    QStringList paths;
+    paths.reserve(static_cast<int>(trackCount));
+
+    /* Songs of the same directory are next to each other, decode the directory once */
+    quint32 lastDirectoryOffset {};
+    quint32 lastDirectoryLength {};
+    QString directory {};
+    bool hasDirectory {false};
+
+    const auto *track = m_data + tracksOffset;
+    for (quint32 i {}; i < trackCount; ++i, track += TRACK_SIZE) {
+        auto directoryOffset = readValue<quint32>(track);
+        auto directoryLength = readValue<quint32>(track + 4);
+        if (not hasDirectory or directoryOffset != lastDirectoryOffset or directoryLength != lastDirectoryLength) {
+            directory = string(directoryOffset, directoryLength);
+            lastDirectoryOffset = directoryOffset;
+            lastDirectoryLength = directoryLength;
+            hasDirectory = true;
+        }
+
+        auto name = string(readValue<quint32>(track + 8), readValue<quint32>(track + 12));
+        paths << (directory.isEmpty() ? name : QString("%1/%2").arg(directory, name));
+    }
+
+    return paths;
+}
+
+QStringList PlaylistStore::names() const
+{
+    QStringList names;
+    names.reserve(static_cast<int>(m_count));
+
+    for (quint32 i {}; i < m_count; ++i) {
+        const auto *entry = m_data + HEADER_SIZE + static_cast<qint64>(i) * ENTRY_SIZE;
+        names << string(readValue<quint32>(entry), readValue<quint32>(entry + 4));
+    }
+
+    return names;
+}
+
+QStringList PlaylistStore::tracks(const QString &name) const
+{
+    TRACE_SCOPE("PlaylistStore::tracks");
+    auto utf8 = name.toUtf8();
+    auto compareAt = [this, &utf8](quint32 index) {
+        const auto *entry = m_data + HEADER_SIZE + static_cast<qint64>(index) * ENTRY_SIZE;
+        return compareString(readValue<quint32>(entry), readValue<quint32>(entry + 4), utf8);
+    };
+
+    if (m_version < VERSION) {
+        for (quint32 i {}; i < m_count; ++i) {
+            if (compareAt(i) == 0) {
+                return tracksAt(i);
+            }
+        }
+        return {};
+    }
+
+    quint32 first {};
+    auto last = m_count;
+    while (first < last) {
+        auto middle = first + (last - first) / 2;
+        auto result = compareAt(middle);
+        if (result == 0) {
+            return tracksAt(middle);
+        }
+        if (result < 0) {
+            first = middle + 1;
+        } else {
+            last = middle;
+        }
+    }
+
+    return {};
+}
+
+PlaylistStore::Playlists PlaylistStore::readAll() const
+{
+    Playlists playlists;
+    playlists.reserve(m_count);
+
+    auto playlistNames = names();
+    for (quint32 i {}; i < m_count; ++i) {
+        playlists.emplace_back(playlistNames[static_cast<int>(i)], tracksAt(i));
+    }
+
+    return playlists;
+}
+
+bool PlaylistStore::save(const QString &name, const QStringList &paths)
+{
+    auto playlists = readAll();
+    playlists.erase(std::remove_if(playlists.begin(), playlists.end(), [&name](const auto &playlist) {
+        return playlist.first == name;
+    }), playlists.end());
+    playlists.emplace_back(name, paths);
+
+    return write(std::move(playlists));
+}
+
+int PlaylistStore::remove(const QStringList &names)
+{
+    auto playlists = readAll();
+    auto count = playlists.size();
+    playlists.erase(std::remove_if(playlists.begin(), playlists.end(), [&names](const auto &playlist) {
+        return names.contains(playlist.first);
+    }), playlists.end());
+
+    int removed = static_cast<int>(count - playlists.size());
+    if (removed > 0 and not write(std::move(playlists))) {
+        return 0;
+    }
+
+    return removed;
+}
+
+QStringList PlaylistStore::directories() const
+{
+    /* Strings are stored once, equal offsets are the same directory */
+    QSet<QPair<quint32, quint32>> seen;
+    QStringList directories;
+    for (quint32 i {}; i < m_count; ++i) {
+        const auto *entry = m_data + HEADER_SIZE + static_cast<qint64>(i) * ENTRY_SIZE;
+        auto tracksOffset = readValue<quint64>(entry + 8);
+        auto trackCount = readValue<quint32>(entry + 16);
+        if (not tracksFit(tracksOffset, trackCount)) {
+            continue;
+        }
+
+        const auto *track = m_data + tracksOffset;
+        for (quint32 j {}; j < trackCount; ++j, track += TRACK_SIZE) {
+            QPair<quint32, quint32> directory {readValue<quint32>(track), readValue<quint32>(track + 4)};
+            if (not seen.contains(directory)) {
+                seen.insert(directory);
+                directories << string(directory.first, directory.second);
+            }
+        }
+    }
+
+    return directories;
+}
+
+int PlaylistStore::renamePaths(const QHash<QString, QString> &renamed)
+{
+    if (renamed.isEmpty()) {
+        return 0;
+    }
+
+    auto playlists = readAll();
+    int count {};
+    for (auto &playlist : playlists) {
+        for (auto &path : playlist.second) {
+            auto it = renamed.constFind(path);
+            if (it != renamed.constEnd()) {
+                path = it.value();
+                ++count;
+            }
+        }
+    }
+
+    if (count > 0 and not write(std::move(playlists))) {
+        return 0;
+    }
+
+    return count;
+}
+
+bool PlaylistStore::importIni(const QString &iniPath)
+{
+    /* Old versions kept every playlist as an INI group of "file name = directory" keys */
+    QSettings settings(iniPath, QSettings::IniFormat);
+    Playlists playlists;
+
+    for (const auto &group : settings.childGroups()) {
+        QStringList paths;
+        settings.beginGroup(group);
+        for (const auto &key : settings.childKeys()) {
+            paths << QDir::cleanPath(QString("%1/%2").arg(settings.value(key).toString(), key));
+        }
+        settings.endGroup();
+        playlists.emplace_back(group, paths);
+    }
+
+    return write(std::move(playlists));
+}
+
+bool PlaylistStore::write(Playlists playlists)
+{
+    /* In the byte order tracks() compares them in */
+    std::sort(playlists.begin(), playlists.end(), [](const auto &left, const auto &right) {
+        return left.first.toUtf8() < right.first.toUtf8();
+    });
+
+    QByteArray strings;
+    QHash<QString, std::pair<quint32, quint32>> stringRefs;
+    auto intern = [&strings, &stringRefs](const QString &text) {
+        auto it = stringRefs.constFind(text);
+        if (it != stringRefs.constEnd()) {
+            return it.value();
+        }
+
+        auto utf8 = text.toUtf8();
+        std::pair<quint32, quint32> ref {static_cast<quint32>(strings.size()), static_cast<quint32>(utf8.size())};
+        strings.append(utf8);
+        stringRefs.insert(text, ref);
+        return ref;
+    };
+
+    QByteArray entries;
+    QByteArray tracks;
+    auto tracksBase = static_cast<quint64>(HEADER_SIZE + static_cast<qint64>(playlists.size()) * ENTRY_SIZE);
+
+    for (const auto &[name, paths] : playlists) {
+        auto nameRef = intern(name);
+        appendValue<quint32>(entries, nameRef.first);
+        appendValue<quint32>(entries, nameRef.second);
+        appendValue<quint64>(entries, tracksBase + static_cast<quint64>(tracks.size()));
+        appendValue<quint32>(entries, static_cast<quint32>(paths.size()));
+        appendValue<quint32>(entries, 0);
+
+        for (const auto &path : paths) {
+            auto index = path.lastIndexOf('/');
+            auto directoryRef = intern(index < 0 ? QString() : path.left(index));
+            auto fileNameRef = intern(path.mid(index + 1));
+            appendValue<quint32>(tracks, directoryRef.first);
+            appendValue<quint32>(tracks, directoryRef.second);
+            appendValue<quint32>(tracks, fileNameRef.first);
+            appendValue<quint32>(tracks, fileNameRef.second);
+        }
+    }
+
+    QByteArray header;
+    header.append(MAGIC, sizeof(MAGIC));
+    appendValue<quint32>(header, VERSION);
+    appendValue<quint32>(header, static_cast<quint32>(playlists.size()));
+    appendValue<quint32>(header, 0);
+    appendValue<quint64>(header, tracksBase + static_cast<quint64>(tracks.size()));
+    appendValue<quint64>(header, static_cast<quint64>(strings.size()));
+
+    /* The old file can't be replaced while it's mapped on some platforms */
+    unmap();
+
+    QDir().mkpath(QFileInfo(m_path).absolutePath());
+    QSaveFile file(m_path);
+    if (not file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Couldn't save playlists to" << m_path << ":" << file.errorString();
+        map();
+        return false;
+    }
+
+    file.write(header);
+    file.write(entries);
+    file.write(tracks);
+    file.write(strings);
+    if (not file.commit()) {
+        qWarning() << "Couldn't save playlists to" << m_path << ":" << file.errorString();
+        map();
+        return false;
+    }
+
+    return map();
+}
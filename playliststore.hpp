@@ -0,0 +1,60 @@
+#ifndef PLAYLISTSTORE_HPP
+#define PLAYLISTSTORE_HPP
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <utility>
+#include <vector>
+
+/* Saved playlists in a single memory-mapped binary file:
+ *
+ *   header | playlist entries (sorted by their UTF-8 name) | track references | string table
+ *
+ * Listing the playlists reads the entries only, opening one reads its own tracks only.
+ * Every string (playlist names, directories, file names) is UTF-8 and stored once in the string table.
+ * Saving rewrites the file next to the old one and renames it over, so a crash never leaves half a file.
+ */
+class PlaylistStore
+{
+    using Playlists = std::vector<std::pair<QString, QStringList>>;
+
+    QString m_path;
+    QFile m_file;
+    const uchar *m_data;
+    qint64 m_size;
+    quint32 m_version;
+    quint32 m_count;
+    quint64 m_stringsOffset;
+    quint64 m_stringsSize;
+
+    bool map();
+    void unmap();
+    QString string(quint32 offset, quint32 length) const;
+    int compareString(quint32 offset, quint32 length, const QByteArray &utf8) const;
+    bool tracksFit(quint64 tracksOffset, quint32 trackCount) const;
+    QStringList tracksAt(quint32 index) const;
+    Playlists readAll() const;
+    bool write(Playlists playlists);
+public:
+    /* Version 1 sorted the entries by their UTF-16 name, those are still read but looked up one by one */
+    static constexpr quint32 VERSION {2};
+
+    explicit PlaylistStore(QString path);
+    ~PlaylistStore();
+    bool open();
+    bool exists() const;
+    QStringList names() const;
+    QStringList tracks(const QString &name) const;
+    bool save(const QString &name, const QStringList &paths);
+    int remove(const QStringList &names);
+    /* Every directory a saved song is in, without reading the songs themselves */
+    QStringList directories() const;
+    /* Points saved songs that were renamed to their new path, returns how many were */
+    int renamePaths(const QHash<QString, QString> &renamed);
+    bool importIni(const QString &iniPath);
+};
+
+#endif // PLAYLISTSTORE_HPP
@@ -0,0 +1,148 @@
+#include <algorithm>
+#include <QDebug>
+
+#include "prefetcher.hpp"
+
+/* Small enough to switch to a new window quickly after a seek */
+static constexpr qint64 CHUNK_BYTES {256 * 1'024};
+
+Prefetcher::Prefetcher()
+    : m_quit(false)
+    , m_from(0)
+    , m_to(0)
+    , m_done(0)
+    , m_generation(0)
+    , m_headBytes(0)
+    , m_headDone(0)
+    , m_buffer(CHUNK_BYTES, Qt::Uninitialized)
+{
+    m_thread = std::thread(&Prefetcher::run, this);
+}
+
+Prefetcher::~Prefetcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_condition.notify_one();
+    m_thread.join();
+}
+
+void Prefetcher::setWindow(const QString &path, qint64 from, qint64 to)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        /* Another track, a seek backwards, or the decoder got past us: start over from where it reads */
+        if (path != m_path or from < m_from or from > m_done) {
+            m_path = path;
+            m_done = from;
+            ++m_generation;
+        }
+        m_from = from;
+        m_to = to;
+
+        if (not hasWork()) {
+            return;
+        }
+    }
+    m_condition.notify_one();
+}
+
+void Prefetcher::prefetchHead(const QString &path, qint64 bytes)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (path == m_headPath) {
+            return;
+        }
+
+        m_headPath = path;
+        m_headBytes = bytes;
+        m_headDone = 0;
+    }
+    m_condition.notify_one();
+}
+
+qint64 Prefetcher::readUntil(const QString &path)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return path == m_path ? m_done : 0;
+}
+
+void Prefetcher::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_path.clear();
+    m_from = m_to = m_done = 0;
+    ++m_generation;
+    m_headPath.clear();
+    m_headBytes = m_headDone = 0;
+}
+
+bool Prefetcher::hasWork() const
+{
+    return (not m_path.isEmpty() and m_done < m_to) or (not m_headPath.isEmpty() and m_headDone < m_headBytes);
+}
+
+void Prefetcher::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (true) {
+        m_condition.wait(lock, [this] { return m_quit or hasWork(); });
+        if (m_quit) {
+            break;
+        }
+
+        /* What's about to be played always goes before the next track */
+        if (not m_path.isEmpty() and m_done < m_to) {
+            auto path = m_path;
+            auto generation = m_generation;
+            auto from = std::max(m_done, m_from);
+            auto to = std::min(from + CHUNK_BYTES, m_to);
+
+            lock.unlock();
+            bool complete = readRange(path, from, to);
+            lock.lock();
+
+            /* The window moved while we were reading, what we read may still help but m_done is stale */
+            if (generation == m_generation) {
+                m_done = complete ? to : m_to;
+            }
+            continue;
+        }
+
+        auto path = m_headPath;
+        auto from = m_headDone;
+        auto to = std::min(from + CHUNK_BYTES, m_headBytes);
+
+        lock.unlock();
+        bool complete = readRange(path, from, to);
+        lock.lock();
+
+        if (path == m_headPath) {
+            m_headDone = complete ? to : m_headBytes;
+        }
+    }
+}
+
+bool Prefetcher::readRange(const QString &path, qint64 from, qint64 to)
+{
+    if (m_file.fileName() != path or not m_file.isOpen()) {
+        m_file.close();
+        m_file.setFileName(path);
+        if (not m_file.open(QIODevice::ReadOnly)) {
+            qDebug() << "Couldn't prefetch" << path << ":" << m_file.errorString();
+            return false;
+        }
+    }
+
+    /* Reading is enough, the data lands in the page cache where the decoder will find it */
+    if (not m_file.seek(from)) {
+        return false;
+    }
+
+    auto read = m_file.read(m_buffer.data(), to - from);
+    return read == to - from;
+}
@@ -0,0 +1,51 @@
+#ifndef PREFETCHER_HPP
+#define PREFETCHER_HPP
+
+#include <condition_variable>
+#include <mutex>
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <thread>
+
+/* Reads ahead of the decoder on its own thread so the bytes are in the page cache by the time
+ * the decoder (on the playback thread) gets to them. A slow disk or a network hiccup then blocks
+ * this thread instead of the one feeding the audio device.
+ * It also warms up the beginning of the track coming next.
+ */
+class Prefetcher
+{
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    bool m_quit;
+    /* The current track: keep [m_from, m_to) resident, everything before m_done already is */
+    QString m_path;
+    qint64 m_from;
+    qint64 m_to;
+    qint64 m_done;
+    quint64 m_generation;
+    /* The beginning of the next track */
+    QString m_headPath;
+    qint64 m_headBytes;
+    qint64 m_headDone;
+    /* Only touched from the prefetching thread */
+    QFile m_file;
+    QByteArray m_buffer;
+
+    void run();
+    bool hasWork() const;
+    bool readRange(const QString &path, qint64 from, qint64 to);
+public:
+    Prefetcher();
+    ~Prefetcher();
+    Prefetcher(const Prefetcher &) = delete;
+    Prefetcher &operator=(const Prefetcher &) = delete;
+
+    void setWindow(const QString &path, qint64 from, qint64 to);
+    void prefetchHead(const QString &path, qint64 bytes);
+    qint64 readUntil(const QString &path);
+    void clear();
+};
+
+#endif // PREFETCHER_HPP
@@ -0,0 +1,153 @@
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <QtEndian>
+
+#include "binaryio.hpp"
+#include "mappedfile.hpp"
+#include "mp3frame.hpp"
+#include "seekindex.hpp"
+#include "tracer.hpp"
+
+/* point count, then seconds (float bits) and offset per point */
+static constexpr qint64 POINT_SIZE {4 + 8};
+
+SeekIndex::SeekIndex()
+{
+}
+
+SeekIndex::SeekIndex(std::vector<Point> points)
+    : m_points(std::make_shared<const std::vector<Point>>(std::move(points)))
+{
+}
+
+SeekIndex SeekIndex::build(const QString &path)
+{
+    MappedFile mapping(path);
+    if (not mapping.map(std::numeric_limits<qint64>::max())) {
+        return {};
+    }
+
+    /* Only the headers are read, but they're spread all over the file */
+    return build(mapping.data(), mapping.size());
+}
+
+SeekIndex SeekIndex::build(const uchar *data, qint64 size)
+{
+    TRACE_SCOPE("SeekIndex::build");
+
+    qint64 position {};
+    if (size >= 10 and std::memcmp(data, "ID3", 3) == 0) {
+        auto tagSize = qFromBigEndian<quint32>(data + 6);
+        tagSize = (tagSize >> 24 & 0x7f) << 21 | (tagSize >> 16 & 0x7f) << 14 | (tagSize >> 8 & 0x7f) << 7 | (tagSize & 0x7f);
+        bool hasFooter = data[5] & 0x10;
+        position = 10 + static_cast<qint64>(tagSize) + (hasFooter ? 10 : 0);
+    }
+
+    std::vector<Point> points;
+    double seconds {};
+    double nextPoint {};
+
+    while (position + 4 <= size) {
+        Mp3Frame frame;
+        if (not Mp3Frame::parse(data + position, frame) or frame.bytes <= 4) {
+            ++position;
+            continue;
+        }
+
+        /* A sync pattern inside the audio data isn't followed by another frame */
+        auto next = position + frame.bytes;
+        Mp3Frame following;
+        bool followed = next + 4 > size or std::memcmp(data + next, "TAG", 3) == 0
+                        or Mp3Frame::parse(data + next, following);
+        if (not followed) {
+            ++position;
+            continue;
+        }
+
+        /* Every frame counts, the Xing/Info one too: the decoder plays it as silence */
+        if (seconds >= nextPoint) {
+            points.push_back({static_cast<float>(seconds), position});
+            nextPoint = seconds + INTERVAL;
+        }
+
+        seconds += static_cast<double>(frame.samples) / frame.sampleRate;
+        position = next;
+    }
+
+    if (points.empty()) {
+        return {};
+    }
+
+    return SeekIndex(std::move(points));
+}
+
+SeekIndex SeekIndex::fromBytes(const QByteArray &bytes)
+{
+    if (bytes.size() < 4) {
+        return {};
+    }
+
+    const auto *data = reinterpret_cast<const uchar *>(bytes.constData());
+    auto count = readValue<quint32>(data);
+    if (count == 0 or 4 + static_cast<qint64>(count) * POINT_SIZE != bytes.size()) {
+        return {};
+    }
+
+    std::vector<Point> points(count);
+    const auto *point = data + 4;
+    for (auto &entry : points) {
+        auto secondsBits = readValue<quint32>(point);
+        std::memcpy(&entry.seconds, &secondsBits, sizeof(float));
+        entry.offset = readValue<qint64>(point + 4);
+        point += POINT_SIZE;
+    }
+
+    return SeekIndex(std::move(points));
+}
+
+QByteArray SeekIndex::toBytes() const
+{
+    if (isEmpty()) {
+        return {};
+    }
+
+    QByteArray bytes;
+    bytes.reserve(static_cast<int>(4 + m_points->size() * POINT_SIZE));
+    appendValue<quint32>(bytes, static_cast<quint32>(m_points->size()));
+    for (const auto &point : *m_points) {
+        quint32 secondsBits {};
+        std::memcpy(&secondsBits, &point.seconds, sizeof(float));
+        appendValue<quint32>(bytes, secondsBits);
+        appendValue<qint64>(bytes, point.offset);
+    }
+
+    return bytes;
+}
+
+bool SeekIndex::isEmpty() const
+{
+    return not m_points or m_points->empty();
+}
+
+int SeekIndex::size() const
+{
+    return m_points ? static_cast<int>(m_points->size()) : 0;
+}
+
+const SeekIndex::Point *SeekIndex::find(float seconds) const
+{
+    if (isEmpty()) {
+        return nullptr;
+    }
+
+    /* The last point at or before the target */
+    auto it = std::upper_bound(m_points->cbegin(), m_points->cend(), seconds, [](float target, const Point &point) {
+        return target < point.seconds;
+    });
+    if (it == m_points->cbegin()) {
+        return nullptr;
+    }
+
+    return &*(it - 1);
+}
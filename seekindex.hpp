@@ -0,0 +1,43 @@
+#ifndef SEEKINDEX_HPP
+#define SEEKINDEX_HPP
+
+#include <memory>
+#include <QByteArray>
+#include <QMetaType>
+#include <QString>
+#include <vector>
+
+/* Where the frames of an MP3 start, about every half a second.
+ * raylib's MP3 decoder seeks by decoding everything up to the target, which takes seconds deep into
+ * a long mix. With an index the stream is reopened at a frame a little before the target instead,
+ * and only that little bit is decoded.
+ * Building one walks the frame headers without decoding anything. Copies share the points.
+ */
+class SeekIndex
+{
+public:
+    struct Point
+    {
+        float seconds;
+        qint64 offset;
+    };
+private:
+    std::shared_ptr<const std::vector<Point>> m_points;
+
+    explicit SeekIndex(std::vector<Point> points);
+public:
+    static constexpr double INTERVAL {0.5};
+
+    SeekIndex();
+    static SeekIndex build(const QString &path);
+    static SeekIndex build(const uchar *data, qint64 size);
+    static SeekIndex fromBytes(const QByteArray &bytes);
+    QByteArray toBytes() const;
+    bool isEmpty() const;
+    int size() const;
+    const Point *find(float seconds) const;
+};
+
+Q_DECLARE_METATYPE(SeekIndex)
+
+#endif // SEEKINDEX_HPP
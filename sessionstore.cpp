@@ -0,0 +1,169 @@
+#include <algorithm>
+#include <cstring>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QSaveFile>
+
+#include "binaryio.hpp"
+#include "sessionstore.hpp"
+#include "tracer.hpp"
+
+static constexpr char MAGIC[4] {'B', 'M', 'S', 'S'};
+/* magic, version, current track, position, flags, directory count, track count */
+static constexpr qint64 HEADER_SIZE {4 + 4 + 4 + 4 + 4 + 4 + 4};
+static constexpr quint32 REPEAT_FLAG {1};
+static constexpr quint32 KEEP_ORDER_FLAG {2};
+static constexpr quint32 NO_TRACK {0xFFFF'FFFF};
+
+SessionStore::SessionStore(QString path)
+    : m_path(std::move(path))
+{
+}
+
+bool SessionStore::load(Session &session) const
+{
+    TRACE_SCOPE("SessionStore::load");
+    session = {};
+
+    /* First run */
+    QFile file(m_path);
+    if (not file.exists()) {
+        return true;
+    }
+
+    if (not file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Couldn't open" << m_path << ":" << file.errorString();
+        return false;
+    }
+
+    auto bytes = file.readAll();
+    const auto *data = reinterpret_cast<const uchar *>(bytes.constData());
+    qint64 size = bytes.size();
+    if (size < HEADER_SIZE or std::memcmp(data, MAGIC, sizeof(MAGIC)) != 0 or readValue<quint32>(data + 4) != VERSION) {
+        qDebug() << "Ignoring session" << m_path;
+        return false;
+    }
+
+    auto current = readValue<quint32>(data + 8);
+    auto positionBits = readValue<quint32>(data + 12);
+    auto flags = readValue<quint32>(data + 16);
+    auto directoryCount = readValue<quint32>(data + 20);
+    auto trackCount = readValue<quint32>(data + 24);
+
+    /* Every string is its length and UTF-8, whatever doesn't fit means the file is cut short */
+    qint64 position {HEADER_SIZE};
+    auto readString = [&](QString &string) {
+        if (position + 4 > size) {
+            return false;
+        }
+
+        auto length = readValue<quint32>(data + position);
+        position += 4;
+        if (position + length > size) {
+            return false;
+        }
+
+        string = QString::fromUtf8(reinterpret_cast<const char *>(data + position), static_cast<int>(length));
+        position += length;
+        return true;
+    };
+
+    /* A directory takes at least its length, a track its directory and length: counts that can't
+     * fit in what's left mean the file is broken, and mustn't make us allocate for them
+     */
+    if (directoryCount > static_cast<quint64>(size - HEADER_SIZE) / 4) {
+        qDebug() << "Ignoring broken session" << m_path;
+        return false;
+    }
+
+    QStringList directories;
+    directories.reserve(static_cast<int>(directoryCount));
+    for (quint32 i {}; i < directoryCount; ++i) {
+        QString directory;
+        if (not readString(directory)) {
+            qDebug() << "Ignoring truncated session" << m_path;
+            return false;
+        }
+        directories << directory;
+    }
+
+    session.tracks.reserve(static_cast<int>(std::min<quint64>(trackCount, static_cast<quint64>(size - position) / 8)));
+    for (quint32 i {}; i < trackCount and position + 4 <= size; ++i) {
+        auto directory = readValue<quint32>(data + position);
+        position += 4;
+
+        QString name;
+        if (directory >= directoryCount or not readString(name)) {
+            break;
+        }
+        const auto &directoryPath = directories[directory];
+        session.tracks << (directoryPath.isEmpty() ? name : QString("%1/%2").arg(directoryPath, name));
+    }
+
+    if (current != NO_TRACK and current < static_cast<quint32>(session.tracks.size())) {
+        session.current = static_cast<int>(current);
+        std::memcpy(&session.position, &positionBits, sizeof(float));
+    }
+    session.repeat = flags & REPEAT_FLAG;
+    session.keepOrder = flags & KEEP_ORDER_FLAG;
+
+    return true;
+}
+
+bool SessionStore::save(const Session &session) const
+{
+    TRACE_SCOPE("SessionStore::save");
+    QHash<QString, quint32> directoryIds;
+    QByteArray directories;
+    QByteArray tracks;
+    for (const auto &path : session.tracks) {
+        auto index = path.lastIndexOf('/');
+        auto directory = index < 0 ? QString() : path.left(index);
+
+        auto it = directoryIds.constFind(directory);
+        if (it == directoryIds.constEnd()) {
+            auto utf8 = directory.toUtf8();
+            appendValue<quint32>(directories, static_cast<quint32>(utf8.size()));
+            directories.append(utf8);
+            it = directoryIds.insert(directory, static_cast<quint32>(directoryIds.size()));
+        }
+
+        auto name = path.mid(index + 1).toUtf8();
+        appendValue<quint32>(tracks, it.value());
+        appendValue<quint32>(tracks, static_cast<quint32>(name.size()));
+        tracks.append(name);
+    }
+
+    quint32 positionBits {};
+    std::memcpy(&positionBits, &session.position, sizeof(float));
+
+    QByteArray bytes;
+    bytes.reserve(HEADER_SIZE + directories.size() + tracks.size());
+    bytes.append(MAGIC, sizeof(MAGIC));
+    appendValue<quint32>(bytes, VERSION);
+    appendValue<quint32>(bytes, session.current < 0 ? NO_TRACK : static_cast<quint32>(session.current));
+    appendValue<quint32>(bytes, positionBits);
+    appendValue<quint32>(bytes, (session.repeat ? REPEAT_FLAG : 0) | (session.keepOrder ? KEEP_ORDER_FLAG : 0));
+    appendValue<quint32>(bytes, static_cast<quint32>(directoryIds.size()));
+    appendValue<quint32>(bytes, static_cast<quint32>(session.tracks.size()));
+    bytes.append(directories);
+    bytes.append(tracks);
+
+    QDir().mkpath(QFileInfo(m_path).absolutePath());
+    QSaveFile file(m_path);
+    if (not file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Couldn't save the session to" << m_path << ":" << file.errorString();
+        return false;
+    }
+
+    file.write(bytes);
+    if (not file.commit()) {
+        qWarning() << "Couldn't save the session to" << m_path << ":" << file.errorString();
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,39 @@
+#ifndef SESSIONSTORE_HPP
+#define SESSIONSTORE_HPP
+
+#include <QString>
+#include <QStringList>
+
+/* What the player was doing when it was closed, kept in the config directory:
+ *
+ *   magic | version | current track | position | flags | directory count | track count | directories | tracks
+ *
+ * A track is the index of its directory and its file name, every directory is written once.
+ * The file is read whole before the window shows up, so it holds nothing but the queue.
+ * Saving rewrites the file next to the old one and renames it over.
+ */
+class SessionStore
+{
+public:
+    struct Session
+    {
+        QStringList tracks {};
+        /* Into tracks, -1 when nothing was loaded */
+        int current {-1};
+        /* Seconds into the current track */
+        float position {};
+        bool repeat {};
+        /* The queue was in an order of its own, an imported playlist's for instance, not sorted */
+        bool keepOrder {};
+    };
+private:
+    QString m_path;
+public:
+    static constexpr quint32 VERSION {1};
+
+    explicit SessionStore(QString path);
+    bool load(Session &session) const;
+    bool save(const Session &session) const;
+};
+
+#endif // SESSIONSTORE_HPP
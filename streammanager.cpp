@@ -0,0 +1,197 @@
+#include <algorithm>
+#include <chrono>
+#include <QDebug>
+
+#include "streammanager.hpp"
+#include "tracer.hpp"
+
+StreamManager::StreamManager()
+    : m_cache(nullptr)
+{
+}
+
+StreamManager::~StreamManager()
+{
+    clear();
+}
+
+void StreamManager::setLimits(Limits limits)
+{
+    m_limits = limits;
+}
+
+StreamManager::Limits StreamManager::limits() const
+{
+    return m_limits;
+}
+
+void StreamManager::setCache(const AudioCache *cache)
+{
+    m_cache = cache;
+}
+
+bool StreamManager::hasRoomFor(qint64 bytes) const
+{
+    /* Decoders still being opened count as well, they'll be resident soon */
+    int open = MusicHandle::openHandles() + static_cast<int>(m_abandoned.size());
+    qint64 resident = MusicHandle::totalResidentBytes();
+    for (const auto &entry : m_entries) {
+        if (not entry.ready) {
+            ++open;
+            resident += entry.estimatedBytes;
+        }
+    }
+
+    return open < m_limits.maxOpenDecoders and resident + bytes <= m_limits.maxResidentBytes;
+}
+
+void StreamManager::prime(MusicHandle &handle)
+{
+    TRACE_SCOPE("StreamManager::prime");
+
+    /* Fill both sub-buffers so the first callback after PlayMusicStream already has samples.
+     * UpdateMusicStream shares a scratch buffer inside raylib, so this only runs on the playback thread.
+     */
+    UpdateMusicStream(handle.music());
+}
+
+void StreamManager::keepOnly(const QString &first, const QString &second)
+{
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        if (it->path == first or it->path == second) {
+            ++it;
+            continue;
+        }
+
+        if (not it->ready) {
+            /* Still loading, it will be unloaded once it's done */
+            m_abandoned.push_back(std::move(it->pending));
+        }
+        it = m_entries.erase(it);
+    }
+}
+
+void StreamManager::preload(const QString &path)
+{
+    if (path.isEmpty() or contains(path)) {
+        return;
+    }
+
+    auto estimatedBytes = MusicHandle::estimateResidentBytes(path);
+    if (not hasRoomFor(estimatedBytes)) {
+        qDebug() << "Not preloading" << path << "- stream limits reached.";
+        return;
+    }
+
+    Entry entry;
+    entry.path = path;
+    entry.estimatedBytes = estimatedBytes;
+    /* Only opening the file happens in the background */
+    entry.pending = std::async(std::launch::async, [path, cache = m_cache] { return MusicHandle::load(path, cache); });
+    m_entries.push_back(std::move(entry));
+}
+
+void StreamManager::store(MusicHandle handle)
+{
+    if (not handle.isReady() or contains(handle.path())) {
+        return;
+    }
+
+    /* The handle is already counted, so only its own bytes must fit */
+    auto open = MusicHandle::openHandles();
+    auto resident = MusicHandle::totalResidentBytes();
+    if (open > m_limits.maxOpenDecoders or resident > m_limits.maxResidentBytes) {
+        return;
+    }
+
+    handle.stop();
+    prime(handle);
+
+    Entry entry;
+    entry.path = handle.path();
+    entry.handle = std::move(handle);
+    entry.ready = true;
+    m_entries.push_back(std::move(entry));
+}
+
+bool StreamManager::take(const QString &path, MusicHandle &handle)
+{
+    auto it = std::find_if(m_entries.begin(), m_entries.end(), [&path](const Entry &entry) {
+        return entry.path == path;
+    });
+    if (it == m_entries.end()) {
+        return false;
+    }
+
+    if (not it->ready) {
+        /* It's already on its way, waiting for it is still faster than starting over */
+        it->handle = it->pending.get();
+        if (it->handle.isReady()) {
+            prime(it->handle);
+        }
+    }
+
+    handle = std::move(it->handle);
+    m_entries.erase(it);
+    return handle.isReady();
+}
+
+bool StreamManager::contains(const QString &path) const
+{
+    return std::any_of(m_entries.cbegin(), m_entries.cend(), [&path](const Entry &entry) {
+        return entry.path == path;
+    });
+}
+
+void StreamManager::collect()
+{
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        if (it->ready or it->pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            ++it;
+            continue;
+        }
+
+        it->handle = it->pending.get();
+        if (not it->handle.isReady()) {
+            /* Loading it again from the engine will report the error */
+            it = m_entries.erase(it);
+            continue;
+        }
+
+        prime(it->handle);
+        it->ready = true;
+        ++it;
+    }
+
+    /* Dropping the futures is enough, the handles unload themselves */
+    m_abandoned.erase(std::remove_if(m_abandoned.begin(), m_abandoned.end(), [](std::future<MusicHandle> &pending) {
+        if (pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return false;
+        }
+
+        pending.get();
+        return true;
+    }), m_abandoned.end());
+}
+
+bool StreamManager::hasPending() const
+{
+    return not m_abandoned.empty() or std::any_of(m_entries.cbegin(), m_entries.cend(), [](const Entry &entry) {
+        return not entry.ready;
+    });
+}
+
+void StreamManager::clear()
+{
+    for (auto &entry : m_entries) {
+        if (not entry.ready) {
+            entry.pending.wait();
+        }
+    }
+    m_entries.clear();
+
+    for (auto &pending : m_abandoned) {
+        pending.wait();
+    }
+    m_abandoned.clear();
+}
@@ -0,0 +1,55 @@
+#ifndef STREAMMANAGER_HPP
+#define STREAMMANAGER_HPP
+
+#include <future>
+#include <QString>
+#include <vector>
+
+#include "musichandle.hpp"
+
+/* Keeps the decoders the engine may need next (the neighbours of the current track)
+ * and makes sure the number of open decoders and their memory never exceed the limits.
+ * Only used from the playback thread.
+ */
+class StreamManager
+{
+public:
+    struct Limits
+    {
+        int maxOpenDecoders {4};
+        qint64 maxResidentBytes {64 * 1'024 * 1'024};
+    };
+private:
+    struct Entry
+    {
+        QString path {};
+        std::future<MusicHandle> pending {};
+        MusicHandle handle {};
+        qint64 estimatedBytes {};
+        bool ready {false};
+    };
+
+    Limits m_limits;
+    const AudioCache *m_cache;
+    std::vector<Entry> m_entries;
+    std::vector<std::future<MusicHandle>> m_abandoned;
+
+    bool hasRoomFor(qint64 bytes) const;
+    static void prime(MusicHandle &handle);
+public:
+    StreamManager();
+    ~StreamManager();
+    void setLimits(Limits limits);
+    Limits limits() const;
+    void setCache(const AudioCache *cache);
+    void keepOnly(const QString &first, const QString &second);
+    void preload(const QString &path);
+    void store(MusicHandle handle);
+    bool take(const QString &path, MusicHandle &handle);
+    bool contains(const QString &path) const;
+    void collect();
+    bool hasPending() const;
+    void clear();
+};
+
+#endif // STREAMMANAGER_HPP
@@ -0,0 +1,101 @@
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "loudnessmeter.hpp"
+
+/* Checks the meter against the signals of ITU-R BS.1770-4 and EBU Tech 3341:
+ *   - a 997 Hz sine at full scale in one channel reads -3.01 LUFS,
+ *   - a 1 kHz sine at -23 dBFS in both channels reads -23 LUFS,
+ *   - quiet parts are left out by the relative gate and silence by the absolute gate,
+ *   - a sine whose samples miss its crests still shows its true peak.
+ * Tech 3341 allows 0.1 LU for the loudness cases and +0.2/-0.4 dB for true peak.
+ */
+
+static constexpr double PI {3.14159265358979323846};
+static constexpr int SAMPLE_RATE {48'000};
+static constexpr double LOUDNESS_TOLERANCE {0.1};
+
+struct Segment
+{
+    double seconds;
+    double dbfs;
+};
+
+/* Interleaved sine segments, every channel listed in active gets the signal, the others stay silent */
+static std::vector<float> sine(double frequency, const std::vector<Segment> &segments, int channels,
+                               const std::vector<int> &active, double phase = 0.0)
+{
+    std::vector<float> samples;
+    qint64 frame {};
+    for (const auto &segment : segments) {
+        auto amplitude = std::pow(10.0, segment.dbfs / 20.0);
+        auto frames = static_cast<qint64>(segment.seconds * SAMPLE_RATE);
+        for (qint64 i {}; i < frames; ++i, ++frame) {
+            auto value = static_cast<float>(amplitude * std::sin(2.0 * PI * frequency * frame / SAMPLE_RATE + phase));
+            for (int channel {}; channel < channels; ++channel) {
+                bool on {};
+                for (auto index : active) {
+                    on = on or index == channel;
+                }
+                samples.push_back(on ? value : 0.0f);
+            }
+        }
+    }
+
+    return samples;
+}
+
+static double measure(const std::vector<float> &samples, int channels, float *truePeak = nullptr)
+{
+    LoudnessMeter meter(SAMPLE_RATE, channels);
+    meter.addFrames(samples.data(), static_cast<qint64>(samples.size()) / channels);
+    if (truePeak != nullptr) {
+        *truePeak = meter.truePeak();
+    }
+    return meter.integrated();
+}
+
+static int failures {};
+
+static void expectLoudness(const char *name, double measured, double expected)
+{
+    bool passed = std::fabs(measured - expected) <= LOUDNESS_TOLERANCE;
+    std::printf("%s %s: %.2f LUFS, expected %.2f\n", passed ? "PASS" : "FAIL", name, measured, expected);
+    failures += passed ? 0 : 1;
+}
+
+int main()
+{
+    expectLoudness("997 Hz full scale, one channel",
+                   measure(sine(997.0, {{20.0, 0.0}}, 1, {0}), 1), -3.01);
+    expectLoudness("997 Hz full scale, left of stereo",
+                   measure(sine(997.0, {{20.0, 0.0}}, 2, {0}), 2), -3.01);
+    expectLoudness("Tech 3341 case 1, 1 kHz at -23 dBFS",
+                   measure(sine(1'000.0, {{20.0, -23.0}}, 2, {0, 1}), 2), -23.0);
+    expectLoudness("Tech 3341 case 2, 1 kHz at -33 dBFS",
+                   measure(sine(1'000.0, {{20.0, -33.0}}, 2, {0, 1}), 2), -33.0);
+    expectLoudness("Tech 3341 case 3, relative gate",
+                   measure(sine(1'000.0, {{10.0, -36.0}, {60.0, -23.0}, {10.0, -36.0}}, 2, {0, 1}), 2), -23.0);
+    expectLoudness("Tech 3341 case 4, absolute and relative gate",
+                   measure(sine(1'000.0, {{10.0, -72.0}, {10.0, -36.0}, {60.0, -23.0}, {10.0, -36.0}, {10.0, -72.0}},
+                                2, {0, 1}), 2), -23.0);
+    expectLoudness("Tech 3341 case 5, louder middle",
+                   measure(sine(1'000.0, {{20.0, -26.0}, {20.1, -20.0}, {20.0, -26.0}}, 2, {0, 1}), 2), -23.0);
+
+    /* Nothing above the absolute gate */
+    auto silence = measure(std::vector<float>(SAMPLE_RATE * 10 * 2, 0.0f), 2);
+    bool silent = silence == LoudnessMeter::ABSOLUTE_GATE;
+    std::printf("%s silence: %.2f LUFS\n", silent ? "PASS" : "FAIL", silence);
+    failures += silent ? 0 : 1;
+
+    /* A quarter of the sample rate shifted by 45 degrees: samples land on +-0.707, the crests at 1 */
+    float truePeak {};
+    measure(sine(SAMPLE_RATE / 4.0, {{1.0, 0.0}}, 1, {0}, PI / 4.0), 1, &truePeak);
+    auto peakDb = 20.0 * std::log10(truePeak);
+    bool peakPassed = peakDb >= -0.4 and peakDb <= 0.2;
+    std::printf("%s true peak between samples: %.2f dBTP, expected 0.00\n", peakPassed ? "PASS" : "FAIL", peakDb);
+    failures += peakPassed ? 0 : 1;
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <cstdio>
+#include <QByteArray>
+#include <QCoreApplication>
+#include <QEventLoop>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QTimer>
+
+#include "audiosink.hpp"
+#include "binaryio.hpp"
+#include "playbackengine.hpp"
+
+/* Renders tracks through the WAV sink and compares what was written with the source PCM:
+ *   - two tracks played back to back come out as their samples one after the other, nothing between them,
+ *   - not a single silent frame around the point where one track hands over to the next,
+ *   - a track played from a seek starts at the frame that was asked for.
+ * The tracks are already in the sink's format and nothing is processed, so the output must match bit for bit.
+ */
+
+static constexpr int SAMPLE_RATE {48'000};
+static constexpr int CHANNELS {2};
+static constexpr int FRAME_BYTES {CHANNELS * 2};
+static constexpr qint64 WAV_HEADER_SIZE {44};
+
+/* Noise, so a frame missing or repeated anywhere shows up as a mismatch.
+ * It never hits 0 either, a silent frame can only come from the engine.
+ */
+static QByteArray noise(qint64 frames, quint32 seed)
+{
+    QByteArray samples;
+    samples.reserve(static_cast<int>(frames * FRAME_BYTES));
+    for (qint64 i {}; i < frames * CHANNELS; ++i) {
+        seed = seed * 1'664'525u + 1'013'904'223u;
+        auto sample = static_cast<qint16>(seed >> 16);
+        appendValue<qint16>(samples, sample == 0 ? qint16 {1} : sample);
+    }
+    return samples;
+}
+
+static bool writeWave(const QString &path, const QByteArray &samples)
+{
+    QByteArray wave;
+    wave.append("RIFF");
+    appendValue<quint32>(wave, static_cast<quint32>(WAV_HEADER_SIZE - 8 + samples.size()));
+    wave.append("WAVEfmt ");
+    appendValue<quint32>(wave, 16);
+    appendValue<quint16>(wave, 1);
+    appendValue<quint16>(wave, CHANNELS);
+    appendValue<quint32>(wave, SAMPLE_RATE);
+    appendValue<quint32>(wave, SAMPLE_RATE * FRAME_BYTES);
+    appendValue<quint16>(wave, FRAME_BYTES);
+    appendValue<quint16>(wave, 16);
+    wave.append("data");
+    appendValue<quint32>(wave, static_cast<quint32>(samples.size()));
+    wave.append(samples);
+
+    QFile file(path);
+    return file.open(QIODevice::WriteOnly) and file.write(wave) == wave.size();
+}
+
+static QByteArray readSamples(const QString &path)
+{
+    QFile file(path);
+    if (not file.open(QIODevice::ReadOnly)) {
+        return {};
+    }
+    return file.readAll().mid(WAV_HEADER_SIZE);
+}
+
+/* Plays until the engine runs out of tracks, then closes the sink so its header is complete */
+static QByteArray render(const QString &output, const QString &first, const QString &next, float seekSeconds)
+{
+    PlaybackEngine engine;
+    engine.setSink(AudioSink::create(AudioSink::Kind::WavFile, output), 0.0f);
+
+    QEventLoop loop;
+    QObject::connect(&engine, &PlaybackEngine::trackFinished, &loop, &QEventLoop::quit);
+    QObject::connect(&engine, &PlaybackEngine::loadFailed, &loop, &QEventLoop::quit);
+    QTimer::singleShot(30'000, &loop, &QEventLoop::quit);
+
+    engine.load(first);
+    engine.setNeighbours({}, next);
+    if (seekSeconds > 0.0f) {
+        engine.seek(seekSeconds);
+    }
+    engine.play();
+    loop.exec();
+    engine.shutdown();
+
+    return readSamples(output);
+}
+
+static int failures {};
+
+static void expectSamples(const char *name, const QByteArray &written, const QByteArray &expected)
+{
+    qint64 mismatch {-1};
+    auto common = std::min(written.size(), expected.size());
+    for (int i {}; i < common; ++i) {
+        if (written[i] != expected[i]) {
+            mismatch = i / FRAME_BYTES;
+            break;
+        }
+    }
+
+    bool passed = mismatch < 0 and written.size() == expected.size();
+    std::printf("%s %s: %lld frames written, %lld expected", passed ? "PASS" : "FAIL", name,
+                static_cast<long long>(written.size() / FRAME_BYTES), static_cast<long long>(expected.size() / FRAME_BYTES));
+    if (mismatch >= 0) {
+        std::printf(", first difference at frame %lld", static_cast<long long>(mismatch));
+    }
+    std::printf("\n");
+    failures += passed ? 0 : 1;
+}
+
+/* Ten milliseconds either side of the handover, a pump round's worth */
+static void expectNoSilence(const char *name, const QByteArray &written, qint64 boundary)
+{
+    static constexpr qint64 WINDOW {SAMPLE_RATE / 100};
+
+    qint64 silent {};
+    auto first = std::max<qint64>(boundary - WINDOW, 0);
+    auto last = std::min<qint64>(boundary + WINDOW, written.size() / FRAME_BYTES);
+    for (auto frame = first; frame < last; ++frame) {
+        auto bytes = written.mid(static_cast<int>(frame * FRAME_BYTES), FRAME_BYTES);
+        silent += bytes.count('\0') == FRAME_BYTES ? 1 : 0;
+    }
+
+    bool passed = silent == 0 and last - first == 2 * WINDOW;
+    std::printf("%s %s: %lld silent frames around frame %lld\n", passed ? "PASS" : "FAIL", name,
+                static_cast<long long>(silent), static_cast<long long>(boundary));
+    failures += passed ? 0 : 1;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QTemporaryDir directory;
+    auto first = directory.filePath("first.wav");
+    auto second = directory.filePath("second.wav");
+    /* Lengths that don't line up with the engine's rounds of writing */
+    auto firstSamples = noise(SAMPLE_RATE * 3 / 2 + 17, 1);
+    auto secondSamples = noise(SAMPLE_RATE + 4'801, 2);
+    if (not writeWave(first, firstSamples) or not writeWave(second, secondSamples)) {
+        std::printf("FAIL couldn't write the tracks to %s\n", qPrintable(directory.path()));
+        return 1;
+    }
+
+    auto gapless = render(directory.filePath("gapless.wav"), first, second, 0.0f);
+    expectSamples("gapless advance", gapless, firstSamples + secondSamples);
+    expectNoSilence("no silence at the handover", gapless, firstSamples.size() / FRAME_BYTES);
+
+    /* A quarter of a second into the first track, the second one still follows */
+    static constexpr float SEEK_SECONDS {0.25f};
+    expectSamples("seek then advance",
+                  render(directory.filePath("seek.wav"), first, second, SEEK_SECONDS),
+                  firstSamples.mid(static_cast<int>(SEEK_SECONDS * SAMPLE_RATE) * FRAME_BYTES) + secondSamples);
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,345 @@
+#include "tracer.hpp"
+
+#ifdef BITMPLAYER_TRACING
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QSaveFile>
+#include <QTextStream>
+#include <QThread>
+#include <vector>
+
+namespace {
+
+enum class EventType : quint8 { Span, Counter, Instant };
+
+struct Event
+{
+    const char *name;
+    qint64 start;
+    /* Duration of spans, value of counters */
+    qint64 value;
+    quint32 thread;
+    EventType type;
+};
+
+/* About ten minutes of the playback thread pumping every 10 ms */
+constexpr quint64 RING_CAPACITY {1 << 16};
+
+/* An event as its owner writes it. The sequence is odd while it's being written and tells which
+ * write it holds once it's done, exporting copies it and checks the sequence didn't move meanwhile.
+ */
+struct RingEntry
+{
+    std::atomic<quint64> sequence {0};
+    std::atomic<const char *> name {nullptr};
+    std::atomic<qint64> start {0};
+    std::atomic<qint64> value {0};
+    std::atomic<quint32> thread {0};
+    std::atomic<EventType> type {EventType::Span};
+};
+
+struct Ring
+{
+    std::array<RingEntry, RING_CAPACITY> events {};
+    std::atomic<quint64> written {0};
+};
+
+/* Rings outlive their threads so their events can still be exported,
+ * the next thread that starts recording takes an idle one over.
+ */
+struct Registry
+{
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Ring>> rings;
+    std::vector<Ring *> idle;
+    std::vector<QString> threadNames;
+};
+
+Registry &registry()
+{
+    static Registry instance;
+    return instance;
+}
+
+struct ThreadSlot
+{
+    Ring *ring {nullptr};
+    quint32 thread {};
+
+    ~ThreadSlot()
+    {
+        if (ring == nullptr) {
+            return;
+        }
+
+        auto &registry = ::registry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.idle.push_back(ring);
+    }
+};
+
+thread_local ThreadSlot t_slot;
+
+/* The audio device's thread can't take the registry's lock or allocate, its ring is set up beforehand */
+std::atomic<Ring *> s_audioRing {nullptr};
+quint32 s_audioThread {};
+
+/* Powers of two in microseconds, the last bucket takes everything longer */
+constexpr int JITTER_BUCKETS {18};
+std::array<std::atomic<quint64>, JITTER_BUCKETS> s_jitter {};
+std::atomic<qint64> s_lastCallback {0};
+std::atomic<qint64> s_lastInterval {0};
+
+ThreadSlot &slot()
+{
+    if (t_slot.ring != nullptr) {
+        return t_slot;
+    }
+
+    auto &registry = ::registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    if (registry.idle.empty()) {
+        registry.rings.push_back(std::make_unique<Ring>());
+        t_slot.ring = registry.rings.back().get();
+    } else {
+        t_slot.ring = registry.idle.back();
+        registry.idle.pop_back();
+    }
+
+    auto *thread = QThread::currentThread();
+    auto *application = QCoreApplication::instance();
+    auto name = application != nullptr and thread == application->thread() ? QString("GUI") : thread->objectName();
+
+    t_slot.thread = static_cast<quint32>(registry.threadNames.size());
+    registry.threadNames.push_back(name.isEmpty() ? QString("Thread %1").arg(t_slot.thread) : name);
+    return t_slot;
+}
+
+void write(Ring &ring, quint32 thread, const char *name, qint64 start, qint64 value, EventType type)
+{
+    auto index = ring.written.load(std::memory_order_relaxed);
+    auto &entry = ring.events[index % RING_CAPACITY];
+    entry.sequence.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    entry.name.store(name, std::memory_order_relaxed);
+    entry.start.store(start, std::memory_order_relaxed);
+    entry.value.store(value, std::memory_order_relaxed);
+    entry.thread.store(thread, std::memory_order_relaxed);
+    entry.type.store(type, std::memory_order_relaxed);
+    entry.sequence.store(2 * index + 2, std::memory_order_release);
+    /* Exporting only reads what was published */
+    ring.written.store(index + 1, std::memory_order_release);
+}
+
+void record(const char *name, qint64 start, qint64 value, EventType type)
+{
+    auto &slot = ::slot();
+    write(*slot.ring, slot.thread, name, start, value, type);
+}
+
+/* False when the owner wrote over it while it was being copied */
+bool read(const Ring &ring, quint64 index, Event &event)
+{
+    const auto &entry = ring.events[index % RING_CAPACITY];
+    auto sequence = entry.sequence.load(std::memory_order_acquire);
+    if (sequence != 2 * index + 2) {
+        return false;
+    }
+
+    event.name = entry.name.load(std::memory_order_relaxed);
+    event.start = entry.start.load(std::memory_order_relaxed);
+    event.value = entry.value.load(std::memory_order_relaxed);
+    event.thread = entry.thread.load(std::memory_order_relaxed);
+    event.type = entry.type.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return entry.sequence.load(std::memory_order_relaxed) == sequence;
+}
+
+QString escaped(QString text)
+{
+    return text.replace('\\', "\\\\").replace('"', "\\\"");
+}
+
+QString microseconds(qint64 nanoseconds)
+{
+    return QString::number(static_cast<double>(nanoseconds) / 1'000.0, 'f', 3);
+}
+
+}
+
+Tracer::Span::Span(const char *name)
+    : m_name(name)
+    , m_start(now())
+{
+}
+
+Tracer::Span::~Span()
+{
+    record(m_name, m_start, now() - m_start, EventType::Span);
+}
+
+Tracer::AudioSpan::AudioSpan(const char *name)
+    : m_name(name)
+    , m_start(now())
+{
+}
+
+Tracer::AudioSpan::~AudioSpan()
+{
+    if (auto *ring = s_audioRing.load(std::memory_order_acquire)) {
+        write(*ring, s_audioThread, m_name, m_start, now() - m_start, EventType::Span);
+    }
+}
+
+qint64 Tracer::now()
+{
+    static const auto origin = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+}
+
+void Tracer::counter(const char *name, qint64 value)
+{
+    record(name, now(), value, EventType::Counter);
+}
+
+void Tracer::instant(const char *name)
+{
+    record(name, now(), 0, EventType::Instant);
+}
+
+void Tracer::prepareAudioCallback()
+{
+    auto &registry = ::registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    if (s_audioRing.load(std::memory_order_relaxed) != nullptr) {
+        return;
+    }
+
+    registry.rings.push_back(std::make_unique<Ring>());
+    s_audioThread = static_cast<quint32>(registry.threadNames.size());
+    registry.threadNames.push_back("Audio callback");
+    s_audioRing.store(registry.rings.back().get(), std::memory_order_release);
+}
+
+void Tracer::audioCallback([[maybe_unused]] void *buffer, [[maybe_unused]] unsigned int frames)
+{
+    auto *ring = s_audioRing.load(std::memory_order_acquire);
+    if (ring == nullptr) {
+        return;
+    }
+
+    auto tick = now();
+    auto last = s_lastCallback.exchange(tick);
+    if (last == 0) {
+        return;
+    }
+
+    /* Jitter is how much an interval differs from the one before it */
+    auto interval = tick - last;
+    auto previous = s_lastInterval.exchange(interval);
+    if (previous != 0) {
+        auto jitter = std::llabs(interval - previous) / 1'000;
+        int bucket {};
+        while (bucket < JITTER_BUCKETS - 1 and (qint64(1) << bucket) <= jitter) {
+            ++bucket;
+        }
+        s_jitter[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    write(*ring, s_audioThread, "Audio callback interval (us)", tick, interval / 1'000, EventType::Counter);
+}
+
+bool Tracer::exportChromeTrace(const QString &path)
+{
+    std::vector<Event> events;
+    std::vector<QString> threadNames;
+    {
+        auto &registry = ::registry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        threadNames = registry.threadNames;
+
+        /* The owners keep recording meanwhile, what they wrote over is left out */
+        for (const auto &ring : registry.rings) {
+            auto end = ring->written.load(std::memory_order_acquire);
+            auto begin = end > RING_CAPACITY ? end - RING_CAPACITY : 0;
+            Event event {};
+            for (auto index = begin; index < end; ++index) {
+                if (read(*ring, index, event)) {
+                    events.push_back(event);
+                }
+            }
+        }
+    }
+
+    QSaveFile file(path);
+    if (not file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Couldn't write trace to" << path << ":" << file.errorString();
+        return false;
+    }
+
+    QTextStream stream(&file);
+    stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+    bool first {true};
+    auto separator = [&stream, &first] {
+        if (not first) {
+            stream << ",\n";
+        }
+        first = false;
+    };
+
+    for (quint32 thread {}; thread < threadNames.size(); ++thread) {
+        separator();
+        stream << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread
+               << ",\"args\":{\"name\":\"" << escaped(threadNames[thread]) << "\"}}";
+    }
+
+    for (const auto &event : events) {
+        separator();
+        stream << "{\"name\":\"" << event.name << "\",\"pid\":1,\"tid\":" << event.thread
+               << ",\"ts\":" << microseconds(event.start);
+        switch (event.type) {
+        case EventType::Span:
+            stream << ",\"ph\":\"X\",\"dur\":" << microseconds(event.value) << "}";
+            break;
+        case EventType::Counter:
+            stream << ",\"ph\":\"C\",\"args\":{\"value\":" << event.value << "}}";
+            break;
+        case EventType::Instant:
+            stream << ",\"ph\":\"i\",\"s\":\"t\"}";
+            break;
+        }
+    }
+
+    stream << "\n],\"otherData\":{\"audioCallbackJitterUs\":{";
+    for (int bucket {}; bucket < JITTER_BUCKETS; ++bucket) {
+        QString label;
+        if (bucket == 0) {
+            label = "<1";
+        } else if (bucket == JITTER_BUCKETS - 1) {
+            label = QString(">=%1").arg(qint64(1) << (bucket - 1));
+        } else {
+            label = QString("%1-%2").arg(qint64(1) << (bucket - 1)).arg(qint64(1) << bucket);
+        }
+
+        stream << (bucket == 0 ? "" : ",") << "\"" << label << "\":" << s_jitter[bucket].load();
+    }
+    stream << "}}}\n";
+    stream.flush();
+
+    if (not file.commit()) {
+        qWarning() << "Couldn't write trace to" << path << ":" << file.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef TRACER_HPP
+#define TRACER_HPP
+
+#include <QString>
+#include <QtGlobal>
+
+/* Scoped spans, counters and a histogram of the audio callback jitter, exported as a Chrome trace
+ * that chrome://tracing and ui.perfetto.dev open.
+ * Only compiled in with -DBITMPLAYER_TRACING=ON, otherwise the macros expand to nothing.
+ *
+ * Every thread records into its own ring buffer without locking, long sessions keep the newest events.
+ * Exporting can happen while they record, events overwritten during the copy are left out.
+ * Names must be string literals, only the pointer is stored.
+ */
+#ifdef BITMPLAYER_TRACING
+class Tracer
+{
+public:
+    class Span
+    {
+        const char *m_name;
+        qint64 m_start;
+    public:
+        explicit Span(const char *name);
+        ~Span();
+        Span(const Span &) = delete;
+        Span &operator=(const Span &) = delete;
+    };
+
+    /* For the audio device's thread, which must not lock or allocate: goes to the ring prepareAudioCallback() set up,
+     * and is left out until it did
+     */
+    class AudioSpan
+    {
+        const char *m_name;
+        qint64 m_start;
+    public:
+        explicit AudioSpan(const char *name);
+        ~AudioSpan();
+        AudioSpan(const AudioSpan &) = delete;
+        AudioSpan &operator=(const AudioSpan &) = delete;
+    };
+
+    static qint64 now();
+    static void counter(const char *name, qint64 value);
+    static void instant(const char *name);
+    /* Before attaching the callback, it records into a ring set up here */
+    static void prepareAudioCallback();
+    /* Matches raylib's AudioCallback, meant for AttachAudioMixedProcessor */
+    static void audioCallback(void *buffer, unsigned int frames);
+    static bool exportChromeTrace(const QString &path);
+};
+
+#define TRACE_CONCAT_(first, second) first##second
+#define TRACE_CONCAT(first, second) TRACE_CONCAT_(first, second)
+#define TRACE_SCOPE(name) Tracer::Span TRACE_CONCAT(traceSpan, __LINE__)(name)
+#define TRACE_AUDIO_SCOPE(name) Tracer::AudioSpan TRACE_CONCAT(traceAudioSpan, __LINE__)(name)
+#define TRACE_COUNTER(name, value) Tracer::counter(name, value)
+#define TRACE_INSTANT(name) Tracer::instant(name)
+#else
+#define TRACE_SCOPE(name) static_cast<void>(0)
+#define TRACE_AUDIO_SCOPE(name) static_cast<void>(0)
+#define TRACE_COUNTER(name, value) static_cast<void>(0)
+#define TRACE_INSTANT(name) static_cast<void>(0)
+#endif
+
+#endif // TRACER_HPP
@@ -0,0 +1,292 @@
+#include <algorithm>
+
+#include "tracer.hpp"
+#include "trackfiltermodel.hpp"
+
+static constexpr int REFILTER_DELAY {300};
+/* Past this many separate runs of rows coming and going, resetting is cheaper for the views */
+static constexpr size_t MAX_ROW_RUNS {256};
+
+TrackFilterModel::TrackFilterModel(TrackTable *tracks, QObject *parent)
+    : QAbstractProxyModel(parent)
+    , m_tracks(tracks)
+{
+    m_refilterTimer.setSingleShot(true);
+    m_refilterTimer.setInterval(REFILTER_DELAY);
+    connect(&m_refilterTimer, &QTimer::timeout, this, [this] {
+        if (isFiltering()) {
+            updateRows();
+        }
+    });
+}
+
+void TrackFilterModel::setSourceModel(QAbstractItemModel *sourceModel)
+{
+    beginResetModel();
+    if (this->sourceModel() != nullptr) {
+        disconnect(this->sourceModel(), nullptr, this, nullptr);
+    }
+    QAbstractProxyModel::setSourceModel(sourceModel);
+    if (sourceModel == nullptr) {
+        m_rows.clear();
+        endResetModel();
+        return;
+    }
+
+    /* Unfiltered, changes are passed on row for row. Filtered, the rows after the change move along
+     * with it, removed ones go right away and inserted ones show up where the query matches them
+     */
+    connect(sourceModel, &QAbstractItemModel::rowsAboutToBeInserted, this, [this](const QModelIndex &, int first, int last) {
+        if (not isFiltering()) {
+            beginInsertRows(QModelIndex(), first, last);
+        }
+    });
+    connect(sourceModel, &QAbstractItemModel::rowsInserted, this, [this](const QModelIndex &, int first, int last) {
+        if (not isFiltering()) {
+            endInsertRows();
+            return;
+        }
+
+        auto count = last - first + 1;
+        for (auto it = std::lower_bound(m_rows.begin(), m_rows.end(), first); it != m_rows.end(); ++it) {
+            *it += count;
+        }
+        updateRows();
+    });
+    connect(sourceModel, &QAbstractItemModel::rowsAboutToBeRemoved, this, [this](const QModelIndex &, int first, int last) {
+        if (not isFiltering()) {
+            beginRemoveRows(QModelIndex(), first, last);
+            return;
+        }
+
+        /* While the source still has them, the views may look at their neighbours meanwhile */
+        auto from = std::lower_bound(m_rows.begin(), m_rows.end(), first);
+        auto to = std::upper_bound(from, m_rows.end(), last);
+        if (from != to) {
+            beginRemoveRows(QModelIndex(), static_cast<int>(from - m_rows.begin()), static_cast<int>(to - m_rows.begin()) - 1);
+            m_rows.erase(from, to);
+            endRemoveRows();
+        }
+    });
+    connect(sourceModel, &QAbstractItemModel::rowsRemoved, this, [this](const QModelIndex &, int first, int last) {
+        if (not isFiltering()) {
+            endRemoveRows();
+            return;
+        }
+
+        auto count = last - first + 1;
+        for (auto it = std::lower_bound(m_rows.begin(), m_rows.end(), first); it != m_rows.end(); ++it) {
+            *it -= count;
+        }
+    });
+    connect(sourceModel, &QAbstractItemModel::modelAboutToBeReset, this, [this] {
+        beginResetModel();
+    });
+    connect(sourceModel, &QAbstractItemModel::modelReset, this, [this] {
+        refilter();
+        endResetModel();
+    });
+    connect(sourceModel, &QAbstractItemModel::layoutAboutToBeChanged, this, [this] {
+        emit layoutAboutToBeChanged();
+        m_layoutIndexes = persistentIndexList();
+        m_layoutSources.clear();
+        for (const auto &index : m_layoutIndexes) {
+            m_layoutSources.append(QPersistentModelIndex(mapToSource(index)));
+        }
+    });
+    connect(sourceModel, &QAbstractItemModel::layoutChanged, this, [this] {
+        refilter();
+        QModelIndexList to;
+        for (const auto &source : m_layoutSources) {
+            to.append(mapFromSource(source));
+        }
+        changePersistentIndexList(m_layoutIndexes, to);
+        m_layoutIndexes.clear();
+        m_layoutSources.clear();
+        emit layoutChanged();
+    });
+    connect(sourceModel, &QAbstractItemModel::dataChanged, this, &TrackFilterModel::onSourceDataChanged);
+
+    refilter();
+    endResetModel();
+}
+
+QModelIndex TrackFilterModel::mapToSource(const QModelIndex &proxyIndex) const
+{
+    if (not proxyIndex.isValid() or sourceModel() == nullptr) {
+        return {};
+    }
+
+    if (not isFiltering()) {
+        return sourceModel()->index(proxyIndex.row(), proxyIndex.column());
+    }
+
+    if (proxyIndex.row() >= static_cast<int>(m_rows.size())) {
+        return {};
+    }
+
+    return sourceModel()->index(m_rows[proxyIndex.row()], proxyIndex.column());
+}
+
+QModelIndex TrackFilterModel::mapFromSource(const QModelIndex &sourceIndex) const
+{
+    if (not sourceIndex.isValid()) {
+        return {};
+    }
+
+    if (not isFiltering()) {
+        return index(sourceIndex.row(), sourceIndex.column());
+    }
+
+    /* Filtered out rows have no index here */
+    auto it = std::lower_bound(m_rows.cbegin(), m_rows.cend(), sourceIndex.row());
+    if (it == m_rows.cend() or *it != sourceIndex.row()) {
+        return {};
+    }
+
+    return index(static_cast<int>(it - m_rows.cbegin()), sourceIndex.column());
+}
+
+QModelIndex TrackFilterModel::index(int row, int column, const QModelIndex &parent) const
+{
+    if (parent.isValid() or row < 0 or row >= rowCount() or column != 0) {
+        return {};
+    }
+
+    return createIndex(row, column);
+}
+
+QModelIndex TrackFilterModel::parent([[maybe_unused]] const QModelIndex &child) const
+{
+    return {};
+}
+
+int TrackFilterModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid() or sourceModel() == nullptr) {
+        return 0;
+    }
+
+    return isFiltering() ? static_cast<int>(m_rows.size()) : sourceModel()->rowCount();
+}
+
+int TrackFilterModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : 1;
+}
+
+void TrackFilterModel::setQuery(const QString &query)
+{
+    auto simplified = query.simplified();
+    if (simplified == m_query) {
+        return;
+    }
+
+    /* Narrowing or widening a query keeps most rows, turning it on or off changes all of them */
+    if (isFiltering() and not simplified.isEmpty()) {
+        m_query = simplified;
+        updateRows();
+        return;
+    }
+
+    beginResetModel();
+    m_query = simplified;
+    refilter();
+    endResetModel();
+}
+
+bool TrackFilterModel::isFiltering() const
+{
+    return not m_query.isEmpty();
+}
+
+void TrackFilterModel::refilter()
+{
+    TRACE_SCOPE("TrackFilterModel::refilter");
+    m_refilterTimer.stop();
+    m_rows.clear();
+    if (isFiltering()) {
+        m_rows = m_tracks->search(m_query);
+    }
+}
+
+void TrackFilterModel::updateRows()
+{
+    TRACE_SCOPE("TrackFilterModel::updateRows");
+    m_refilterTimer.stop();
+    auto rows = m_tracks->search(m_query);
+
+    /* Both are sorted, the rows that stop matching come in runs of proxy rows, and so do the new ones
+     * once those are gone
+     */
+    std::vector<std::pair<int, int>> removed;
+    std::vector<int> kept;
+    kept.reserve(std::min(rows.size(), m_rows.size()));
+    for (size_t i {}; i < m_rows.size();) {
+        if (std::binary_search(rows.cbegin(), rows.cend(), m_rows[i])) {
+            kept.push_back(m_rows[i++]);
+            continue;
+        }
+
+        auto first = i;
+        while (i < m_rows.size() and not std::binary_search(rows.cbegin(), rows.cend(), m_rows[i])) {
+            ++i;
+        }
+        removed.emplace_back(static_cast<int>(first), static_cast<int>(i) - 1);
+    }
+
+    std::vector<std::pair<int, int>> inserted;
+    size_t keptIndex {};
+    for (size_t i {}; i < rows.size();) {
+        if (keptIndex < kept.size() and kept[keptIndex] == rows[i]) {
+            ++keptIndex;
+            ++i;
+            continue;
+        }
+
+        auto first = i;
+        while (i < rows.size() and (keptIndex >= kept.size() or kept[keptIndex] != rows[i])) {
+            ++i;
+        }
+        inserted.emplace_back(static_cast<int>(first), static_cast<int>(i) - 1);
+    }
+
+    if (removed.size() + inserted.size() > MAX_ROW_RUNS) {
+        beginResetModel();
+        m_rows = std::move(rows);
+        endResetModel();
+        return;
+    }
+
+    /* From the back, so the runs still to go keep their place */
+    for (auto it = removed.crbegin(); it != removed.crend(); ++it) {
+        beginRemoveRows(QModelIndex(), it->first, it->second);
+        m_rows.erase(m_rows.begin() + it->first, m_rows.begin() + it->second + 1);
+        endRemoveRows();
+    }
+
+    /* From the front, everything before a run is already where it ends up */
+    for (const auto &[first, last] : inserted) {
+        beginInsertRows(QModelIndex(), first, last);
+        m_rows.insert(m_rows.begin() + first, rows.cbegin() + first, rows.cbegin() + last + 1);
+        endInsertRows();
+    }
+}
+
+void TrackFilterModel::onSourceDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles)
+{
+    if (not isFiltering()) {
+        emit dataChanged(index(topLeft.row(), 0), index(bottomRight.row(), 0), roles);
+        return;
+    }
+
+    /* New tags may match the query, or stop matching it */
+    m_refilterTimer.start();
+
+    auto first = std::lower_bound(m_rows.cbegin(), m_rows.cend(), topLeft.row());
+    auto last = std::upper_bound(first, m_rows.cend(), bottomRight.row());
+    if (first != last) {
+        emit dataChanged(index(static_cast<int>(first - m_rows.cbegin()), 0),
+                         index(static_cast<int>(last - m_rows.cbegin()) - 1, 0), roles);
+    }
+}
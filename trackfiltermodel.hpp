@@ -0,0 +1,44 @@
+#ifndef TRACKFILTERMODEL_HPP
+#define TRACKFILTERMODEL_HPP
+
+#include <QAbstractProxyModel>
+#include <QList>
+#include <QPersistentModelIndex>
+#include <QTimer>
+#include <vector>
+
+#include "tracktable.hpp"
+
+/* Shows the rows of the track list model that match what was typed in the search box.
+ * It keeps the matching row numbers only, the tracks stay where they are. Without a query
+ * it passes everything through as is.
+ */
+class TrackFilterModel : public QAbstractProxyModel
+{
+    Q_OBJECT
+    TrackTable *m_tracks;
+    QString m_query;
+    std::vector<int> m_rows;
+    /* Tags arrive in batches while probing, matching them again is done once they settle */
+    QTimer m_refilterTimer;
+    /* Persistent indexes of the views while the track model moves rows around */
+    QModelIndexList m_layoutIndexes;
+    QList<QPersistentModelIndex> m_layoutSources;
+
+    bool isFiltering() const;
+    void refilter();
+    void updateRows();
+    void onSourceDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles);
+public:
+    explicit TrackFilterModel(TrackTable *tracks, QObject *parent = nullptr);
+    void setSourceModel(QAbstractItemModel *sourceModel) override;
+    QModelIndex mapToSource(const QModelIndex &proxyIndex) const override;
+    QModelIndex mapFromSource(const QModelIndex &sourceIndex) const override;
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex &child) const override;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    void setQuery(const QString &query);
+};
+
+#endif // TRACKFILTERMODEL_HPP
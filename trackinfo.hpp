@@ -0,0 +1,57 @@
+#ifndef TRACKINFO_HPP
+#define TRACKINFO_HPP
+
+#include <QString>
+
+enum class Codec : quint8 { Unknown, Wav, Ogg, Mp3, Flac, Qoa, Xm, Mod };
+
+/* ReplayGain from the tags, gains in dB, peaks linear with 0 for unknown */
+struct ReplayGain
+{
+    float trackGain {};
+    float trackPeak {};
+    float albumGain {};
+    float albumPeak {};
+    bool hasTrack {false};
+    bool hasAlbum {false};
+};
+
+/* What we know about a song without decoding it */
+struct TrackInfo
+{
+    QString title;
+    QString artist;
+    QString album;
+    float duration {};
+    quint32 sampleRate {};
+    quint8 channels {};
+    Codec codec {Codec::Unknown};
+    ReplayGain replayGain {};
+    bool probed {false};
+};
+
+inline QString codecName(Codec codec)
+{
+    switch (codec) {
+    case Codec::Wav:
+        return "WAV";
+    case Codec::Ogg:
+        return "OGG";
+    case Codec::Mp3:
+        return "MP3";
+    case Codec::Flac:
+        return "FLAC";
+    case Codec::Qoa:
+        return "QOA";
+    case Codec::Xm:
+        return "XM";
+    case Codec::Mod:
+        return "MOD";
+    case Codec::Unknown:
+        break;
+    }
+
+    return {};
+}
+
+#endif // TRACKINFO_HPP
@@ -0,0 +1,238 @@
+#include <algorithm>
+
+#include "tracer.hpp"
+#include "tracklistmodel.hpp"
+
+/* Past this many runs of rows, the views are told to start over and the table drops them all at once */
+static constexpr size_t MAX_REMOVAL_RUNS {256};
+
+static QString durationText(float duration)
+{
+    auto seconds = static_cast<int>(duration + 0.5f);
+    if (seconds >= 3'600) {
+        return QString("%1:%2:%3")
+            .arg(seconds / 3'600)
+            .arg(seconds / 60 % 60, 2, 10, QChar('0'))
+            .arg(seconds % 60, 2, 10, QChar('0'));
+    }
+
+    return QString("%1:%2").arg(seconds / 60).arg(seconds % 60, 2, 10, QChar('0'));
+}
+
+TrackListModel::TrackListModel(TrackTable *tracks, QObject *parent)
+    : QAbstractListModel(parent)
+    , m_tracks(tracks)
+{
+}
+
+int TrackListModel::rowCount(const QModelIndex &parent) const
+{
+    /* It's a flat list, items don't have children */
+    if (parent.isValid()) {
+        return 0;
+    }
+
+    return m_tracks->count();
+}
+
+QVariant TrackListModel::data(const QModelIndex &index, int role) const
+{
+    if (not index.isValid() or index.row() >= m_tracks->count()) {
+        return {};
+    }
+
+    const auto &info = m_tracks->info(index.row());
+    if (role == Qt::DisplayRole) {
+        if (info.duration <= 0) {
+            return m_tracks->name(index.row());
+        }
+        return QString("%1 (%2)").arg(m_tracks->name(index.row()), durationText(info.duration));
+    } else if (role == Qt::ToolTipRole) {
+        auto text = m_tracks->path(index.row());
+        if (not info.title.isEmpty()) {
+            text += QString("\n%1").arg(info.title);
+            if (not info.artist.isEmpty()) {
+                text += tr(" by %1").arg(info.artist);
+            }
+            if (not info.album.isEmpty()) {
+                text += QString(" (%1)").arg(info.album);
+            }
+        }
+
+        if (info.codec != Codec::Unknown) {
+            text += tr("\n%1, %2 Hz, %3 channel(s)")
+                        .arg(codecName(info.codec), QString::number(info.sampleRate), QString::number(info.channels));
+        }
+        return text;
+    }
+
+    return {};
+}
+
+void TrackListModel::addTracks(const QStringList &paths)
+{
+    TRACE_SCOPE("TrackListModel::addTracks");
+    QStringList fresh;
+    for (const auto &path : paths) {
+        if (not path.isEmpty() and not m_tracks->contains(path)) {
+            fresh.append(path);
+        }
+    }
+    fresh.removeDuplicates();
+    if (fresh.isEmpty()) {
+        return;
+    }
+
+    /* New songs land anywhere in the sorted list. They're inserted at the end and then moved
+     * into place, so views keep their selection and scroll position
+     */
+    auto first = m_tracks->count();
+    beginInsertRows(QModelIndex(), first, first + static_cast<int>(fresh.size()) - 1);
+    m_tracks->appendNew(fresh);
+    endInsertRows();
+
+    emit layoutAboutToBeChanged();
+    auto from = persistentIndexList();
+    std::vector<TrackId> ids;
+    ids.reserve(static_cast<size_t>(from.size()));
+    for (const auto &index : from) {
+        ids.push_back(m_tracks->id(index.row()));
+    }
+
+    m_tracks->sortFrom(first);
+
+    QModelIndexList to;
+    to.reserve(from.size());
+    for (auto id : ids) {
+        to.append(index(m_tracks->row(id)));
+    }
+    changePersistentIndexList(from, to);
+    emit layoutChanged();
+}
+
+void TrackListModel::appendTracks(const QStringList &paths)
+{
+    TRACE_SCOPE("TrackListModel::appendTracks");
+    QStringList fresh;
+    for (const auto &path : paths) {
+        if (not path.isEmpty() and not m_tracks->contains(path)) {
+            fresh.append(path);
+        }
+    }
+    fresh.removeDuplicates();
+    if (fresh.isEmpty()) {
+        return;
+    }
+
+    /* Whoever made the list chose the order, they stay at the end as they came */
+    auto first = m_tracks->count();
+    beginInsertRows(QModelIndex(), first, first + static_cast<int>(fresh.size()) - 1);
+    m_tracks->appendInOrder(fresh);
+    endInsertRows();
+}
+
+void TrackListModel::setTracks(const QStringList &paths, bool keepOrder)
+{
+    TRACE_SCOPE("TrackListModel::setTracks");
+    beginResetModel();
+    m_tracks->clear();
+    if (keepOrder) {
+        m_tracks->appendInOrder(paths);
+    } else {
+        m_tracks->add(paths);
+    }
+    endResetModel();
+}
+
+int TrackListModel::appendTrack(const QString &path)
+{
+    auto row = m_tracks->indexOf(path);
+    if (row != TrackTable::INVALID_ROW) {
+        return row;
+    }
+
+    beginInsertRows(QModelIndex(), m_tracks->count(), m_tracks->count());
+    row = m_tracks->append(path);
+    endInsertRows();
+    return row;
+}
+
+void TrackListModel::removeTrack(int row)
+{
+    if (row < 0 or row >= m_tracks->count()) {
+        return;
+    }
+
+    beginRemoveRows(QModelIndex(), row, row);
+    m_tracks->removeAt(row);
+    endRemoveRows();
+}
+
+void TrackListModel::removeTracks(std::vector<int> rows)
+{
+    TRACE_SCOPE("TrackListModel::removeTracks");
+    rows.erase(std::remove_if(rows.begin(), rows.end(), [this](int row) {
+        return row < 0 or row >= m_tracks->count();
+    }), rows.end());
+    std::sort(rows.begin(), rows.end());
+    rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+
+    size_t runs {};
+    for (size_t i {}; i < rows.size(); ++i) {
+        runs += i == 0 or rows[i - 1] != rows[i] - 1 ? 1 : 0;
+    }
+    if (runs > MAX_REMOVAL_RUNS) {
+        beginResetModel();
+        m_tracks->removeRows(rows);
+        endResetModel();
+        return;
+    }
+
+    /* From the bottom up, a run of rows at a time: the queue is sorted by directory,
+     * so a whole album going away is a single removal
+     */
+    auto last = rows.size();
+    while (last > 0) {
+        auto first = last - 1;
+        while (first > 0 and rows[first - 1] == rows[first] - 1) {
+            --first;
+        }
+
+        auto row = rows[first];
+        auto count = static_cast<int>(last - first);
+        beginRemoveRows(QModelIndex(), row, row + count - 1);
+        m_tracks->removeRange(row, count);
+        endRemoveRows();
+        last = first;
+    }
+}
+
+void TrackListModel::clear()
+{
+    if (m_tracks->isEmpty()) {
+        return;
+    }
+
+    beginResetModel();
+    m_tracks->clear();
+    endResetModel();
+}
+
+void TrackListModel::setInfos(const QVector<ProbeResult> &results)
+{
+    int first {m_tracks->count()};
+    int last {TrackTable::INVALID_ROW};
+
+    for (const auto &result : results) {
+        auto row = m_tracks->setInfo(result.id, result.info);
+        if (row != TrackTable::INVALID_ROW) {
+            first = std::min(first, row);
+            last = std::max(last, row);
+        }
+    }
+
+    /* One notification for the whole batch, the view repaints what's visible only */
+    if (last != TrackTable::INVALID_ROW) {
+        emit dataChanged(index(first), index(last), {Qt::DisplayRole, Qt::ToolTipRole});
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef TRACKLISTMODEL_HPP
+#define TRACKLISTMODEL_HPP
+
+#include <QAbstractListModel>
+#include <QStringList>
+#include <vector>
+
+#include "metadataprober.hpp"
+#include "tracktable.hpp"
+
+/* Backs the playlist view with the track table. Rows are only materialized when
+ * the view asks for them, and every change is announced in one batch rather than row by row.
+ * Changes to the table go through the model so views are always notified.
+ */
+class TrackListModel : public QAbstractListModel
+{
+    Q_OBJECT
+    TrackTable *m_tracks;
+public:
+    explicit TrackListModel(TrackTable *tracks, QObject *parent = nullptr);
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    void addTracks(const QStringList &paths);
+    void appendTracks(const QStringList &paths);
+    void setTracks(const QStringList &paths, bool keepOrder = false);
+    int appendTrack(const QString &path);
+    void removeTrack(int row);
+    void removeTracks(std::vector<int> rows);
+    void clear();
+    void setInfos(const QVector<ProbeResult> &results);
+};
+
+#endif // TRACKLISTMODEL_HPP
@@ -0,0 +1,447 @@
+#include <algorithm>
+
+#include "tracktable.hpp"
+
+/* Rebuild the arena once removed names take more than half of it */
+static constexpr qsizetype COMPACT_THRESHOLD {1'024 * 1'024};
+
+static size_t hashPath(const QString &path)
+{
+    return static_cast<size_t>(qHash(path));
+}
+
+TrackTable::TrackTable()
+    : m_arenaGarbage(0)
+    , m_staleRow(INVALID_ROW)
+    , m_totalDuration(0)
+    , m_sorted(true)
+{
+}
+
+int TrackTable::count() const
+{
+    return static_cast<int>(m_order.size());
+}
+
+bool TrackTable::isEmpty() const
+{
+    return m_order.empty();
+}
+
+TrackId TrackTable::id(int row) const
+{
+    return m_order[row];
+}
+
+int TrackTable::row(TrackId id) const
+{
+    if (id >= m_rows.size()) {
+        return INVALID_ROW;
+    }
+
+    renumber();
+    return m_rows[id];
+}
+
+int TrackTable::indexOf(const QString &path) const
+{
+    auto range = m_pathIndex.equal_range(hashPath(path));
+    for (auto it = range.first; it != range.second; ++it) {
+        if (pathOf(it->second) == path) {
+            return row(it->second);
+        }
+    }
+
+    return INVALID_ROW;
+}
+
+bool TrackTable::contains(const QString &path) const
+{
+    return indexOf(path) != INVALID_ROW;
+}
+
+QString TrackTable::path(int row) const
+{
+    return pathOf(m_order[row]);
+}
+
+QString TrackTable::name(int row) const
+{
+    return nameView(m_order[row]).toString();
+}
+
+QString TrackTable::directory(int row) const
+{
+    return m_directories[m_tracks[m_order[row]].directory];
+}
+
+QStringList TrackTable::paths() const
+{
+    QStringList paths;
+    paths.reserve(count());
+    for (auto id : m_order) {
+        paths << pathOf(id);
+    }
+
+    return paths;
+}
+
+QStringList TrackTable::directories() const
+{
+    QStringList directories;
+    for (int directory {}; directory < m_directories.size(); ++directory) {
+        if (m_directoryTracks[directory] > 0) {
+            directories << m_directories[directory];
+        }
+    }
+
+    return directories;
+}
+
+const TrackInfo &TrackTable::info(int row) const
+{
+    return m_infos[m_order[row]];
+}
+
+int TrackTable::setInfo(TrackId id, const TrackInfo &info)
+{
+    /* Removed tracks keep their id until the table is cleared */
+    auto row = this->row(id);
+    if (row == INVALID_ROW) {
+        return INVALID_ROW;
+    }
+
+    m_totalDuration += info.duration - m_infos[id].duration;
+    m_infos[id] = info;
+    m_trackIndex.add(id, {info.title, info.artist, info.album});
+    return row;
+}
+
+double TrackTable::totalDuration() const
+{
+    return m_totalDuration;
+}
+
+int TrackTable::append(const QString &path)
+{
+    auto existing = indexOf(path);
+    if (existing != INVALID_ROW) {
+        return existing;
+    }
+
+    auto id = insert(path);
+    m_order.push_back(id);
+    m_rows[id] = count() - 1;
+    m_sorted = false;
+    return m_rows[id];
+}
+
+int TrackTable::appendNew(const QStringList &paths)
+{
+    auto before = count();
+    for (const auto &path : paths) {
+        if (path.isEmpty() or contains(path)) {
+            continue;
+        }
+
+        auto id = insert(path);
+        m_order.push_back(id);
+        m_rows[id] = count() - 1;
+    }
+
+    return count() - before;
+}
+
+int TrackTable::appendInOrder(const QStringList &paths)
+{
+    auto added = appendNew(paths);
+    if (added > 0) {
+        m_sorted = false;
+    }
+    return added;
+}
+
+bool TrackTable::isSorted() const
+{
+    return m_sorted;
+}
+
+void TrackTable::sortFrom(int row)
+{
+    if (row >= count()) {
+        return;
+    }
+
+    /* Rank the directories once so sorting compares integers most of the time */
+    std::vector<quint32> directoryOrder(m_directories.size());
+    for (quint32 i {}; i < directoryOrder.size(); ++i) {
+        directoryOrder[i] = i;
+    }
+    std::sort(directoryOrder.begin(), directoryOrder.end(), [this](quint32 left, quint32 right) {
+        return m_directories[left] < m_directories[right];
+    });
+
+    std::vector<int> directoryRanks(directoryOrder.size());
+    for (int rank {}; rank < static_cast<int>(directoryOrder.size()); ++rank) {
+        directoryRanks[directoryOrder[rank]] = rank;
+    }
+
+    auto lessThan = [this, &directoryRanks](TrackId left, TrackId right) {
+        auto leftRank = directoryRanks[m_tracks[left].directory];
+        auto rightRank = directoryRanks[m_tracks[right].directory];
+        if (leftRank != rightRank) {
+            return leftRank < rightRank;
+        }
+
+        return nameView(left).compare(nameView(right)) < 0;
+    };
+
+    /* Only the new tracks are sorted, then merged in: the rest is in order already,
+     * unless a track was appended at the end
+     */
+    if (m_sorted) {
+        std::stable_sort(m_order.begin() + row, m_order.end(), lessThan);
+        std::inplace_merge(m_order.begin(), m_order.begin() + row, m_order.end(), lessThan);
+    } else {
+        std::stable_sort(m_order.begin(), m_order.end(), lessThan);
+        m_sorted = true;
+    }
+
+    updateRows();
+}
+
+void TrackTable::add(const QStringList &paths)
+{
+    sortFrom(count() - appendNew(paths));
+}
+
+void TrackTable::removeAt(int row)
+{
+    removeRange(row, 1);
+}
+
+void TrackTable::removeRange(int row, int count)
+{
+    if (row < 0 or count <= 0 or row + count > this->count()) {
+        return;
+    }
+
+    for (auto index = row; index < row + count; ++index) {
+        forget(m_order[index]);
+    }
+
+    m_order.erase(m_order.begin() + row, m_order.begin() + row + count);
+    updateRows(row);
+    if (m_arenaGarbage > COMPACT_THRESHOLD and m_arenaGarbage > m_arena.size() / 2) {
+        compact();
+    }
+}
+
+void TrackTable::removeRows(const std::vector<int> &rows)
+{
+    auto first = count();
+    for (auto row : rows) {
+        if (row >= 0 and row < count() and m_rows[m_order[row]] != INVALID_ROW) {
+            first = std::min(first, row);
+            forget(m_order[row]);
+        }
+    }
+
+    if (first == count()) {
+        return;
+    }
+
+    /* Forgotten tracks have no row anymore, what's left keeps its order */
+    m_order.erase(std::remove_if(m_order.begin() + first, m_order.end(), [this](TrackId id) {
+        return m_rows[id] == INVALID_ROW;
+    }), m_order.end());
+    updateRows(first);
+    if (m_arenaGarbage > COMPACT_THRESHOLD and m_arenaGarbage > m_arena.size() / 2) {
+        compact();
+    }
+}
+
+void TrackTable::clear()
+{
+    m_arena.clear();
+    m_arena.squeeze();
+    m_arenaGarbage = 0;
+    m_directories.clear();
+    m_directoryIds.clear();
+    m_directoryTracks.clear();
+    m_tracks.clear();
+    m_tracks.shrink_to_fit();
+    m_order.clear();
+    m_order.shrink_to_fit();
+    m_rows.clear();
+    m_rows.shrink_to_fit();
+    m_staleRow = INVALID_ROW;
+    m_pathIndex.clear();
+    m_infos.clear();
+    m_infos.shrink_to_fit();
+    m_totalDuration = 0;
+    m_sorted = true;
+    m_trackIndex.clear();
+    m_directoryIndex.clear();
+}
+
+std::vector<int> TrackTable::search(const QString &query)
+{
+    /* Longer words first, they narrow it down through the index before the short ones are read */
+    auto words = query.simplified().split(' ', Qt::SkipEmptyParts);
+    std::sort(words.begin(), words.end(), [](const QString &left, const QString &right) {
+        return left.size() > right.size();
+    });
+
+    /* By id, removed tracks are never looked at */
+    std::vector<char> matches(m_tracks.size(), 1);
+    std::vector<char> wordMatches;
+    std::vector<char> directoryMatches;
+    for (const auto &word : words) {
+        wordMatches.assign(m_tracks.size(), 0);
+        directoryMatches.assign(static_cast<size_t>(m_directories.size()), 0);
+
+        if (word.size() >= TrigramIndex::MIN_LENGTH) {
+            for (auto directory : m_directoryIndex.candidates(word)) {
+                directoryMatches[directory] = m_directories[directory].contains(word, Qt::CaseInsensitive);
+            }
+            /* Checked even for a word that is a single trigram: tags that changed leave their old postings behind */
+            for (auto id : m_trackIndex.candidates(word)) {
+                wordMatches[id] = matches[id] and textContains(id, word);
+            }
+        } else {
+            for (int directory {}; directory < m_directories.size(); ++directory) {
+                directoryMatches[directory] = m_directories[directory].contains(word, Qt::CaseInsensitive);
+            }
+            for (auto id : m_order) {
+                wordMatches[id] = matches[id] and not directoryMatches[m_tracks[id].directory] and textContains(id, word);
+            }
+        }
+
+        for (auto id : m_order) {
+            matches[id] = matches[id] and (wordMatches[id] or directoryMatches[m_tracks[id].directory]);
+        }
+    }
+
+    std::vector<int> rows;
+    for (int row {}; row < count(); ++row) {
+        if (matches[m_order[row]]) {
+            rows.push_back(row);
+        }
+    }
+
+    return rows;
+}
+
+TrackId TrackTable::insert(const QString &path)
+{
+    auto index = path.lastIndexOf('/');
+    auto directory = index < 0 ? QString() : path.left(index);
+
+    quint32 directoryId {};
+    auto it = m_directoryIds.constFind(directory);
+    if (it == m_directoryIds.constEnd()) {
+        directoryId = static_cast<quint32>(m_directories.count());
+        m_directories.append(directory);
+        m_directoryIds.insert(directory, directoryId);
+        m_directoryTracks.push_back(0);
+        m_directoryIndex.add(directoryId, directory);
+    } else {
+        directoryId = it.value();
+    }
+    ++m_directoryTracks[directoryId];
+
+    auto nameLength = path.size() - index - 1;
+    Track track {directoryId, static_cast<quint32>(m_arena.size()), static_cast<quint32>(nameLength)};
+    m_arena.append(path.constData() + index + 1, nameLength);
+
+    auto id = static_cast<TrackId>(m_tracks.size());
+    m_tracks.push_back(track);
+    m_rows.push_back(INVALID_ROW);
+    m_infos.emplace_back();
+    m_pathIndex.emplace(hashPath(path), id);
+    m_trackIndex.add(id, nameView(id));
+    return id;
+}
+
+QString TrackTable::pathOf(TrackId id) const
+{
+    const auto &track = m_tracks[id];
+    const auto &directory = m_directories[track.directory];
+
+    QString path;
+    path.reserve(directory.size() + 1 + static_cast<qsizetype>(track.nameLength));
+    if (not directory.isEmpty()) {
+        path.append(directory);
+        path.append('/');
+    }
+    path.append(m_arena.constData() + track.nameOffset, track.nameLength);
+    return path;
+}
+
+QStringView TrackTable::nameView(TrackId id) const
+{
+    const auto &track = m_tracks[id];
+    return QStringView(m_arena).mid(track.nameOffset, track.nameLength);
+}
+
+bool TrackTable::textContains(TrackId id, QStringView word) const
+{
+    const auto &info = m_infos[id];
+    return nameView(id).contains(word, Qt::CaseInsensitive) or info.title.contains(word, Qt::CaseInsensitive)
+           or info.artist.contains(word, Qt::CaseInsensitive) or info.album.contains(word, Qt::CaseInsensitive);
+}
+
+void TrackTable::forget(TrackId id)
+{
+    m_rows[id] = INVALID_ROW;
+    m_totalDuration -= m_infos[id].duration;
+    m_infos[id] = {};
+    --m_directoryTracks[m_tracks[id].directory];
+
+    auto range = m_pathIndex.equal_range(hashPath(pathOf(id)));
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == id) {
+            m_pathIndex.erase(it);
+            break;
+        }
+    }
+
+    m_arenaGarbage += m_tracks[id].nameLength;
+    m_tracks[id].nameLength = 0;
+}
+
+void TrackTable::updateRows(int from)
+{
+    if (m_staleRow == INVALID_ROW or from < m_staleRow) {
+        m_staleRow = from;
+    }
+}
+
+void TrackTable::renumber() const
+{
+    if (m_staleRow == INVALID_ROW) {
+        return;
+    }
+
+    for (int row {m_staleRow}; row < count(); ++row) {
+        m_rows[m_order[row]] = row;
+    }
+    m_staleRow = INVALID_ROW;
+}
+
+void TrackTable::compact()
+{
+    QString arena;
+    arena.reserve(m_arena.size() - m_arenaGarbage);
+
+    for (auto id : m_order) {
+        auto &track = m_tracks[id];
+        auto offset = static_cast<quint32>(arena.size());
+        arena.append(m_arena.constData() + track.nameOffset, track.nameLength);
+        track.nameOffset = offset;
+    }
+
+    m_arena = std::move(arena);
+    m_arenaGarbage = 0;
+}
@@ -0,0 +1,96 @@
+#ifndef TRACKTABLE_HPP
+#define TRACKTABLE_HPP
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QStringView>
+#include <unordered_map>
+#include <vector>
+
+#include "trackinfo.hpp"
+#include "trigramindex.hpp"
+
+using TrackId = quint32;
+
+/* The queue of songs. Every directory is stored once and every file name lives
+ * in a single string arena, so a track costs a few integers instead of two QStrings.
+ * Tracks keep their id for as long as they're in the table, rows change when sorting or removing.
+ * Names, tags and directories are indexed by trigram as they come in, so searching doesn't read
+ * the whole queue.
+ */
+class TrackTable
+{
+    struct Track
+    {
+        quint32 directory;
+        quint32 nameOffset;
+        quint32 nameLength;
+    };
+
+    QString m_arena;
+    qsizetype m_arenaGarbage;
+    QStringList m_directories;
+    QHash<QString, quint32> m_directoryIds;
+    /* Tracks in each directory, the ones down to 0 aren't watched anymore */
+    std::vector<quint32> m_directoryTracks;
+    std::vector<Track> m_tracks;
+    std::vector<TrackId> m_order;
+    /* Renumbered from m_staleRow on when a row is next asked for, so removing doesn't pay for it every time */
+    mutable std::vector<int> m_rows;
+    mutable int m_staleRow;
+    std::unordered_multimap<size_t, TrackId> m_pathIndex;
+    std::vector<TrackInfo> m_infos;
+    double m_totalDuration;
+    /* By directory, then name. Tracks appended one by one and imported playlists stay in their own order */
+    bool m_sorted;
+    /* Track ids by name and tags, directory ids by directory */
+    TrigramIndex m_trackIndex;
+    TrigramIndex m_directoryIndex;
+
+    TrackId insert(const QString &path);
+    QString pathOf(TrackId id) const;
+    QStringView nameView(TrackId id) const;
+    bool textContains(TrackId id, QStringView word) const;
+    void forget(TrackId id);
+    void updateRows(int from = 0);
+    void renumber() const;
+    void compact();
+public:
+    static constexpr int INVALID_ROW {-1};
+
+    TrackTable();
+    int count() const;
+    bool isEmpty() const;
+    TrackId id(int row) const;
+    int row(TrackId id) const;
+    int indexOf(const QString &path) const;
+    bool contains(const QString &path) const;
+    QString path(int row) const;
+    QString name(int row) const;
+    QString directory(int row) const;
+    QStringList paths() const;
+    /* Only those that still have tracks */
+    QStringList directories() const;
+    const TrackInfo &info(int row) const;
+    int setInfo(TrackId id, const TrackInfo &info);
+    double totalDuration() const;
+    int append(const QString &path);
+    /* At the end and in the given order, leaves out what's already there. Returns how many went in */
+    int appendNew(const QStringList &paths);
+    /* Like appendNew, but they're meant to stay in that order, so the table is no longer sorted */
+    int appendInOrder(const QStringList &paths);
+    bool isSorted() const;
+    /* Moves the tracks from row on into place */
+    void sortFrom(int row);
+    void add(const QStringList &paths);
+    void removeAt(int row);
+    void removeRange(int row, int count);
+    /* Ascending rows, all of them go in a single pass over the queue */
+    void removeRows(const std::vector<int> &rows);
+    void clear();
+    /* Ascending rows of the tracks that have every word of the query in their name, directory or tags */
+    std::vector<int> search(const QString &query);
+};
+
+#endif // TRACKTABLE_HPP
@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <iterator>
+
+#include "trigramindex.hpp"
+
+static quint16 fold(QChar character)
+{
+    auto unicode = character.unicode();
+    if (unicode < 128) {
+        return unicode >= 'A' and unicode <= 'Z' ? unicode + ('a' - 'A') : unicode;
+    }
+
+    return QChar::toCaseFolded(unicode);
+}
+
+void TrigramIndex::trigrams(QStringView text, std::vector<quint64> &keys)
+{
+    if (text.size() < MIN_LENGTH) {
+        return;
+    }
+
+    quint64 key = (static_cast<quint64>(fold(text[0])) << 16) | fold(text[1]);
+    for (qsizetype i {2}; i < text.size(); ++i) {
+        key = ((key << 16) | fold(text[i])) & 0xFFFF'FFFF'FFFFull;
+        keys.push_back(key);
+    }
+}
+
+void TrigramIndex::add(quint32 id, QStringView text)
+{
+    add(id, {text});
+}
+
+void TrigramIndex::add(quint32 id, std::initializer_list<QStringView> texts)
+{
+    /* Each trigram once per id, however often it appears */
+    std::vector<quint64> keys;
+    for (auto text : texts) {
+        trigrams(text, keys);
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    for (auto key : keys) {
+        auto &postings = m_postings[key];
+        if (not postings.ids.empty() and postings.ids.back() >= id) {
+            postings.sorted = false;
+        }
+        postings.ids.push_back(id);
+    }
+}
+
+std::vector<quint32> TrigramIndex::candidates(QStringView word)
+{
+    std::vector<quint64> keys;
+    trigrams(word, keys);
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    std::vector<Postings *> lists;
+    lists.reserve(keys.size());
+    for (auto key : keys) {
+        auto it = m_postings.find(key);
+        if (it == m_postings.end()) {
+            return {};
+        }
+
+        auto &postings = it->second;
+        if (not postings.sorted) {
+            /* Texts added again for the same id, like tags read twice, leave duplicates behind */
+            std::sort(postings.ids.begin(), postings.ids.end());
+            postings.ids.erase(std::unique(postings.ids.begin(), postings.ids.end()), postings.ids.end());
+            postings.sorted = true;
+        }
+        lists.push_back(&postings);
+    }
+
+    if (lists.empty()) {
+        return {};
+    }
+
+    /* Rarest first, the result only shrinks from there */
+    std::sort(lists.begin(), lists.end(), [](const Postings *left, const Postings *right) {
+        return left->ids.size() < right->ids.size();
+    });
+
+    auto result = lists.front()->ids;
+    std::vector<quint32> intersection;
+    for (size_t i {1}; i < lists.size() and not result.empty(); ++i) {
+        intersection.clear();
+        std::set_intersection(result.cbegin(), result.cend(), lists[i]->ids.cbegin(), lists[i]->ids.cend(),
+                              std::back_inserter(intersection));
+        result.swap(intersection);
+    }
+
+    return result;
+}
+
+void TrigramIndex::clear()
+{
+    m_postings.clear();
+}
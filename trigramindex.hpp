@@ -0,0 +1,38 @@
+#ifndef TRIGRAMINDEX_HPP
+#define TRIGRAMINDEX_HPP
+
+#include <initializer_list>
+#include <QStringView>
+#include <unordered_map>
+#include <vector>
+
+/* Maps every three letters, case folded, to the ids of the texts they appear in.
+ * A word can only be in a text that has all of its trigrams, so looking one up intersects
+ * a few id lists instead of reading every text. What comes out are candidates: the letters
+ * may be there in another order, whoever asks still checks the text itself.
+ * Nothing is ever removed, ids that are gone are skipped by the caller until it clears the index.
+ */
+class TrigramIndex
+{
+    struct Postings
+    {
+        std::vector<quint32> ids;
+        /* Ids mostly come in order, the rest are sorted when the list is next read */
+        bool sorted {true};
+    };
+
+    std::unordered_map<quint64, Postings> m_postings;
+
+    static void trigrams(QStringView text, std::vector<quint64> &keys);
+public:
+    /* Words shorter than this have no trigram, they can't be looked up */
+    static constexpr int MIN_LENGTH {3};
+
+    void add(quint32 id, QStringView text);
+    void add(quint32 id, std::initializer_list<QStringView> texts);
+    /* Ascending, empty when no text has all of the word's trigrams */
+    std::vector<quint32> candidates(QStringView word);
+    void clear();
+};
+
+#endif // TRIGRAMINDEX_HPP